@@ -0,0 +1,500 @@
+#include "AdaptiveTerrain.h"
+#include <algorithm>
+#include <cmath>
+#include <functional>
+
+using namespace std;
+
+namespace {
+
+// Twice the signed area of (a, b, c) in grid coordinates; the triangles of
+// MeshBuilder::buildIndices are negative
+inline long long orient(int ax, int az, int bx, int bz, int cx, int cz) {
+	return (long long)(bx - ax) * (cz - az) - (long long)(bz - az) * (cx - ax);
+}
+
+// World heights of a grid, row-major
+struct HeightField {
+	vector<float> heights;
+	int width, height;
+
+	HeightField(const HeightGrid& grid, const MeshSettings& mesh) : heights(grid.data.size()), width(grid.width), height(grid.height) {
+		for (size_t i = 0; i < heights.size(); i++)
+			heights[i] = grid.data[i] * mesh.heightScale + mesh.heightOffset;
+	}
+
+	// Largest vertical distance between triangle (a, b, c) and the samples
+	// inside it or on its edges. Stops as soon as it exceeds limit
+	float triangleError(unsigned int a, unsigned int b, unsigned int c, float limit) const {
+		int ax = a % width, az = a / width;
+		int bx = b % width, bz = b / width;
+		int cx = c % width, cz = c / width;
+		long long area = orient(ax, az, bx, bz, cx, cz);
+		if (area == 0)
+			return 0.0f;
+		double inverse = 1.0 / (double)area;
+		double ha = heights[a], hb = heights[b], hc = heights[c];
+		int z0 = min(az, min(bz, cz)), z1 = max(az, max(bz, cz));
+		const int ex[3][2] = { { ax, bx }, { bx, cx }, { cx, ax } };
+		const int ez[3][2] = { { az, bz }, { bz, cz }, { cz, az } };
+
+		float worst = 0.0f;
+		for (int z = z0; z <= z1; z++) {
+			// Span of the row between the edges it crosses, widened a little;
+			// the exact test below decides
+			double lo = INFINITY, hi = -INFINITY;
+			for (int e = 0; e < 3; e++) {
+				if (z < min(ez[e][0], ez[e][1]) || z > max(ez[e][0], ez[e][1]))
+					continue;
+				if (ez[e][0] == ez[e][1]) {
+					lo = min(lo, (double)min(ex[e][0], ex[e][1]));
+					hi = max(hi, (double)max(ex[e][0], ex[e][1]));
+					continue;
+				}
+				double x = ex[e][0] + (double)(ex[e][1] - ex[e][0]) * (z - ez[e][0]) / (ez[e][1] - ez[e][0]);
+				lo = min(lo, x);
+				hi = max(hi, x);
+			}
+			const float* row = &heights[(size_t)z * width];
+			int x0 = (int)ceil(lo - 1e-6), x1 = (int)floor(hi + 1e-6);
+			// Barycentric weights times the area, exact in integers and
+			// linear along the row
+			long long wa = orient(bx, bz, cx, cz, x0, z);
+			long long wb = orient(cx, cz, ax, az, x0, z);
+			long long wc = orient(ax, az, bx, bz, x0, z);
+			for (int x = x0; x <= x1; x++, wa -= cz - bz, wb -= az - cz, wc -= bz - az) {
+				bool inside = area < 0 ? wa <= 0 && wb <= 0 && wc <= 0 : wa >= 0 && wb >= 0 && wc >= 0;
+				if (!inside)
+					continue;
+				double h = (wa * ha + wb * hb + wc * hc) * inverse;
+				worst = max(worst, (float)fabs(h - row[x]));
+				if (worst > limit)
+					return worst;
+			}
+		}
+		return worst;
+	}
+};
+
+// Append triangle (a, b, c) with MeshBuilder's winding
+void emit(const HeightField& field, unsigned int a, unsigned int b, unsigned int c, vector<unsigned int>& triangles) {
+	int w = field.width;
+	if (orient(a % w, a / w, b % w, b / w, c % w, c / w) > 0)
+		swap(b, c);
+	triangles.push_back(a);
+	triangles.push_back(b);
+	triangles.push_back(c);
+}
+
+// Martini's RTIN over a (2^k + 1)^2 grid. Every triangle of the bisection
+// tree is named by its hypotenuse midpoint, which it shares with the
+// triangle across the hypotenuse. errors[m] is the largest error of either
+// triangle if it is not split, raised to the errors of their children, so a
+// split always reaches the neighbour too and the mesh has no T-junctions.
+// Unlike Martini, which only measures the midpoints, the error of a triangle
+// is measured over every sample it covers, so the bound is exact
+void buildRtin(const HeightField& field, float maxError, vector<unsigned int>& triangles) {
+	int size = field.width;
+	int tile = size - 1;
+	// A 32769 x 32769 map already has over 2^31 triangles
+	size_t count = (size_t)tile * tile * 2 - 2;
+	size_t parents = count - (size_t)tile * tile;
+	vector<float> errors((size_t)size * size, 0.0f);
+
+	// Finest triangles first, so the children are done before their parent
+	for (size_t i = count; i-- > 0;) {
+		size_t id = i + 2;
+		int ax = 0, az = 0, bx = 0, bz = 0, cx = 0, cz = 0;
+		if (id & 1)
+			bx = bz = cx = tile;
+		else
+			ax = az = cz = tile;
+		while ((id >>= 1) > 1) {
+			int mx = (ax + bx) >> 1, mz = (az + bz) >> 1;
+			if (id & 1) {
+				bx = ax; bz = az;
+				ax = cx; az = cz;
+			}
+			else {
+				ax = bx; az = bz;
+				bx = cx; bz = cz;
+			}
+			cx = mx; cz = mz;
+		}
+
+		int mx = (ax + bx) >> 1, mz = (az + bz) >> 1;
+		size_t m = (size_t)mz * size + mx;
+		float error = field.triangleError(az * size + ax, bz * size + bx, cz * size + cx, maxError);
+		if (i < parents) {
+			// Midpoints of the children's hypotenuses, the legs of this triangle
+			size_t left = (size_t)((az + cz) >> 1) * size + ((ax + cx) >> 1);
+			size_t right = (size_t)((bz + cz) >> 1) * size + ((bx + cx) >> 1);
+			error = max(error, max(errors[left], errors[right]));
+		}
+		errors[m] = max(errors[m], error);
+	}
+
+	function<void(int, int, int, int, int, int)> process = [&](int ax, int az, int bx, int bz, int cx, int cz) {
+		int mx = (ax + bx) >> 1, mz = (az + bz) >> 1;
+		if (abs(ax - cx) + abs(az - cz) > 1 && errors[(size_t)mz * size + mx] > maxError) {
+			process(cx, cz, ax, az, mx, mz);
+			process(bx, bz, cx, cz, mx, mz);
+		}
+		else
+			emit(field, az * size + ax, bz * size + bx, cz * size + cx, triangles);
+	};
+	process(0, 0, tile, tile, tile, 0);
+	process(tile, tile, 0, 0, 0, tile);
+}
+
+// Symmetric 4x4 matrix of the squared distance to a set of planes
+struct Quadric {
+	double q[10];
+
+	Quadric() { fill(q, q + 10, 0.0); }
+	Quadric(double a, double b, double c, double d) {
+		q[0] = a * a; q[1] = a * b; q[2] = a * c; q[3] = a * d;
+		q[4] = b * b; q[5] = b * c; q[6] = b * d;
+		q[7] = c * c; q[8] = c * d;
+		q[9] = d * d;
+	}
+	Quadric& operator+=(const Quadric& other) {
+		for (int i = 0; i < 10; i++)
+			q[i] += other.q[i];
+		return *this;
+	}
+	double evaluate(double x, double y, double z) const {
+		return q[0] * x * x + 2.0 * q[1] * x * y + 2.0 * q[2] * x * z + 2.0 * q[3] * x
+			+ q[4] * y * y + 2.0 * q[5] * y * z + 2.0 * q[6] * y
+			+ q[7] * z * z + 2.0 * q[8] * z + q[9];
+	}
+};
+
+// Binary min-heap of vertices keyed on their cheapest collapse, with the
+// place of every vertex so a key can change in place. One entry per vertex,
+// rather than one per queued edge, keeps it small
+constexpr unsigned int NOT_QUEUED = ~0u;
+
+class VertexHeap {
+	vector<pair<float, unsigned int>> heap;
+	vector<unsigned int> slot;
+public:
+	explicit VertexHeap(size_t vertices) : slot(vertices, NOT_QUEUED) {}
+
+	bool empty() const { return heap.empty(); }
+	unsigned int top() const { return heap[0].second; }
+
+	void update(unsigned int v, float cost) {
+		if (slot[v] == NOT_QUEUED) {
+			heap.push_back(make_pair(cost, v));
+			slot[v] = (unsigned int)heap.size() - 1;
+			up(slot[v]);
+		}
+		else {
+			heap[slot[v]].first = cost;
+			up(slot[v]);
+			down(slot[v]);
+		}
+	}
+	void remove(unsigned int v) {
+		unsigned int i = slot[v];
+		if (i == NOT_QUEUED)
+			return;
+		slot[v] = NOT_QUEUED;
+		if (i + 1 == heap.size()) {
+			heap.pop_back();
+			return;
+		}
+		unsigned int moved = heap.back().second;
+		place(i, heap.back());
+		heap.pop_back();
+		up(i);
+		down(slot[moved]);
+	}
+private:
+	void place(unsigned int i, const pair<float, unsigned int>& entry) {
+		heap[i] = entry;
+		slot[entry.second] = i;
+	}
+	void up(unsigned int i) {
+		pair<float, unsigned int> entry = heap[i];
+		while (i > 0 && entry.first < heap[(i - 1) / 2].first) {
+			place(i, heap[(i - 1) / 2]);
+			i = (i - 1) / 2;
+		}
+		place(i, entry);
+	}
+	void down(unsigned int i) {
+		pair<float, unsigned int> entry = heap[i];
+		size_t n = heap.size();
+		for (;;) {
+			size_t child = 2 * (size_t)i + 1;
+			if (child >= n)
+				break;
+			if (child + 1 < n && heap[child + 1].first < heap[child].first)
+				child++;
+			if (!(heap[child].first < entry.first))
+				break;
+			place(i, heap[child]);
+			i = (unsigned int)child;
+		}
+		place(i, entry);
+	}
+};
+
+class Decimator {
+	const HeightField& field;
+	float maxError;
+	double step;
+	vector<unsigned int> corners;
+	vector<char> alive;
+	// Triangles around every vertex
+	vector<vector<unsigned int>> star;
+	vector<Quadric> quadrics;
+	VertexHeap queue;
+	// Scratch: neighbours of a vertex, and its collapses ordered by cost
+	vector<unsigned int> neighbours;
+	vector<pair<double, unsigned int>> targets;
+	vector<unsigned int> seen;
+	unsigned int visit;
+public:
+	Decimator(const HeightField& _field, float _maxError, double _step) : field(_field), maxError(_maxError), step(_step),
+		queue((size_t)_field.width * _field.height), visit(0) {}
+
+	void run(vector<unsigned int>& triangles) {
+		int width = field.width, height = field.height;
+		size_t vertices = (size_t)width * height;
+		star.assign(vertices, vector<unsigned int>());
+		quadrics.assign(vertices, Quadric());
+		seen.assign(vertices, 0);
+		corners.reserve(vertices * 6);
+		alive.reserve(vertices * 2);
+		for (int z = 0; z + 1 < height; z++) {
+			for (int x = 0; x + 1 < width; x++) {
+				unsigned int topLeft = (unsigned int)z * width + x;
+				unsigned int bottomLeft = topLeft + width;
+				addTriangle(topLeft, bottomLeft, topLeft + 1);
+				addTriangle(topLeft + 1, bottomLeft, bottomLeft + 1);
+			}
+		}
+		for (size_t t = 0; t < alive.size(); t++) {
+			const unsigned int* c = &corners[t * 3];
+			Quadric plane = planeOf(c[0], c[1], c[2]);
+			for (int k = 0; k < 3; k++)
+				quadrics[c[k]] += plane;
+		}
+		for (unsigned int v = 0; v < vertices; v++)
+			enqueue(v);
+
+		while (!queue.empty()) {
+			unsigned int v = queue.top();
+			queue.remove(v);
+			tryCollapse(v);
+		}
+
+		triangles.clear();
+		for (size_t t = 0; t < alive.size(); t++)
+			if (alive[t])
+				triangles.insert(triangles.end(), &corners[t * 3], &corners[t * 3 + 3]);
+	}
+private:
+	void addTriangle(unsigned int a, unsigned int b, unsigned int c) {
+		unsigned int t = (unsigned int)alive.size();
+		corners.push_back(a);
+		corners.push_back(b);
+		corners.push_back(c);
+		alive.push_back(1);
+		star[a].push_back(t);
+		star[b].push_back(t);
+		star[c].push_back(t);
+	}
+
+	void position(unsigned int v, double& x, double& y, double& z) const {
+		x = (v % field.width) * step;
+		y = field.heights[v];
+		z = (v / field.width) * step;
+	}
+
+	Quadric planeOf(unsigned int a, unsigned int b, unsigned int c) const {
+		double p[3][3];
+		position(a, p[0][0], p[0][1], p[0][2]);
+		position(b, p[1][0], p[1][1], p[1][2]);
+		position(c, p[2][0], p[2][1], p[2][2]);
+		double ux = p[1][0] - p[0][0], uy = p[1][1] - p[0][1], uz = p[1][2] - p[0][2];
+		double vx = p[2][0] - p[0][0], vy = p[2][1] - p[0][1], vz = p[2][2] - p[0][2];
+		double nx = uy * vz - uz * vy, ny = uz * vx - ux * vz, nz = ux * vy - uy * vx;
+		double length = sqrt(nx * nx + ny * ny + nz * nz);
+		if (length == 0.0)
+			return Quadric();
+		nx /= length; ny /= length; nz /= length;
+		return Quadric(nx, ny, nz, -(nx * p[0][0] + ny * p[0][1] + nz * p[0][2]));
+	}
+
+	void gatherNeighbours(unsigned int v) {
+		neighbours.clear();
+		// Flat ground collapses into wide fans, so duplicates are found
+		// through a mark per vertex rather than by searching the list
+		visit++;
+		seen[v] = visit;
+		for (unsigned int t : star[v]) {
+			const unsigned int* c = &corners[t * 3];
+			for (int k = 0; k < 3; k++) {
+				if (seen[c[k]] != visit) {
+					seen[c[k]] = visit;
+					neighbours.push_back(c[k]);
+				}
+			}
+		}
+	}
+
+	// Fill targets with the neighbours v may move onto, cheapest first
+	void gatherTargets(unsigned int v) {
+		gatherNeighbours(v);
+		targets.clear();
+		for (unsigned int n : neighbours) {
+			if (!allowed(v, n))
+				continue;
+			double x, y, z;
+			position(n, x, y, z);
+			targets.push_back(make_pair(quadrics[v].evaluate(x, y, z) + quadrics[n].evaluate(x, y, z), n));
+		}
+		sort(targets.begin(), targets.end());
+	}
+
+	void enqueue(unsigned int v) {
+		gatherTargets(v);
+		if (targets.empty())
+			queue.remove(v);
+		else
+			queue.update(v, (float)targets[0].first);
+	}
+
+	// The map outline stays put: corners never move and a border vertex only
+	// moves along its own side
+	bool allowed(unsigned int from, unsigned int to) const {
+		int w = field.width, h = field.height;
+		int fx = from % w, fz = from / w, tx = to % w, tz = to / w;
+		bool sideX = fx == 0 || fx == w - 1;
+		bool sideZ = fz == 0 || fz == h - 1;
+		if (sideX && sideZ)
+			return false;
+		if (sideX)
+			return tx == fx;
+		if (sideZ)
+			return tz == fz;
+		return true;
+	}
+
+	// Every triangle that keeps from's place after the move must keep its
+	// winding and fit the samples under it
+	bool fits(unsigned int from, unsigned int to) const {
+		int w = field.width;
+		for (unsigned int t : star[from]) {
+			unsigned int c[3] = { corners[t * 3], corners[t * 3 + 1], corners[t * 3 + 2] };
+			if (c[0] == to || c[1] == to || c[2] == to)
+				continue;
+			for (int k = 0; k < 3; k++)
+				if (c[k] == from)
+					c[k] = to;
+			if (orient(c[0] % w, c[0] / w, c[1] % w, c[1] / w, c[2] % w, c[2] / w) >= 0)
+				return false;
+			if (field.triangleError(c[0], c[1], c[2], maxError) > maxError)
+				return false;
+		}
+		return true;
+	}
+
+	// Collapse v onto its cheapest neighbour that fits. A vertex that can't
+	// move waits until one of its neighbours changes its star
+	void tryCollapse(unsigned int v) {
+		gatherTargets(v);
+		for (const pair<double, unsigned int>& target : targets) {
+			if (fits(v, target.second)) {
+				collapse(v, target.second);
+				return;
+			}
+		}
+	}
+
+	void unlink(unsigned int v, unsigned int t) {
+		vector<unsigned int>& s = star[v];
+		auto found = find(s.begin(), s.end(), t);
+		if (found != s.end()) {
+			*found = s.back();
+			s.pop_back();
+		}
+	}
+
+	void collapse(unsigned int from, unsigned int to) {
+		for (unsigned int t : star[from]) {
+			unsigned int* c = &corners[t * 3];
+			if (c[0] == to || c[1] == to || c[2] == to) {
+				alive[t] = 0;
+				for (int k = 0; k < 3; k++)
+					if (c[k] != from)
+						unlink(c[k], t);
+				continue;
+			}
+			for (int k = 0; k < 3; k++)
+				if (c[k] == from)
+					c[k] = to;
+			star[to].push_back(t);
+		}
+		star[from].clear();
+		quadrics[to] += quadrics[from];
+		queue.remove(from);
+
+		// to and every vertex around it have a new star
+		gatherNeighbours(to);
+		vector<unsigned int> changed(neighbours);
+		changed.push_back(to);
+		for (unsigned int v : changed)
+			enqueue(v);
+	}
+};
+
+}
+
+AdaptiveTerrain::AdaptiveTerrain(const HeightGrid& grid, const AdaptiveSettings& _settings, ThreadPool& pool)
+	: settings(_settings), method(_settings.method) {
+	if (grid.width < 2 || grid.height < 2)
+		return;
+
+	HeightField field(grid, settings.mesh);
+	MeshBuilder builder(grid.width, grid.height, gridRows(grid), settings.mesh);
+	int cells = grid.width - 1;
+	bool square = grid.width == grid.height && (cells & (cells - 1)) == 0;
+	if (method == AdaptiveMethod::Rtin && !square)
+		method = AdaptiveMethod::Quadric;
+
+	vector<unsigned int> triangles;
+	if (method == AdaptiveMethod::Rtin)
+		buildRtin(field, settings.maxError, triangles);
+	else
+		Decimator(field, settings.maxError, builder.spacing()).run(triangles);
+
+	// Keep the vertices the triangles use, in order of first use
+	vector<Vertex> full;
+	builder.buildInterleaved(full, pool);
+	vector<unsigned int> remap(full.size(), ~0u);
+	indices.resize(triangles.size());
+	for (size_t i = 0; i < triangles.size(); i++) {
+		unsigned int s = triangles[i];
+		if (remap[s] == ~0u) {
+			remap[s] = (unsigned int)vertices.size();
+			vertices.push_back(full[s]);
+			samples.push_back(s);
+		}
+		indices[i] = remap[s];
+	}
+}
+
+float AdaptiveTerrain::measureError(const HeightGrid& grid) const {
+	HeightField field(grid, settings.mesh);
+	float worst = 0.0f;
+	for (size_t i = 0; i + 2 < indices.size(); i += 3) {
+		float error = field.triangleError(samples[indices[i]], samples[indices[i + 1]], samples[indices[i + 2]], INFINITY);
+		worst = max(worst, error);
+	}
+	return worst;
+}
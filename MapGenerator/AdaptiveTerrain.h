@@ -0,0 +1,52 @@
+// Adaptive triangulation of a height grid for static export: flat ground gets
+// a few large triangles, rough ground keeps the full resolution, and no
+// sample of the grid lies further than maxError (vertically, in world units)
+// from the mesh. Vertices are grid samples with the normals of the full
+// resolution mesh, in the same Vertex layout and winding as Terrain
+#pragma once
+
+#include "Vertex.h"
+#include "HeightGrid.h"
+#include "MeshBuilder.h"
+#include "ThreadPool.h"
+#include <vector>
+
+enum class AdaptiveMethod {
+	// Right-triangulated irregular network (Martini): longest-edge bisection of
+	// the two halves of a square of 2^k + 1 samples. Fast and crack-free by
+	// construction; other grid sizes fall back to Quadric
+	Rtin,
+	// Half-edge collapses in order of quadric error, each one kept only if the
+	// triangles it changes still fit the samples under them. Slower, but
+	// triangles can have any shape and the grid any size
+	Quadric
+};
+
+struct AdaptiveSettings {
+	AdaptiveMethod method;
+	// Largest vertical distance between the mesh and any sample, in world units
+	float maxError;
+	MeshSettings mesh;
+
+	AdaptiveSettings() : method(AdaptiveMethod::Rtin), maxError(0.5f) {}
+};
+
+class AdaptiveTerrain {
+public:
+	std::vector<Vertex> vertices;
+	std::vector<unsigned int> indices;
+	// Grid sample (z * width + x) of every vertex
+	std::vector<unsigned int> samples;
+
+	AdaptiveTerrain(const HeightGrid& grid, const AdaptiveSettings& settings = AdaptiveSettings(), ThreadPool& pool = ThreadPool::shared());
+
+	size_t triangleCount() const { return indices.size() / 3; }
+	// Method actually used, after the RTIN size fallback
+	AdaptiveMethod getMethod() const { return method; }
+	// Largest vertical distance between the mesh and the samples of grid, in
+	// world units, found by rasterizing every triangle over the grid
+	float measureError(const HeightGrid& grid) const;
+private:
+	AdaptiveSettings settings;
+	AdaptiveMethod method;
+};
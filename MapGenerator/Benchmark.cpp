@@ -0,0 +1,1264 @@
+#include "Benchmark.h"
+#include "PerlinNoise.h"
+#include "HeightmapGenerator.h"
+#include "FractalNoise.h"
+#include "ppm.h"
+#include "pnm.h"
+#include "HeightmapView.h"
+#include "HeightFile.h"
+#include "MeshBuilder.h"
+#include "NormalPass.h"
+#include "ChunkedTerrain.h"
+#include "AdaptiveTerrain.h"
+#include "GridIndices.h"
+#include "TileService.h"
+#include "TilePipeline.h"
+#include "Camera.h"
+#include "Erosion.h"
+#include "NoiseSource.h"
+#include "BasicPerlinNoise.h"
+#include "Random.h"
+#include "DomainWarp.h"
+#include "SoftwareRasterizer.h"
+#include "TerrainQuery.h"
+#include "EditableTerrain.h"
+#include "NoiseKernels.h"
+#include "Stopwatch.h"
+
+#include <vector>
+#include <cmath>
+#include <algorithm>
+#include <thread>
+#include <cstring>
+#include <cstdio>
+#include <set>
+#include <random>
+#include <numeric>
+
+using namespace std;
+
+// Keeps the optimizer from dropping a benchmark loop whose result is unused
+static volatile float s_sink;
+
+void benchNoiseRow(ostream& out, int size) {
+	PerlinNoise pn(237);
+	vector<float> reference(size * (size_t)size);
+	vector<float> row(size);
+	double step = 10.0 / size;
+
+	Stopwatch timer;
+	for (int i = 0; i < size; i++) {
+		for (int j = 0; j < size; j++)
+			reference[(size_t)i * size + j] = (float)pn.noise(step * j, step * i, 0.8);
+	}
+	double scalarTime = timer.seconds();
+	double samples = (double)size * size;
+
+	out << "noise " << size << "x" << size << "\n";
+	out << "  noise() loop    " << samples / scalarTime / 1e6 << " Msamples/s\n";
+
+	SimdLevel best = detectSimdLevel();
+	SimdLevel levels[] = { SimdLevel::Scalar, SimdLevel::SSE41, SimdLevel::AVX2 };
+	for (SimdLevel level : levels) {
+		if (level > best)
+			break;
+
+		timer.restart();
+		for (int i = 0; i < size; i++) {
+			pn.noiseRow(step * i, 0.8, 0.0, step, size, row.data(), level);
+			s_sink = row[i % size];
+		}
+		double time = timer.seconds();
+
+		double maxError = 0.0;
+		for (int i = 0; i < size; i++) {
+			pn.noiseRow(step * i, 0.8, 0.0, step, size, row.data(), level);
+			for (int j = 0; j < size; j++)
+				maxError = max(maxError, (double)fabs(row[j] - reference[(size_t)i * size + j]));
+		}
+
+		out << "  noiseRow " << simdLevelName(level) << "\t" << samples / time / 1e6 << " Msamples/s"
+			<< " (x" << scalarTime / time << ", max error " << maxError << ")\n";
+	}
+}
+
+void benchHeightmap(ostream& out, int size) {
+	HeightmapGenerator generator;
+	HeightGrid reference(size, size);
+
+	Stopwatch timer;
+	generator.generateTile(reference, 0, 0, size, size);
+	double serialTime = timer.seconds();
+	double samples = (double)size * size;
+
+	out << "heightmap " << size << "x" << size << "\n";
+	out << "  single thread   " << samples / serialTime / 1e6 << " Msamples/s\n";
+
+	unsigned int maxThreads = max(1u, thread::hardware_concurrency());
+	for (unsigned int threads = 1; threads <= maxThreads; threads *= 2) {
+		ThreadPool pool(threads);
+		HeightGrid grid(size, size);
+
+		timer.restart();
+		generator.generate(grid, pool);
+		double time = timer.seconds();
+
+		bool identical = memcmp(grid.data.data(), reference.data.data(), grid.data.size() * sizeof(float)) == 0;
+		out << "  " << threads << " workers\t" << samples / time / 1e6 << " Msamples/s"
+			<< " (x" << serialTime / time << (identical ? ", identical" : ", MISMATCH") << ")\n";
+	}
+}
+
+void benchFractal(ostream& out, int size) {
+	vector<float> row(size);
+	double step = 10.0 / size;
+	double samples = (double)size * size;
+
+	out << "fractal " << size << "x" << size << "\n";
+	for (int octaves : { 8, 12 }) {
+		// Naive reference: every octave is a full scalar noise() evaluation
+		PerlinNoise pn(237);
+		Stopwatch timer;
+		double sum = 0.0;
+		for (int i = 0; i < size; i++) {
+			for (int j = 0; j < size; j++) {
+				double f = 1.0, a = 1.0, n = 0.0;
+				for (int k = 0; k < octaves; k++) {
+					n += a * pn.noise(step * j * f, step * i * f, 0.8 * f);
+					f *= 2.0;
+					a *= 0.5;
+				}
+				sum += n;
+			}
+		}
+		double naiveTime = timer.seconds();
+		s_sink = (float)sum;
+		out << "  " << octaves << " octaves, scalar loop\t" << samples / naiveTime / 1e6 << " Msamples/s\n";
+
+		for (int bits : { 8, 16 }) {
+			FractalSettings settings;
+			settings.octaves = octaves;
+			settings.epsilon = 0.5 / ((1 << bits) - 1);
+			FractalNoise fractal(237, settings);
+
+			timer.restart();
+			for (int i = 0; i < size; i++) {
+				fractal.noiseRow(step * i, 0.8, 0.0, step, size, row.data());
+				s_sink = row[i % size];
+			}
+			double time = timer.seconds();
+			out << "  " << octaves << " octaves, rows, " << bits << "-bit cut-off\t" << samples / time / 1e6 << " Msamples/s"
+				<< " (x" << naiveTime / time << ", " << fractal.getActiveOctaves() << " octaves evaluated)\n";
+		}
+	}
+}
+
+void benchPnm(ostream& out, const string& path, int size) {
+	ppm image(size, size);
+	for (uint64_t i = 0; i < image.size; i++) {
+		image.r[i] = (unsigned char)i;
+		image.g[i] = (unsigned char)(i >> 8);
+		image.b[i] = (unsigned char)(i >> 16);
+	}
+	double megabytes = image.size * 3 / 1e6;
+
+	out << "pnm " << size << "x" << size << "\n";
+	Stopwatch timer;
+	image.write(path);
+	double writeTime = timer.seconds();
+
+	timer.restart();
+	ppm copy(path);
+	double readTime = timer.seconds();
+	bool identical = copy.r == image.r && copy.g == image.g && copy.b == image.b;
+	out << "  ppm P6 8-bit\twrite " << megabytes / writeTime << " MB/s, read " << megabytes / readTime << " MB/s"
+		<< (identical ? "" : " (MISMATCH)") << "\n";
+
+	// 16-bit grayscale in bands of 64 rows
+	const unsigned int bandRows = 64;
+	vector<uint16_t> band((size_t)bandRows * size);
+	pnm_writer writer;
+	timer.restart();
+	writer.open(path, pnm_header(1, size, size, 65535));
+	for (unsigned int row = 0; row < (unsigned int)size; row += bandRows) {
+		unsigned int rows = min(bandRows, size - row);
+		for (size_t i = 0; i < (size_t)rows * size; i++)
+			band[i] = (uint16_t)(row * size + i);
+		writer.write_rows(rows, band.data());
+	}
+	writer.close();
+	writeTime = timer.seconds();
+
+	pnm_reader reader;
+	timer.restart();
+	reader.open(path);
+	while (reader.rows_left() > 0) {
+		unsigned int rows = min(bandRows, reader.rows_left());
+		reader.read_rows(rows, band.data());
+	}
+	readTime = timer.seconds();
+	megabytes = (double)size * size * 2 / 1e6;
+	out << "  pnm P5 16-bit\twrite " << megabytes / writeTime << " MB/s, read " << megabytes / readTime << " MB/s\n";
+
+	remove(path.c_str());
+}
+
+void benchHeightmapView(ostream& out, const string& path, int size) {
+	{
+		ppm image(size, size);
+		for (uint64_t i = 0; i < image.size; i++)
+			image.r[i] = image.g[i] = image.b[i] = (unsigned char)(i * 7);
+		image.write(path);
+	}
+	out << "heightmap view " << size << "x" << size << "\n";
+
+	Stopwatch timer;
+	ppm copy(path);
+	double copyTime = timer.seconds();
+	out << "  ppm decode copy\t" << copyTime * 1000.0 << " ms, " << copy.size * 3 / 1e6 << " MB allocated\n";
+
+	timer.restart();
+	HeightmapView view(path);
+	double openTime = timer.seconds();
+	vector<float> row(size);
+	float sum = 0.0f;
+	for (int z = 0; z < view.getHeight(); z++) {
+		view.decodeRow(z, row.data());
+		sum += row[z % size];
+	}
+	double scanTime = timer.seconds() - openTime;
+	s_sink = sum;
+	out << "  view open\t\t" << openTime * 1000.0 << " ms (x" << copyTime / openTime << "), full row scan "
+		<< scanTime * 1000.0 << " ms\n";
+
+	remove(path.c_str());
+}
+
+void benchHeightFormats(ostream& out, const string& path, int size) {
+	HeightmapGenerator generator;
+	HeightGrid grid = generator.generate(size, size);
+	out << "height formats " << size << "x" << size << "\n";
+
+	// Old path: one gray byte copied into R, G and B
+	{
+		ppm image(size, size);
+		for (uint64_t i = 0; i < image.size; i++)
+			image.r[i] = image.g[i] = image.b[i] = (unsigned char)floor(grid.data[i] * 255);
+		Stopwatch timer;
+		image.write(path);
+		double writeTime = timer.seconds();
+
+		double maxError = 0.0;
+		for (uint64_t i = 0; i < image.size; i++)
+			maxError = max(maxError, (double)fabs(image.r[i] / 255.0f - grid.data[i]));
+		out << "  ppm gray\t3 bytes/sample, write " << writeTime * 1000.0 << " ms, max error " << maxError << "\n";
+	}
+
+	HeightFormat formats[] = { HeightFormat::UNorm16, HeightFormat::Half, HeightFormat::Float32 };
+	for (HeightFormat format : formats) {
+		Stopwatch timer;
+		generator.generateToFile(path, size, size, format);
+		double writeTime = timer.seconds();
+
+		timer.restart();
+		HeightmapView view(path);
+		vector<float> row(size);
+		double maxError = 0.0;
+		for (int z = 0; z < view.getHeight(); z++) {
+			view.decodeRow(z, row.data());
+			for (int x = 0; x < size; x++)
+				maxError = max(maxError, (double)fabs(row[x] - grid.at(x, z)));
+		}
+		double readTime = timer.seconds();
+		out << "  " << heightFormatName(format) << "\t" << heightFormatBytes(format) << " bytes/sample, generate+write "
+			<< writeTime * 1000.0 << " ms, map+decode " << readTime * 1000.0 << " ms, max error " << maxError << "\n";
+	}
+
+	remove(path.c_str());
+}
+
+void benchMesh(ostream& out, int size) {
+	HeightmapGenerator generator;
+	HeightGrid grid = generator.generate(size, size);
+	double count = (double)size * size;
+	out << "mesh " << size << "x" << size << "\n";
+
+	// The old Terrain loop: getHeight with bounds checks, four times per normal
+	auto height = [&](int x, int z) {
+		if (x < 0 || x >= grid.width || z < 0 || z >= grid.height)
+			return 0.0f;
+		return grid.at(x, z) * 80.0f - 40.0f;
+	};
+	// Allocation is timed too: the old loop sized its array three times too large
+	Stopwatch timer;
+	vector<Vertex> legacy((size_t)count * 3);
+	size_t index = 0;
+	for (int i = 0; i < size; i++) {
+		for (int j = 0; j < size; j++) {
+			legacy[index].Position.x = j / (float)(size - 1) * 800.0f - 400.0f;
+			legacy[index].Position.y = height(j, i);
+			legacy[index].Position.z = i / (float)(size - 1) * 800.0f - 400.0f;
+			legacy[index].Normal.x = height(j - 1, i) - height(j + 1, i);
+			legacy[index].Normal.y = 2.0f;
+			legacy[index].Normal.z = height(j, i - 1) - height(j, i + 1);
+			index++;
+		}
+	}
+	double legacyTime = timer.seconds();
+	s_sink = legacy[index / 2].Normal.x;
+	out << "  per-vertex loop\t" << count / legacyTime / 1e6 << " Mvertices/s\n";
+
+	MeshBuilder builder(size, size, gridRows(grid));
+	unsigned int maxThreads = max(1u, thread::hardware_concurrency());
+	for (unsigned int threads = 1; threads <= maxThreads; threads *= 2) {
+		ThreadPool pool(threads);
+		vector<Vertex> vertices;
+		timer.restart();
+		builder.buildInterleaved(vertices, pool);
+		double interleavedTime = timer.seconds();
+
+		vector<float> positions, normals;
+		timer.restart();
+		builder.buildStreams(positions, normals, pool);
+		double streamsTime = timer.seconds();
+
+		out << "  " << threads << " workers\tinterleaved " << count / interleavedTime / 1e6 << " Mvertices/s (x"
+			<< legacyTime / interleavedTime << "), streams " << count / streamsTime / 1e6 << " Mvertices/s\n";
+	}
+}
+
+void benchNormals(ostream& out, int size) {
+	HeightmapGenerator generator;
+	HeightGrid map = generator.generate(size, size);
+	float spacing = 800.0f / (size - 1);
+	double count = (double)size * size;
+	out << "normals " << size << "x" << size << "\n";
+
+	// The map as the viewer used to load it: 24-bit heights, high byte in red
+	const float MAX_PIXEL_COLOR = 256.0f * 256.0f * 256.0f, MAX_HEIGHT = 40.0f;
+	ppm image(size, size);
+	for (size_t i = 0; i < map.data.size(); i++) {
+		int rgb = (int)min(max(map.data[i] * MAX_PIXEL_COLOR, 0.0f), MAX_PIXEL_COLOR - 1.0f);
+		image.r[i] = (unsigned char)(rgb >> 16);
+		image.g[i] = (unsigned char)(rgb >> 8);
+		image.b[i] = (unsigned char)rgb;
+	}
+	auto decode = [&](size_t index) {
+		int rgb = image.b[index] | (image.g[index] << 8) | (image.r[index] << 16);
+		float height = static_cast<float>(rgb);
+		height -= MAX_PIXEL_COLOR / 2.0f;
+		height /= MAX_PIXEL_COLOR / 2.0f;
+		return height * MAX_HEIGHT;
+	};
+
+	// Both outputs are allocated up front so only the arithmetic is timed
+	vector<float> legacy((size_t)count * 3);
+	vector<float> normals((size_t)count * 3);
+
+	// Terrain::getHeight and calcNormal as they were: a bounds check and a
+	// three-byte reassembly for each of the four taps
+	auto getHeight = [&](int x, int z) {
+		if (x < 0 || x >= (int)image.width || z < 0 || z >= (int)image.height)
+			return 0.0f;
+		return decode((size_t)x + (size_t)z * image.width);
+	};
+	Stopwatch timer;
+	for (int z = 0; z < size; z++) {
+		for (int x = 0; x < size; x++) {
+			float* n = &legacy[((size_t)z * size + x) * 3];
+			n[0] = getHeight(x - 1, z) - getHeight(x + 1, z);
+			n[1] = 2.0f;
+			n[2] = getHeight(x, z - 1) - getHeight(x, z + 1);
+		}
+	}
+	double legacyTime = timer.seconds();
+	s_sink = legacy[size];
+	out << "  calcNormal on RGB\t" << count / legacyTime / 1e6 << " Mnormals/s (unnormalized)\n";
+
+	// Every height decoded once into a float grid
+	timer.restart();
+	HeightGrid grid(size, size);
+	for (size_t i = 0; i < grid.data.size(); i++)
+		grid.data[i] = decode(i);
+	double decodeTime = timer.seconds();
+
+	auto height = [&](int x, int z) {
+		if (x < 0 || x >= grid.width || z < 0 || z >= grid.height)
+			return 0.0f;
+		return grid.at(x, z);
+	};
+	timer.restart();
+	for (int z = 0; z < size; z++) {
+		for (int x = 0; x < size; x++) {
+			float* n = &legacy[((size_t)z * size + x) * 3];
+			n[0] = height(x - 1, z) - height(x + 1, z);
+			n[1] = 2.0f;
+			n[2] = height(x, z - 1) - height(x, z + 1);
+		}
+	}
+	double floatTime = timer.seconds();
+	s_sink = legacy[size];
+	out << "  four-tap on float grid\t" << count / floatTime / 1e6 << " Mnormals/s (x" << legacyTime / floatTime
+		<< ", unnormalized, decode not counted)\n";
+
+	ThreadPool pool(1);
+	timer.restart();
+	computeNormals(grid, spacing, normals, pool);
+	double time = timer.seconds();
+	out << "  row pass, " << simdLevelName(detectSimdLevel()) << "\t" << count / time / 1e6 << " Mnormals/s (x"
+		<< floatTime / time << " the float grid, normalized)\n";
+	out << "  decode + row pass\t" << count / (decodeTime + time) / 1e6 << " Mnormals/s (x"
+		<< legacyTime / (decodeTime + time) << " calcNormal on RGB)\n";
+
+	double maxAngle = 0.0;
+	for (size_t i = 0; i < normals.size(); i += 3) {
+		float nx, ny, nz;
+		unpackOctahedral(packOctahedral(normals[i], normals[i + 1], normals[i + 2]), nx, ny, nz);
+		double ax = normals[i], ay = normals[i + 1], az = normals[i + 2];
+		double cx = ay * nz - az * ny, cy = az * nx - ax * nz, cz = ax * ny - ay * nx;
+		double angle = atan2(sqrt(cx * cx + cy * cy + cz * cz), ax * nx + ay * ny + az * nz);
+		maxAngle = max(maxAngle, angle * 180.0 / 3.14159265358979);
+	}
+	out << "  octahedral snorm16\tmax error " << maxAngle << " degrees\n";
+}
+
+void benchChunkLod(ostream& out, int size, int frames) {
+	HeightmapGenerator generator;
+	HeightGrid grid = generator.generate(size, size);
+	out << "chunked lod " << size << "x" << size << "\n";
+
+	Stopwatch timer;
+	ChunkedTerrain terrain(size, size, gridRows(grid));
+	out << "  build\t" << timer.milliseconds() << " ms, " << terrain.chunks.size() << " chunks, "
+		<< terrain.vertices.size() << " vertices, " << terrain.indices.size() << " indices\n";
+
+	LodCamera lodCamera;
+	vector<int> lods;
+	size_t least = (size_t)-1, most = 0;
+	double total = 0.0;
+	timer.restart();
+	for (int frame = 0; frame < frames; frame++) {
+		OrbitCamera::scripted(frame, frames).eye(lodCamera.x, lodCamera.y, lodCamera.z);
+		size_t triangles = terrain.selectLods(lodCamera, lods);
+		least = min(least, triangles);
+		most = max(most, triangles);
+		total += (double)triangles;
+	}
+	double time = timer.seconds();
+	out << "  full resolution\t" << terrain.fullTriangleCount() << " triangles\n";
+	out << "  orbit, " << lodCamera.maxPixelError << " px\tmin " << least << ", mean " << (size_t)(total / frames)
+		<< ", max " << most << " triangles/frame (x" << terrain.fullTriangleCount() / (total / frames)
+		<< " fewer), selection " << time / frames * 1e6 << " us/frame\n";
+}
+
+void benchGridIndices(ostream& out, int size) {
+	out << "grid indices " << size << "x" << size << "\n";
+	// Indices do not depend on the heights
+	HeightRowSource flat = [size](int, float* row) { fill(row, row + size, 0.5f); };
+	vector<unsigned int> whole;
+	MeshBuilder(size, size, flat).buildIndices(whole, ThreadPool::shared());
+
+	ChunkedTerrain terrain(size, size, flat);
+	size_t perChunk = 0;
+	for (const TerrainChunk& chunk : terrain.chunks)
+		for (const ChunkLod& lod : chunk.lods)
+			perChunk += lod.indexCount;
+	out << "  whole map, 32-bit\t" << whole.size() * 4 / 1024 << " KiB\n";
+	out << "  per chunk, all lods, 32-bit\t" << perChunk * 4 / 1024 << " KiB\n";
+	out << "  shared templates, 16-bit\t" << terrain.indices.size() * 2 / 1024 << " KiB (x"
+		<< (double)perChunk * 4 / (terrain.indices.size() * 2) << " smaller than per chunk)\n";
+
+	const int cacheSizes[] = { 16, 32 };
+	for (int cacheSize : cacheSizes) {
+		out << "  acmr, fifo " << cacheSize << "\twhole map " << simulateAcmr(whole.data(), whole.size(), cacheSize);
+		const IndexOrder orders[] = { IndexOrder::RowMajor, IndexOrder::Strip, IndexOrder::CacheOptimized };
+		const char* names[] = { "row-major", "strip", "optimized" };
+		for (int o = 0; o < 3; o++) {
+			vector<uint16_t> chunk, list;
+			buildGridIndices(64, 64, 1, orders[o], chunk);
+			if (orders[o] == IndexOrder::Strip)
+				stripToList(chunk.data(), chunk.size(), list);
+			else
+				list = chunk;
+			out << ", " << names[o] << " " << simulateAcmr(list.data(), list.size(), cacheSize);
+		}
+		out << "\n";
+	}
+
+	vector<uint16_t> chunk;
+	Stopwatch timer;
+	buildGridIndices(64, 64, 1, IndexOrder::CacheOptimized, chunk);
+	out << "  optimize one 64x64 template\t" << timer.milliseconds() << " ms\n";
+}
+
+void benchTiles(ostream& out, int tileSize, int frames) {
+	TileSettings settings;
+	settings.tileSize = tileSize;
+	settings.fractal.octaves = 6;
+	TileService service(settings);
+	out << "tiles " << tileSize << "x" << tileSize << ", " << settings.fractal.octaves << " octaves\n";
+
+	// Time one tile to price a full regeneration
+	HeightGrid grid;
+	Stopwatch timer;
+	service.generate(TileKey{ 0, 0, 0 }, grid);
+	double tileTime = timer.seconds();
+
+	// The camera moves a quarter tile per frame and sees 4 tiles around it
+	double radius = 4.0 * tileSize;
+	vector<TileKey> keys;
+	size_t requested = 0;
+	timer.restart();
+	for (int frame = 0; frame < frames; frame++) {
+		double x = frame * 0.25 * tileSize;
+		service.tilesAround(x, 0.0, radius, 0, keys);
+		service.prefetch(keys, ThreadPool::shared());
+		for (const TileKey& key : keys)
+			s_sink = service.getTile(key.tx, key.tz, key.lod)->grid.data[0];
+		requested += keys.size();
+	}
+	double time = timer.seconds();
+	TileStats stats = service.getStats();
+	out << "  streaming\t" << (double)stats.generated / frames << " tiles built/frame of " << (double)requested / frames
+		<< " visible, " << time / frames * 1000.0 << " ms/frame (full regeneration " << tileTime * requested / frames * 1000.0
+		<< " ms/frame), cache " << service.cachedBytes() / (1 << 20) << " MiB\n";
+
+	// Neighbours far beyond the old 256 unit period must share their borders
+	float mismatch = 0.0f;
+	const int64_t far = (int64_t)1 << 40;
+	for (int64_t t = 0; t < 4; t++) {
+		auto left = service.getTile(far + t, far, 0);
+		auto right = service.getTile(far + t + 1, far, 0);
+		auto below = service.getTile(far + t, far + 1, 0);
+		for (int k = 0; k <= tileSize; k++) {
+			mismatch = max(mismatch, fabsf(left->grid.at(tileSize, k) - right->grid.at(0, k)));
+			mismatch = max(mismatch, fabsf(left->grid.at(k, tileSize) - below->grid.at(k, 0)));
+		}
+	}
+	out << "  borders at 2^40 tiles\tmax mismatch " << mismatch << "\n";
+}
+
+void benchPipeline(ostream& out, int tileSize, int frames) {
+	TileSettings settings;
+	settings.tileSize = tileSize;
+	settings.fractal.octaves = 4;
+	TileService service(settings);
+	TilePipeline pipeline(service);
+	out << "pipeline " << tileSize << "x" << tileSize << " tiles\n";
+
+	// The camera moves half a tile per frame; a frame lasts about 16 ms, of
+	// which the polling thread should use almost nothing
+	double radius = 3.0 * tileSize;
+	vector<TileKey> keys;
+	set<pair<int64_t, int64_t>> resident;
+	double worst = 0.0, total = 0.0, latency = 0.0;
+	size_t delivered = 0;
+	for (int frame = 0; frame < frames; frame++) {
+		Stopwatch timer;
+		double x = frame * 0.5 * tileSize;
+		pipeline.setCamera(x, 0.0, radius);
+		service.tilesAround(x, 0.0, radius, 0, keys);
+		for (const TileKey& key : keys)
+			if (!resident.count(make_pair(key.tx, key.tz)))
+				pipeline.request(key);
+		while (unique_ptr<TileMesh> mesh = pipeline.poll()) {
+			resident.insert(make_pair(mesh->key.tx, mesh->key.tz));
+			latency += mesh->latency;
+			delivered++;
+		}
+		double time = timer.seconds();
+		worst = max(worst, time);
+		total += time;
+		this_thread::sleep_for(chrono::milliseconds(16));
+	}
+	PipelineStats stats = pipeline.getStats();
+	out << "  polling thread\tmean " << total / frames * 1000.0 << " ms, worst " << worst * 1000.0 << " ms per frame\n";
+	out << "  jobs\t" << stats.requested << " requested, " << delivered << " delivered, " << stats.cancelled
+		<< " cancelled, mean latency " << (delivered ? latency / delivered * 1000.0 : 0.0) << " ms\n";
+}
+
+void benchDerivatives(ostream& out, int size, int octaves) {
+	HeightmapSettings hs;
+	hs.fractal.octaves = octaves;
+	HeightmapGenerator generator(hs);
+	MeshSettings mesh;
+	float spacing = mesh.extent / (size - 1);
+	double count = (double)size * size;
+	ThreadPool pool(1);
+	out << "derivatives " << size << "x" << size << ", " << octaves << " octaves\n";
+
+	// Heights then four taps per normal, as Terrain::calcNormal did
+	vector<float> normals((size_t)count * 3);
+	Stopwatch timer;
+	HeightGrid grid(size, size);
+	generator.generate(grid, pool);
+	for (float& h : grid.data)
+		h = h * mesh.heightScale + mesh.heightOffset;
+	auto height = [&](int x, int z) {
+		if (x < 0 || x >= grid.width || z < 0 || z >= grid.height)
+			return 0.0f;
+		return grid.at(x, z);
+	};
+	for (int z = 0; z < size; z++) {
+		for (int x = 0; x < size; x++) {
+			float* n = &normals[((size_t)z * size + x) * 3];
+			n[0] = height(x - 1, z) - height(x + 1, z);
+			n[1] = 2.0f;
+			n[2] = height(x, z - 1) - height(x, z + 1);
+		}
+	}
+	double legacyTime = timer.seconds();
+	s_sink = normals[size];
+	out << "  heights + four-tap\t" << count / legacyTime / 1e6 << " Msamples/s (unnormalized)\n";
+
+	timer.restart();
+	generator.generate(grid, pool);
+	for (float& h : grid.data)
+		h = h * mesh.heightScale + mesh.heightOffset;
+	computeNormals(grid, spacing, normals, pool);
+	double passTime = timer.seconds();
+	out << "  heights + row normal pass\t" << count / passTime / 1e6 << " Msamples/s (x" << legacyTime / passTime << ")\n";
+
+	// Both from one noise evaluation per sample
+	SlopeRowSource source = generator.slopeSource(size, size);
+	vector<float> row(size), slopeX(size), slopeZ(size);
+	vector<float> analytic((size_t)count * 3);
+	vector<float> nx(size), ny(size), nz(size);
+	float scale = mesh.heightScale / spacing;
+	timer.restart();
+	for (int z = 0; z < size; z++) {
+		source(z, row.data(), slopeX.data(), slopeZ.data());
+		slopeNormalRow(slopeX.data(), slopeZ.data(), size, scale, nx.data(), ny.data(), nz.data());
+		float* n = &analytic[(size_t)z * size * 3];
+		for (int x = 0; x < size; x++) {
+			n[3 * x] = nx[x];
+			n[3 * x + 1] = ny[x];
+			n[3 * x + 2] = nz[x];
+		}
+	}
+	double analyticTime = timer.seconds();
+	out << "  analytic derivatives\t" << count / analyticTime / 1e6 << " Msamples/s (x" << legacyTime / analyticTime
+		<< ", exact normals)\n";
+
+	// Mean angle to the normal pass, which differences the sampled mesh
+	double angle = 0.0;
+	for (size_t i = 0; i < normals.size(); i += 3) {
+		double dot = normals[i] * analytic[i] + normals[i + 1] * analytic[i + 1] + normals[i + 2] * analytic[i + 2];
+		angle += acos(min(1.0, dot));
+	}
+	out << "  mean angle to the normal pass\t" << angle / count * 180.0 / 3.14159265358979 << " degrees\n";
+
+	// Derivatives against central differences, and values against noise()
+	FractalSettings fs;
+	fs.octaves = octaves;
+	FractalNoise fractal(hs.seed, fs);
+	const PerlinNoise& perlin = fractal.getPerlin();
+	double worst = 0.0, worstFractal = 0.0;
+	bool same = true;
+	const double h = 1e-6;
+	for (int i = 0; i < 20000; i++) {
+		double x = 0.37 + i * 0.0123, y = 1.91 + i * 0.0071, zc = 0.8 + i * 0.0031;
+		NoiseSample s = perlin.noiseDerivative(x, y, zc);
+		same = same && s.value == perlin.noise(x, y, zc);
+		double gx = (perlin.noise(x + h, y, zc) - perlin.noise(x - h, y, zc)) / (2 * h);
+		double gy = (perlin.noise(x, y + h, zc) - perlin.noise(x, y - h, zc)) / (2 * h);
+		double gz = (perlin.noise(x, y, zc + h) - perlin.noise(x, y, zc - h)) / (2 * h);
+		worst = max(worst, max(fabs(s.dx - gx), max(fabs(s.dy - gy), fabs(s.dz - gz))));
+
+		NoiseSample f = fractal.noiseDerivative(x, y, zc);
+		double fx = (fractal.noise(x + h, y, zc) - fractal.noise(x - h, y, zc)) / (2 * h);
+		double fy = (fractal.noise(x, y + h, zc) - fractal.noise(x, y - h, zc)) / (2 * h);
+		worstFractal = max(worstFractal, max(fabs(f.dx - fx), fabs(f.dy - fy)));
+	}
+	// The row kernels round the same double results to float
+	vector<float> rowValue(size), rowX(size), rowY(size);
+	perlin.noiseDerivativeRow(1.91, 0.8, 0.37, 0.0123, size, rowValue.data(), rowX.data(), rowY.data());
+	for (int i = 0; i < size; i++) {
+		NoiseSample s = perlin.noiseDerivative(0.37 + 0.0123 * i, 1.91, 0.8);
+		same = same && rowValue[i] == (float)s.value && rowX[i] == (float)s.dx && rowY[i] == (float)s.dy;
+	}
+	out << "  derivative error against central differences\tnoise " << worst << ", fractal " << worstFractal
+		<< (same ? ", values and row kernels bit-identical" : ", values or row kernels DIFFER") << "\n";
+
+	// Eroded fBm needs the derivatives of every octave, plain fBm doesn't
+	fs.mode = FractalMode::Eroded;
+	FractalNoise eroded(hs.seed, fs);
+	double dx = hs.frequency / size;
+	vector<float> values(size);
+	timer.restart();
+	for (int z = 0; z < size; z++)
+		fractal.noiseRow(dx * z, hs.z, 0.0, dx, size, values.data());
+	double fbmTime = timer.seconds();
+	s_sink = values[0];
+	timer.restart();
+	for (int z = 0; z < size; z++)
+		eroded.noiseRow(dx * z, hs.z, 0.0, dx, size, values.data());
+	double erodedTime = timer.seconds();
+	s_sink = values[0];
+	out << "  fBm rows\t" << count / fbmTime / 1e6 << " Msamples/s, eroded fBm " << count / erodedTime / 1e6 << " Msamples/s\n";
+}
+
+// Time rows of noise, then report the largest deviation from the double
+// noise() at the exact coordinates, for rows near the origin and near 240
+template <class Noise, class Real>
+static void timeNoiseRows(ostream& out, const char* name, const Noise& noise, const PerlinNoise& reference, int size,
+	SimdLevel level) {
+	// Not a power of two fraction, so float rounds the coordinates
+	double step = 10.0 / (size - 1);
+	vector<float> row(size);
+	Stopwatch timer;
+	for (int i = 0; i < size; i++) {
+		noise.noiseRow((Real)(step * i), (Real)0.8, (Real)0.0, (Real)step, size, row.data(), level);
+		s_sink = row[i % size];
+	}
+	double time = timer.seconds();
+
+	double worst[2] = { 0.0, 0.0 };
+	for (int far = 0; far < 2; far++) {
+		double origin = far ? 240.0 : 0.0;
+		for (int i = 0; i < size; i += 7) {
+			double y = origin + step * i;
+			noise.noiseRow((Real)y, (Real)0.8, (Real)origin, (Real)step, size, row.data(), level);
+			for (int j = 0; j < size; j++)
+				worst[far] = max(worst[far], fabs(row[j] - reference.noise(origin + step * j, y, 0.8)));
+		}
+	}
+	out << "  " << name << ", " << simdLevelName(level) << "\t" << (double)size * size / time / 1e6 << " Msamples/s, max deviation "
+		<< worst[0] << " near 0, " << worst[1] << " near 240\n";
+}
+
+void benchNoisePrecision(ostream& out, int size) {
+	PerlinNoise pn(237);
+	BasicPerlinNoise<double, uint8_t> d8(237);
+	BasicPerlinNoise<double, uint16_t> d16(237);
+	BasicPerlinNoise<float, uint8_t> f8(237);
+	BasicPerlinNoise<float, uint16_t> f16(237);
+	out << "precision " << size << "x" << size << ", tables: PerlinNoise " << pn.getPermutation().size() * sizeof(int)
+		<< " bytes, uint8_t " << sizeof(d8) << " bytes, uint16_t " << sizeof(d16) << " bytes\n";
+
+	// The double variants have to match PerlinNoise bit for bit
+	bool same = true;
+	for (int i = 0; i < 100000; i++) {
+		double x = i * 0.0173, y = i * 0.0029 + 0.5, z = 0.8 + i * 0.0011;
+		double r = pn.noise(x, y, z);
+		same = same && d8.noise(x, y, z) == r && d16.noise(x, y, z) == r;
+	}
+	out << "  double templates " << (same ? "bit-identical to PerlinNoise" : "DIFFER from PerlinNoise") << "\n";
+
+	SimdLevel best = detectSimdLevel();
+	SimdLevel levels[] = { SimdLevel::Scalar, SimdLevel::SSE41, SimdLevel::AVX2 };
+	for (SimdLevel level : levels) {
+		if (level > best)
+			break;
+		timeNoiseRows<PerlinNoise, double>(out, "PerlinNoise", pn, pn, size, level);
+		timeNoiseRows<BasicPerlinNoise<double, uint8_t>, double>(out, "double, uint8_t", d8, pn, size, level);
+		timeNoiseRows<BasicPerlinNoise<double, uint16_t>, double>(out, "double, uint16_t", d16, pn, size, level);
+		timeNoiseRows<BasicPerlinNoise<float, uint8_t>, float>(out, "float, uint8_t", f8, pn, size, level);
+		timeNoiseRows<BasicPerlinNoise<float, uint16_t>, float>(out, "float, uint16_t", f16, pn, size, level);
+	}
+}
+
+void benchSeeds(ostream& out, int count, int thumb) {
+	out << "seeds " << count << ", " << thumb << "x" << thumb << " thumbnails\n";
+	int table[256];
+	Stopwatch timer;
+	for (int s = 0; s < count; s++) {
+		iota(table, table + 256, 0);
+		default_random_engine engine(s);
+		shuffle(table, table + 256, engine);
+		s_sink = (float)table[s & 255];
+	}
+	double libraryTime = timer.seconds();
+	timer.restart();
+	for (int s = 0; s < count; s++) {
+		iota(table, table + 256, 0);
+		Pcg32 rng(s);
+		portableShuffle(table, 256, rng);
+		s_sink = (float)table[s & 255];
+	}
+	double portableTime = timer.seconds();
+	out << "  std::shuffle\t" << count / libraryTime / 1e3 << " k permutations/s\n";
+	out << "  Pcg32 portableShuffle\t" << count / portableTime / 1e3 << " k permutations/s\n";
+
+	vector<unsigned int> seeds(count);
+	for (int s = 0; s < count; s++)
+		seeds[s] = (unsigned int)s;
+	vector<HeightGrid> thumbnails;
+	for (int octaves : { 1, 4 }) {
+		HeightmapSettings settings;
+		settings.fractal.octaves = octaves;
+		ThreadPool& pool = ThreadPool::shared();
+		timer.restart();
+		generateThumbnails(settings, seeds, thumb, thumbnails, pool);
+		double time = timer.seconds();
+		out << "  thumbnails, " << octaves << " octaves, " << pool.size() << " threads\t" << count / time << " maps/s\n";
+	}
+}
+
+void benchWarp(ostream& out, int size, int octaves) {
+	double count = (double)size * size;
+	out << "domain warp " << size << "x" << size << ", " << octaves << " octaves\n";
+
+	// Points jittered off a grid, so no two rows share a lattice y
+	PerlinNoise pn(237);
+	vector<double> x(size), y(size);
+	vector<float> scalar(size), vectorized(size);
+	Pcg32 rng(1);
+	double scalarTime = 0.0, vectorTime = 0.0;
+	bool identical = true;
+	for (int j = 0; j < size; j++) {
+		for (int i = 0; i < size; i++) {
+			x[i] = 10.0 * i / size + rng.next() * (0.005 / 4294967296.0);
+			y[i] = 10.0 * j / size + rng.next() * (0.005 / 4294967296.0);
+		}
+		Stopwatch timer;
+		perlinPointsScalar(pn.getPermutation().data(), 0.8, x.data(), y.data(), size, scalar.data());
+		scalarTime += timer.seconds();
+		timer.restart();
+		perlinPointsAVX2(pn.getPermutation().data(), 0.8, x.data(), y.data(), size, vectorized.data());
+		vectorTime += timer.seconds();
+		identical = identical && scalar == vectorized;
+	}
+	out << "  points scalar\t" << count / scalarTime / 1e6 << " Msamples/s\n";
+	out << "  points AVX2\t" << count / vectorTime / 1e6 << " Msamples/s, " << (identical ? "identical" : "DIFFERENT") << "\n";
+
+	HeightmapSettings settings;
+	settings.fractal.octaves = octaves;
+	settings.warp.amplitude = 1.0;
+	HeightGrid full;
+	for (int cell : { 0, 1, 4, 8, 16 }) {
+		HeightmapSettings warped = settings;
+		if (cell == 0)
+			warped.warp.amplitude = 0.0;
+		else
+			warped.warp.cellSize = cell;
+
+		// The warp alone: fields and warped rows over the same tiles
+		DomainWarp warp(warped.seed + 1, warped.warp);
+		double dx = warped.frequency / size;
+		double warpTime = 0.0;
+		if (warp.enabled()) {
+			WarpField field;
+			Stopwatch timer;
+			for (int z0 = 0; z0 < size; z0 += warped.tileSize) {
+				for (int x0 = 0; x0 < size; x0 += warped.tileSize) {
+					int w = min(warped.tileSize, size - x0), h = min(warped.tileSize, size - z0);
+					warp.field(dx, dx, warped.z, x0, z0, w, h, field);
+					for (int i = 0; i < h; i++)
+						warp.warpRow(field, dx, dx, x0, z0 + i, w, x.data(), y.data());
+				}
+			}
+			warpTime = timer.seconds();
+			s_sink = (float)x[0];
+		}
+
+		// Single thread, so the times add up
+		HeightmapGenerator generator(warped);
+		HeightGrid grid(size, size);
+		Stopwatch timer;
+		for (int z0 = 0; z0 < size; z0 += warped.tileSize)
+			for (int x0 = 0; x0 < size; x0 += warped.tileSize)
+				generator.generateTile(grid, x0, z0, min(warped.tileSize, size - x0), min(warped.tileSize, size - z0));
+		double time = timer.seconds();
+
+		if (cell == 0)
+			out << "  no warp\t" << time * 1e3 << " ms, " << count / time / 1e6 << " Msamples/s\n";
+		else {
+			if (cell == 1)
+				full = grid;
+			float deviation = 0.0f;
+			for (size_t i = 0; i < grid.data.size(); i++)
+				deviation = max(deviation, fabsf(grid.data[i] - full.data[i]));
+			out << "  warp cell " << cell << "\t" << time * 1e3 << " ms, warp " << warpTime * 1e3 << " ms, "
+				<< count / time / 1e6 << " Msamples/s, deviation " << deviation << "\n";
+		}
+	}
+}
+
+void benchAdaptive(ostream& out, int size, int octaves) {
+	HeightmapSettings settings;
+	settings.fractal.octaves = octaves;
+	HeightGrid grid = HeightmapGenerator(settings).generate(size, size);
+	size_t full = (size_t)2 * (size - 1) * (size - 1);
+	AdaptiveSettings adaptive;
+	out << "adaptive mesh " << size << "x" << size << ", " << full << " triangles at full resolution, heights x"
+		<< adaptive.mesh.heightScale << "\n";
+
+	for (AdaptiveMethod method : { AdaptiveMethod::Rtin, AdaptiveMethod::Quadric }) {
+		for (float maxError : { 0.1f, 0.25f, 0.5f, 1.0f }) {
+			adaptive.method = method;
+			adaptive.maxError = maxError;
+			Stopwatch timer;
+			AdaptiveTerrain terrain(grid, adaptive);
+			double time = timer.seconds();
+			out << "  " << (method == AdaptiveMethod::Rtin ? "rtin" : "quadric") << " max error " << maxError << "\t"
+				<< time * 1e3 << " ms, " << terrain.triangleCount() << " triangles (" << (double)full / terrain.triangleCount()
+				<< "x fewer), measured error " << terrain.measureError(grid) << "\n";
+		}
+	}
+}
+
+void benchRender(ostream& out, int size, int frames, int width, int height) {
+	HeightmapGenerator generator;
+	HeightGrid grid = generator.generate(size, size);
+	ChunkedTerrain terrain(size, size, gridRows(grid));
+	MeshBuilder builder(size, size, gridRows(grid));
+	vector<Vertex> vertices;
+	vector<unsigned int> indices;
+	builder.buildInterleaved(vertices, ThreadPool::shared());
+	builder.buildIndices(indices, ThreadPool::shared());
+	out << "software rasterizer " << width << "x" << height << ", " << size << "x" << size << " map\n";
+
+	const int repeats = 3;
+	ThreadPool single(1);
+	SoftwareRasterizer raster(width, height), reference(width, height);
+	LodCamera lodCamera;
+	lodCamera.viewportHeight = (float)height;
+	vector<int> lods;
+	bool identical = true;
+	double lodTotal = 0.0, fullTotal = 0.0;
+	for (int frame = 0; frame < frames; frame++) {
+		OrbitCamera camera = OrbitCamera::scripted(frame, frames);
+		camera.eye(lodCamera.x, lodCamera.y, lodCamera.z);
+		size_t triangles = terrain.selectLods(lodCamera, lods);
+		raster.setTransforms(Matrix4::identity(), camera.view(), OrbitCamera::projection(width, height));
+		reference.setTransforms(Matrix4::identity(), camera.view(), OrbitCamera::projection(width, height));
+
+		Stopwatch timer;
+		for (int r = 0; r < repeats; r++) {
+			raster.clear();
+			raster.draw(terrain, lods);
+		}
+		double lodTime = timer.seconds() / repeats;
+		size_t lodDrawn = raster.drawnTriangles();
+		reference.clear();
+		reference.draw(terrain, lods, single);
+		identical = identical && raster.pixels() == reference.pixels();
+
+		timer.restart();
+		for (int r = 0; r < repeats; r++) {
+			raster.clear();
+			raster.draw(vertices, indices);
+		}
+		double fullTime = timer.seconds() / repeats;
+		lodTotal += lodTime;
+		fullTotal += fullTime;
+		out << "  pose " << frame << ", radius " << camera.radius << "\tlod " << lodTime * 1e3 << " ms (" << lodDrawn << " of "
+			<< triangles << " triangles drawn), full " << fullTime * 1e3 << " ms (" << raster.drawnTriangles() << " of "
+			<< indices.size() / 3 << ")\n";
+	}
+	out << "  mean\tlod " << lodTotal / frames * 1e3 << " ms, full " << fullTotal / frames * 1e3 << " ms per frame, "
+		<< (identical ? "same" : "different") << " image on 1 and " << ThreadPool::shared().size() << " threads\n";
+}
+
+void benchCulling(ostream& out, int size, int frames) {
+	const int width = 800, height = 600;
+	HeightmapGenerator generator;
+	HeightGrid grid = generator.generate(size, size);
+	ChunkedTerrain terrain(size, size, gridRows(grid));
+	out << "frustum culling " << size << "x" << size << ", " << terrain.chunks.size() << " chunks, " << frames << " frames\n";
+
+	LodCamera lodCamera;
+	lodCamera.viewportHeight = (float)height;
+	vector<int> lods, flat, all;
+	double submitted = 0.0, drawn = 0.0, treeTime = 0.0, flatTime = 0.0;
+	size_t least = (size_t)-1, most = 0;
+	bool same = true, sameImage = true;
+	SoftwareRasterizer culled(width, height), reference(width, height);
+	for (int frame = 0; frame < frames; frame++) {
+		OrbitCamera camera = OrbitCamera::scripted(frame, frames);
+		camera.eye(lodCamera.x, lodCamera.y, lodCamera.z);
+		Matrix4 viewProjection = camera.view() * OrbitCamera::projection(width, height);
+		submitted += (double)terrain.selectLods(lodCamera, all);
+
+		lods = all;
+		Stopwatch timer;
+		size_t triangles = terrain.cullChunks(viewProjection, lods);
+		treeTime += timer.seconds();
+		flat = all;
+		timer.restart();
+		same = same && terrain.cullChunksFlat(viewProjection, flat) == triangles && flat == lods;
+		flatTime += timer.seconds();
+		drawn += (double)triangles;
+		least = min(least, triangles);
+		most = max(most, triangles);
+
+		// Culling must only drop what the rasterizer would have clipped away
+		if (frame % 32 == 0) {
+			culled.setTransforms(Matrix4::identity(), camera.view(), OrbitCamera::projection(width, height));
+			reference.setTransforms(Matrix4::identity(), camera.view(), OrbitCamera::projection(width, height));
+			culled.clear();
+			culled.draw(terrain, lods);
+			reference.clear();
+			reference.draw(terrain, all);
+			sameImage = sameImage && culled.pixels() == reference.pixels();
+		}
+	}
+	out << "  submitted\t" << (size_t)(submitted / frames) << " triangles/frame after lod selection\n";
+	out << "  drawn\tmin " << least << ", mean " << (size_t)(drawn / frames) << ", max " << most << " triangles/frame ("
+		<< 100.0 * (1.0 - drawn / submitted) << "% culled)\n";
+	out << "  quadtree\t" << treeTime / frames * 1e6 << " us/frame\n";
+	out << "  per chunk\t" << flatTime / frames * 1e6 << " us/frame, " << (same ? "same" : "different") << " chunks\n";
+	out << "  rendered\t" << (sameImage ? "same" : "different") << " image with and without culling\n";
+}
+
+void benchQueries(ostream& out, int size, int rays) {
+	HeightmapSettings settings;
+	settings.fractal.octaves = 8;
+	HeightGrid grid = HeightmapGenerator(settings).generate(size, size);
+	Stopwatch timer;
+	TerrainQuery query(grid);
+	out << "terrain queries " << size << "x" << size << ", pyramid of " << query.levelCount() << " levels built in "
+		<< timer.milliseconds() << " ms\n";
+
+	MeshSettings mesh;
+	float half = 0.5f * mesh.extent;
+	float sampleStep = mesh.extent / (size - 1);
+	Pcg32 rng(237);
+	auto uniform = [&rng](float lo, float hi) { return lo + (hi - lo) * (float)(rng.next() / 4294967296.0); };
+
+	const int points = 1 << 20;
+	vector<float> xs(points), zs(points);
+	for (int i = 0; i < points; i++) {
+		xs[i] = uniform(-half, half);
+		zs[i] = uniform(-half, half);
+	}
+	timer.restart();
+	float sum = 0.0f;
+	for (int i = 0; i < points; i++)
+		sum += query.heightAt(xs[i], zs[i]);
+	double heightTime = timer.seconds();
+	timer.restart();
+	for (int i = 0; i < points; i++)
+		sum += query.normalAt(xs[i], zs[i]).y;
+	double normalTime = timer.seconds();
+	s_sink = sum;
+	out << "  heightAt\t" << points / heightTime / 1e6 << " Mqueries/s, normalAt " << points / normalTime / 1e6 << " Mqueries/s\n";
+
+	// Picking: rays from poses of the orbit through random pixels
+	const float tanHalf = tanf(3.14159265f / 8.0f), aspect = 800.0f / 600.0f;
+	vector<Ray> picks(rays);
+	for (int i = 0; i < rays; i++) {
+		Float3 eye;
+		OrbitCamera::scripted(i % 64, 64).eye(eye.x, eye.y, eye.z);
+		float length = sqrtf(eye.x * eye.x + eye.y * eye.y + eye.z * eye.z);
+		Float3 forward(-eye.x / length, -eye.y / length, -eye.z / length);
+		float side = sqrtf(forward.x * forward.x + forward.z * forward.z);
+		Float3 right(forward.z / side, 0.0f, -forward.x / side);
+		Float3 up(forward.y * right.z - forward.z * right.y, forward.z * right.x - forward.x * right.z, forward.x * right.y - forward.y * right.x);
+		float px = uniform(-1.0f, 1.0f) * tanHalf * aspect, py = uniform(-1.0f, 1.0f) * tanHalf;
+		picks[i] = Ray(eye, Float3(forward.x + right.x * px + up.x * py, forward.y + right.y * px + up.y * py,
+			forward.z + right.z * px + up.z * py));
+	}
+	vector<RayHit> hits(rays), stepped(rays);
+	timer.restart();
+	for (int i = 0; i < rays; i++)
+		hits[i] = query.raycast(picks[i]);
+	double pyramidTime = timer.seconds();
+	timer.restart();
+	for (int i = 0; i < rays; i++)
+		stepped[i] = query.raycastStepped(picks[i], 0.5f * sampleStep);
+	double steppedTime = timer.seconds();
+	// Stepping can skip a crossing between two steps and find a later one
+	int hitCount = 0, disagree = 0, further = 0;
+	for (int i = 0; i < rays; i++) {
+		hitCount += hits[i].hit ? 1 : 0;
+		if (hits[i].hit != stepped[i].hit)
+			disagree++;
+		else if (hits[i].hit && fabsf(hits[i].distance - stepped[i].distance) > sampleStep)
+			further++;
+	}
+	out << "  picking\tpyramid " << pyramidTime / rays * 1e6 << " us/ray, half-sample steps " << steppedTime / rays * 1e6
+		<< " us/ray (x" << steppedTime / pyramidTime << "), " << hitCount << " of " << rays << " hit\n";
+	out << "  agreement\t" << disagree << " rays differ on hit or miss, " << further << " hit more than a sample apart\n";
+
+	timer.restart();
+	query.raycast(picks, hits);
+	double batchTime = timer.seconds();
+	out << "  batched\t" << rays / batchTime / 1e6 << " Mrays/s on " << ThreadPool::shared().size() << " threads\n";
+
+	// Line of sight between points 2 units above the ground, up to 200 apart
+	vector<Sightline> lines(rays);
+	for (int i = 0; i < rays; i++) {
+		float x = uniform(-half, half), z = uniform(-half, half);
+		float tx = min(max(x + uniform(-200.0f, 200.0f), -half), half), tz = min(max(z + uniform(-200.0f, 200.0f), -half), half);
+		lines[i].from = Float3(x, query.heightAt(x, z) + 2.0f, z);
+		lines[i].to = Float3(tx, query.heightAt(tx, tz) + 2.0f, tz);
+	}
+	vector<char> clear;
+	timer.restart();
+	query.visible(lines, clear);
+	double visibleTime = timer.seconds();
+	int seen = 0, mismatched = 0;
+	timer.restart();
+	for (int i = 0; i < rays; i++) {
+		const Sightline& l = lines[i];
+		Float3 d(l.to.x - l.from.x, l.to.y - l.from.y, l.to.z - l.from.z);
+		float length = sqrtf(d.x * d.x + d.y * d.y + d.z * d.z);
+		bool steppedClear = !query.raycastStepped(Ray(l.from, d, length * 0.9999f), 0.5f * sampleStep).hit;
+		seen += clear[i];
+		mismatched += steppedClear != (clear[i] != 0) ? 1 : 0;
+	}
+	double steppedVisibleTime = timer.seconds();
+	out << "  sightlines\t" << visibleTime / rays * 1e6 << " us/query batched, half-sample steps " << steppedVisibleTime / rays * 1e6
+		<< " us/query, " << seen << " of " << rays << " clear, " << mismatched << " differ\n";
+}
+
+void benchEdits(ostream& out, int size, int strokes) {
+	HeightmapGenerator generator;
+	HeightGrid grid = generator.generate(size, size);
+	Stopwatch timer;
+	ChunkedTerrain full(size, size, gridRows(grid));
+	double fullTime = timer.seconds();
+	timer.restart();
+	TerrainQuery fullQuery(grid);
+	double queryTime = timer.seconds();
+	size_t fullBytes = full.vertices.size() * sizeof(Vertex);
+	out << "terrain edits " << size << "x" << size << ", " << full.chunks.size() << " chunks, full rebuild "
+		<< fullTime * 1e3 << " ms and " << fullBytes / 1024 << " KB to upload, picking query " << queryTime * 1e3 << " ms\n";
+
+	EditableTerrain editable(grid);
+	MeshSettings mesh;
+	float sampleStep = mesh.extent / (size - 1);
+	Pcg32 rng(237);
+	auto uniform = [&rng](float lo, float hi) { return lo + (hi - lo) * (float)(rng.next() / 4294967296.0); };
+	const BrushMode modes[] = { BrushMode::Raise, BrushMode::Lower, BrushMode::Flatten, BrushMode::Smooth };
+	const int radii[] = { 4, 16, 64 };
+	for (int radius : radii) {
+		double seconds = 0.0, chunks = 0.0, bytes = 0.0;
+		for (int i = 0; i < strokes; i++) {
+			Brush brush;
+			brush.mode = modes[i % 4];
+			brush.radius = radius * sampleStep;
+			brush.x = uniform(-0.5f, 0.5f) * mesh.extent;
+			brush.z = uniform(-0.5f, 0.5f) * mesh.extent;
+			brush.strength = 0.05f;
+			timer.restart();
+			editable.applyBrush(brush);
+			vector<int> changed = editable.update();
+			seconds += timer.seconds();
+			chunks += (double)changed.size();
+			for (int c : changed)
+				bytes += (double)editable.terrain().chunks[c].vertexCount * sizeof(Vertex);
+		}
+		out << "  brush r=" << radius << "\t" << seconds / strokes * 1e3 << " ms/stroke, " << chunks / strokes
+			<< " chunks and " << bytes / strokes / 1024 << " KB uploaded per stroke\n";
+	}
+
+	// Regenerating part of the map: one generator tile, then everything
+	int tile = HeightmapSettings().tileSize;
+	editable.regenerate(size / 2, size / 2, size / 2 + 1, size / 2 + 1);
+	timer.restart();
+	size_t tileChunks = editable.update().size();
+	out << "  regenerate tile\t" << timer.milliseconds() << " ms, " << tileChunks << " chunks (" << tile << "x" << tile << " tile)\n";
+	HeightmapSettings reseeded;
+	reseeded.seed = 238;
+	editable.setSettings(reseeded);
+	timer.restart();
+	size_t allChunks = editable.update().size();
+	out << "  regenerate all\t" << timer.milliseconds() << " ms, " << allChunks << " chunks\n";
+
+	// Edits over the new map, then the terrain built from the edited grid anew
+	for (int i = 0; i < strokes; i++) {
+		Brush brush;
+		brush.mode = modes[i % 4];
+		brush.radius = radii[i % 3] * sampleStep;
+		brush.x = uniform(-0.5f, 0.5f) * mesh.extent;
+		brush.z = uniform(-0.5f, 0.5f) * mesh.extent;
+		editable.applyBrush(brush);
+		editable.update();
+	}
+	const ChunkedTerrain& edited = editable.terrain();
+	ChunkedTerrain fresh(size, size, gridRows(editable.heights()));
+	bool same = fresh.vertices.size() == edited.vertices.size()
+		&& memcmp(fresh.vertices.data(), edited.vertices.data(), fresh.vertices.size() * sizeof(Vertex)) == 0;
+	for (size_t i = 0; i < fresh.chunks.size() && same; i++) {
+		const TerrainChunk& a = fresh.chunks[i];
+		const TerrainChunk& b = edited.chunks[i];
+		same = memcmp(&a.bounds, &b.bounds, sizeof(ChunkBounds)) == 0 && a.lods.size() == b.lods.size();
+		for (size_t l = 0; l < a.lods.size() && same; l++)
+			same = a.lods[l].error == b.lods[l].error;
+	}
+	Matrix4 viewProjection = OrbitCamera::scripted(0, 1).view() * OrbitCamera::projection(800, 600);
+	vector<int> freshLods(fresh.chunks.size(), 0), editedLods(edited.chunks.size(), 0);
+	same = same && fresh.cullChunks(viewProjection, freshLods) == edited.cullChunks(viewProjection, editedLods) && freshLods == editedLods;
+
+	// Rays across the map against a query built from the edited grid
+	TerrainQuery freshQuery(editable.heights());
+	for (int i = 0; i < 4096 && same; i++) {
+		Ray ray(Float3(uniform(-0.5f, 0.5f) * mesh.extent, 60.0f, uniform(-0.5f, 0.5f) * mesh.extent),
+			Float3(uniform(-1.0f, 1.0f), -1.0f, uniform(-1.0f, 1.0f)));
+		RayHit a = freshQuery.raycast(ray), b = editable.query().raycast(ray);
+		same = a.hit == b.hit && a.distance == b.distance;
+	}
+	out << "  edited terrain\t" << (same ? "same" : "different") << " vertices, bounds, culling and raycasts as a fresh build\n";
+}
+
+void benchNoiseBackends(ostream& out, int size) {
+	double count = (double)size * size;
+	double step = 10.0 / size;
+	vector<float> row(size);
+	out << "noise backends " << size << "x" << size << "\n";
+	for (NoiseType type : { NoiseType::Perlin3D, NoiseType::Perlin3DFloat, NoiseType::Perlin2D, NoiseType::Simplex2D, NoiseType::Simplex3D }) {
+		unique_ptr<NoiseSource> source = makeNoise(type, 237);
+
+		// One virtual call per sample
+		Stopwatch timer;
+		float sum = 0.0f;
+		for (int i = 0; i < size; i++)
+			for (int j = 0; j < size; j++)
+				sum += (float)source->noise(step * j, step * i, 0.8);
+		double sampleTime = timer.seconds();
+		s_sink = sum;
+
+		// One virtual call per row
+		timer.restart();
+		for (int i = 0; i < size; i++) {
+			source->noiseRow(step * i, 0.8, 0.0, step, size, row.data());
+			s_sink = row[size - 1];
+		}
+		double rowTime = timer.seconds();
+		out << "  " << noiseTypeName(type) << ", " << noiseCorners(type) << " corners\tper sample "
+			<< count / sampleTime / 1e6 << " Msamples/s, per row " << count / rowTime / 1e6 << " Msamples/s\n";
+	}
+}
+
+void benchErosion(ostream& out, int size, int iterations) {
+	HeightmapGenerator generator;
+	HeightGrid source = generator.generate(size, size);
+	double cells = (double)size * size * iterations;
+	auto total = [](const HeightGrid& grid) {
+		double sum = 0.0;
+		for (float h : grid.data)
+			sum += h;
+		return sum;
+	};
+	out << "erosion " << size << "x" << size << ", " << iterations << " iterations\n";
+
+	ErosionSettings settings;
+	settings.hydraulic.iterations = iterations;
+	settings.thermal.iterations = iterations;
+	Erosion erosion(settings);
+	ThreadPool single(1);
+	ThreadPool& shared = ThreadPool::shared();
+
+	HeightGrid reference = source;
+	erosion.hydraulic(reference, single);
+	HeightGrid grid = source;
+	Stopwatch timer;
+	erosion.hydraulic(grid, shared);
+	double time = timer.seconds();
+	out << "  hydraulic, " << shared.size() << " threads\t" << cells / time / 1e6 << " Mcells/s per iteration, height sum "
+		<< total(source) << " -> " << total(grid) << (grid.data == reference.data ? ", same as 1 thread" : ", DIFFERS from 1 thread")
+		<< "\n";
+
+	reference = source;
+	erosion.thermal(reference, single);
+	grid = source;
+	timer.restart();
+	erosion.thermal(grid, shared);
+	time = timer.seconds();
+	out << "  thermal, " << shared.size() << " threads\t" << cells / time / 1e6 << " Mcells/s per iteration, height sum "
+		<< total(source) << " -> " << total(grid) << (grid.data == reference.data ? ", same as 1 thread" : ", DIFFERS from 1 thread")
+		<< "\n";
+}
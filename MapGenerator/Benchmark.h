@@ -0,0 +1,115 @@
+// Throughput benchmarks for the generation pipeline, printed to a stream
+#pragma once
+
+#include <ostream>
+#include <string>
+
+// Scalar noise() loop against PerlinNoise::noiseRow for every kernel the CPU
+// supports, over a size x size image; also reports the largest deviation
+// from the scalar values
+void benchNoiseRow(std::ostream& out, int size = 2048);
+
+// Tiled heightmap generation on pools of increasing size against a single
+// threaded fill; checks that every pool produces the same bits
+void benchHeightmap(std::ostream& out, int size = 4096);
+
+// Octave-by-octave scalar fBm against FractalNoise::noiseRow for 8 and 12
+// octaves, with the epsilon cut-off set for 8 and 16 bit output
+void benchFractal(std::ostream& out, int size = 1024);
+
+// Write and read back a size x size image as 8-bit P6 through ppm and as
+// 16-bit P5 in row bands through pnm_reader/pnm_writer
+void benchPnm(std::ostream& out, const std::string& path, int size = 4096);
+
+// Time to first height for a size x size PPM: full ppm decode against
+// mapping it with HeightmapView, plus one pass decoding every row
+void benchHeightmapView(std::ostream& out, const std::string& path, int size = 4096);
+
+// Bytes per sample, write/map time and round-trip error of every height
+// file format against the old 8-bit gray PPM encoding
+void benchHeightFormats(std::ostream& out, const std::string& path, int size = 2048);
+
+// Vertices per second of MeshBuilder (interleaved and streams, per pool
+// size) against the old per-vertex loop with four bounds-checked lookups
+void benchMesh(std::ostream& out, int size = 2048);
+
+// The old calcNormal over a 24-bit RGB image (four bounds-checked taps, each
+// reassembling three bytes) and the same four taps on a decoded float grid,
+// against the row normal pass at the detected SIMD level, alone and with the
+// one-time RGB decode; plus the octahedral packing error
+void benchNormals(std::ostream& out, int size = 2048);
+
+// Chunk build time and triangles per frame picked by the LOD selector along
+// a scripted orbit that circles the map while zooming in and out
+void benchChunkLod(std::ostream& out, int size = 1025, int frames = 360);
+
+// Index memory of the whole-map list, per-chunk 32-bit lists and shared
+// 16-bit chunk templates, and vertex cache ACMR of each index order
+void benchGridIndices(std::ostream& out, int size = 1025);
+
+// Tile streaming along a straight camera path: tiles built per frame and
+// frame cost against regenerating every visible tile, plus the largest
+// border mismatch between neighbouring tiles far from the origin
+void benchTiles(std::ostream& out, int tileSize = 128, int frames = 120);
+
+// Headless streaming through TilePipeline with a simulated camera: time the
+// polling thread spends per frame, tiles delivered and cancelled, latency
+void benchPipeline(std::ostream& out, int tileSize = 64, int frames = 120);
+
+// Heights plus normals from the four-tap getHeight scheme, the row normal pass
+// and the analytic noise derivatives; the largest error of the derivatives
+// against central differences of the noise, and eroded fBm against plain fBm
+void benchDerivatives(std::ostream& out, int size = 1024, int octaves = 6);
+
+// PerlinNoise against BasicPerlinNoise with double and float precision and
+// byte or 16-bit tables, per kernel, with the largest deviation of each from
+// the double noise() near the origin and near the 256 unit period
+void benchNoisePrecision(std::ostream& out, int size = 1024);
+
+// Permutations per second from std::shuffle with default_random_engine (the
+// old, library-dependent seeding) and from Pcg32 + portableShuffle, and
+// thumbnails per second for a batch of seeds
+void benchSeeds(std::ostream& out, int count = 2000, int thumb = 64);
+
+// Scattered-point Perlin kernels, scalar and AVX2, then heightmaps with no
+// warp, the warp evaluated at every sample and the cached warp at coarser
+// cells: the time spent on the warp, total throughput and the largest height
+// deviation of each cached field from the full-resolution one
+void benchWarp(std::ostream& out, int size = 1024, int octaves = 6);
+
+// AdaptiveTerrain with RTIN and quadric decimation at several vertical error
+// bounds: build time, triangles against the full grid mesh and the largest
+// error measured over every sample
+void benchAdaptive(std::ostream& out, int size = 513, int octaves = 6);
+
+// SoftwareRasterizer frame time per pose of the scripted orbit, drawing the
+// chunked terrain at the LODs the viewer would pick and the full resolution
+// mesh, and whether a single thread renders the same image
+void benchRender(std::ostream& out, int size = 1024, int frames = 8, int width = 800, int height = 600);
+
+// Triangles submitted after LOD selection against those left after frustum
+// culling over the scripted orbit, culling time per frame through the
+// quadtree and chunk by chunk, and whether culling changes the rendered image
+void benchCulling(std::ostream& out, int size = 1024, int frames = 256);
+
+// TerrainQuery heightAt and normalAt per second, picking rays from the
+// scripted orbit through the min/max pyramid against stepping every half
+// sample (time per ray and agreement), batched rays on the shared pool and
+// sightlines between points just above the ground
+void benchQueries(std::ostream& out, int size = 1025, int rays = 4096);
+
+// EditableTerrain stroke latency (brush, then update with the chunk rebuild
+// and picking query refresh) for several brush radii, with the chunks rebuilt
+// and bytes uploaded per stroke against rebuilding the whole terrain and
+// query, regenerating one tile and the whole map, and whether the edited
+// terrain and query match ones built from the edited grid
+void benchEdits(std::ostream& out, int size = 1025, int strokes = 64);
+
+// Every noise backend per sample through the virtual NoiseSource::noise and
+// per row through the templated loop, with corners blended per sample
+void benchNoiseBackends(std::ostream& out, int size = 1024);
+
+// Hydraulic and thermal erosion throughput in cells per second per iteration,
+// whether the result depends on the number of threads, and the change in
+// total height (thermal erosion conserves it up to rounding)
+void benchErosion(std::ostream& out, int size = 1024, int iterations = 50);
@@ -0,0 +1,40 @@
+// Orbit camera used by the viewer and by the headless benchmarks
+#pragma once
+
+#include "Matrix4.h"
+#include <cmath>
+
+struct OrbitCamera {
+	float radius;
+	float phi;
+	float theta;
+
+	OrbitCamera() : radius(500.0f), phi(0.35f * 3.14159265f), theta(1.3f * 3.14159265f) {}
+
+	// Pose frame of frames along the scripted flight of the benchmarks: one
+	// turn around the map while the radius swings twice between 150 and 600
+	static OrbitCamera scripted(int frame, int frames) {
+		OrbitCamera camera;
+		float t = (float)frame / frames;
+		camera.theta = 6.2831853f * t;
+		camera.radius = 150.0f + 450.0f * (0.5f + 0.5f * cosf(2.0f * 6.2831853f * t));
+		return camera;
+	}
+
+	// Convert spherical to cartesian; the camera looks at the origin
+	void eye(float& x, float& y, float& z) const {
+		x = radius * sinf(phi) * cosf(theta);
+		y = radius * cosf(phi);
+		z = radius * sinf(phi) * sinf(theta);
+	}
+
+	// The viewer's g_View and g_Projection
+	Matrix4 view() const {
+		Float3 position;
+		eye(position.x, position.y, position.z);
+		return Matrix4::lookAtLH(position, Float3(0.0f, 0.0f, 0.0f), Float3(0.0f, 1.0f, 0.0f));
+	}
+	static Matrix4 projection(int width, int height) {
+		return Matrix4::perspectiveFovLH(3.14159265f / 4.0f, width / (float)height, 0.1f, 5000.0f);
+	}
+};
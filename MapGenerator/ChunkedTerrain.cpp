@@ -0,0 +1,332 @@
+#include "ChunkedTerrain.h"
+#include "NormalPass.h"
+#include <algorithm>
+#include <cmath>
+#include <map>
+
+using namespace std;
+
+namespace {
+
+// Index of the LOD cell holding sample i, given lodSamples output
+int lodCell(const vector<int>& samples, int i, int step) {
+	return min(i / step, (int)samples.size() - 2);
+}
+
+void merge(ChunkBounds& a, const ChunkBounds& b) {
+	a.minX = min(a.minX, b.minX);
+	a.minY = min(a.minY, b.minY);
+	a.minZ = min(a.minZ, b.minZ);
+	a.maxX = max(a.maxX, b.maxX);
+	a.maxY = max(a.maxY, b.maxY);
+	a.maxZ = max(a.maxZ, b.maxZ);
+}
+
+FrustumTest testBounds(const Frustum& frustum, const ChunkBounds& b) {
+	return frustum.testBox(b.minX, b.minY, b.minZ, b.maxX, b.maxY, b.maxZ);
+}
+
+}
+
+ChunkedTerrain::ChunkedTerrain(int width, int height, const HeightRowSource& source, const ChunkSettings& _settings)
+	: settings(_settings), triangles(0), mapWidth(width), mapHeight(height), spacing(0.0f), chunksX(0), chunksZ(0) {
+	if (width < 2 || height < 2)
+		return;
+
+	settings.chunkCells = max(1, min(settings.chunkCells, MAX_CHUNK_CELLS));
+	int maxLods = 1;
+	while ((1 << (maxLods - 1)) < settings.chunkCells)
+		maxLods++;
+	settings.lodCount = max(1, min(settings.lodCount, maxLods));
+	triangles = (size_t)2 * (width - 1) * (height - 1);
+
+	vector<Vertex> grid;
+	MeshBuilder builder(width, height, source, settings.mesh);
+	builder.buildInterleaved(grid, ThreadPool::shared());
+	spacing = builder.spacing();
+
+	int cells = settings.chunkCells;
+	chunksX = (width - 1 + cells - 1) / cells;
+	chunksZ = (height - 1 + cells - 1) / cells;
+	chunks.resize((size_t)chunksX * chunksZ);
+	for (int cz = 0; cz < chunksZ; cz++) {
+		for (int cx = 0; cx < chunksX; cx++) {
+			TerrainChunk& chunk = chunks[(size_t)cz * chunksX + cx];
+			chunk.x0 = cx * cells;
+			chunk.z0 = cz * cells;
+			chunk.cellsX = min(cells, width - 1 - chunk.x0);
+			chunk.cellsZ = min(cells, height - 1 - chunk.z0);
+		}
+	}
+
+	// Chunks build independently into their own buffers, then get packed
+	vector<vector<Vertex>> chunkVertices(chunks.size());
+	ThreadPool::shared().parallelFor(0, (int)chunks.size(), [&](int i) {
+		buildChunk(chunks[i], &grid[(size_t)chunks[i].z0 * width + chunks[i].x0], width, chunkVertices[i]);
+	});
+
+	// At most four chunk sizes exist (full, and cut by the right and far
+	// edges), each with one index list per LOD
+	map<pair<int, int>, size_t> lists;
+	size_t vertexTotal = 0;
+	for (size_t i = 0; i < chunks.size(); i++) {
+		TerrainChunk& chunk = chunks[i];
+		chunk.firstVertex = (unsigned int)vertexTotal;
+		chunk.vertexCount = (unsigned int)chunkVertices[i].size();
+		vertexTotal += chunkVertices[i].size();
+
+		pair<int, int> size(chunk.cellsX, chunk.cellsZ);
+		auto found = lists.find(size);
+		if (found != lists.end()) {
+			const TerrainChunk& shared = chunks[found->second];
+			for (size_t l = 0; l < chunk.lods.size(); l++) {
+				chunk.lods[l].firstIndex = shared.lods[l].firstIndex;
+				chunk.lods[l].indexCount = shared.lods[l].indexCount;
+				chunk.lods[l].triangleCount = shared.lods[l].triangleCount;
+			}
+			continue;
+		}
+		lists[size] = i;
+		for (size_t l = 0; l < chunk.lods.size(); l++) {
+			ChunkLod& lod = chunk.lods[l];
+			int step = 1 << l;
+			vector<int> xs, zs;
+			lodSamples(chunk.cellsX, step, xs);
+			lodSamples(chunk.cellsZ, step, zs);
+			lod.firstIndex = (unsigned int)indices.size();
+			buildGridIndices(chunk.cellsX, chunk.cellsZ, step, settings.order, indices);
+			lod.indexCount = (unsigned int)indices.size() - lod.firstIndex;
+			// Grid cells and skirt quads, two triangles each
+			lod.triangleCount = (unsigned int)(2 * ((xs.size() - 1) * (zs.size() - 1) + (xs.size() - 1) * 2 + (zs.size() - 1) * 2));
+		}
+	}
+
+	vertices.resize(vertexTotal);
+	ThreadPool::shared().parallelFor(0, (int)chunks.size(), [&](int i) {
+		copy(chunkVertices[i].begin(), chunkVertices[i].end(), vertices.begin() + chunks[i].firstVertex);
+	});
+	buildQuadtree();
+}
+
+void ChunkedTerrain::buildQuadtree() {
+	levels.assign(1, vector<ChunkBounds>(chunks.size()));
+	levelWidths.assign(1, chunksX);
+	for (size_t i = 0; i < chunks.size(); i++)
+		levels[0][i] = chunks[i].bounds;
+	int w = chunksX, h = chunksZ;
+	while (w > 1 || h > 1) {
+		int pw = (w + 1) / 2, ph = (h + 1) / 2;
+		vector<ChunkBounds> parents((size_t)pw * ph);
+		const vector<ChunkBounds>& children = levels.back();
+		for (int z = 0; z < ph; z++) {
+			for (int x = 0; x < pw; x++) {
+				ChunkBounds& b = parents[(size_t)z * pw + x];
+				b = children[(size_t)(2 * z) * w + 2 * x];
+				for (int cz = 2 * z; cz < min(2 * z + 2, h); cz++)
+					for (int cx = 2 * x; cx < min(2 * x + 2, w); cx++)
+						merge(b, children[(size_t)cz * w + cx]);
+			}
+		}
+		levels.push_back(move(parents));
+		levelWidths.push_back(pw);
+		w = pw;
+		h = ph;
+	}
+}
+
+void ChunkedTerrain::buildChunk(TerrainChunk& chunk, const Vertex* origin, size_t stride, vector<Vertex>& chunkVertices) const {
+	int n = chunk.cellsX, m = chunk.cellsZ;
+	int columns = n + 1;
+	size_t gridCount = (size_t)columns * (m + 1);
+
+	// Grid vertices, row-major, then one skirt vertex per border sample
+	chunkVertices.resize(chunkVertexCount(n, m));
+	ChunkBounds& b = chunk.bounds;
+	b.minY = b.maxY = origin->Position.y;
+	for (int r = 0; r <= m; r++) {
+		const Vertex* src = origin + r * stride;
+		copy(src, src + columns, chunkVertices.begin() + (size_t)r * columns);
+		for (int c = 0; c <= n; c++) {
+			b.minY = min(b.minY, src[c].Position.y);
+			b.maxY = max(b.maxY, src[c].Position.y);
+		}
+	}
+	b.minX = chunkVertices[0].Position.x;
+	b.minZ = chunkVertices[0].Position.z;
+	b.maxX = chunkVertices[gridCount - 1].Position.x;
+	b.maxZ = chunkVertices[gridCount - 1].Position.z;
+
+	auto heightAt = [&](int r, int c) { return chunkVertices[(size_t)r * columns + c].Position.y; };
+
+	// Geometric error of every LOD: the largest vertical distance between a
+	// full resolution sample and the LOD surface, split like the full mesh
+	// (diagonal from the top right to the bottom left corner of each cell)
+	chunk.lods.resize(settings.lodCount);
+	vector<int> xs, zs;
+	float error = 0.0f;
+	for (int l = 0; l < settings.lodCount; l++) {
+		int step = 1 << l;
+		lodSamples(n, step, xs);
+		lodSamples(m, step, zs);
+		for (int r = 0; r <= m; r++) {
+			int kz = lodCell(zs, r, step);
+			int r0 = zs[kz], r1 = zs[kz + 1];
+			float fv = (float)(r - r0) / (r1 - r0);
+			for (int c = 0; c <= n; c++) {
+				int kx = lodCell(xs, c, step);
+				int c0 = xs[kx], c1 = xs[kx + 1];
+				float fu = (float)(c - c0) / (c1 - c0);
+				float h00 = heightAt(r0, c0), h01 = heightAt(r0, c1);
+				float h10 = heightAt(r1, c0), h11 = heightAt(r1, c1);
+				float approx = fu + fv <= 1.0f
+					? h00 + fu * (h01 - h00) + fv * (h10 - h00)
+					: h11 + (1.0f - fu) * (h10 - h11) + (1.0f - fv) * (h01 - h11);
+				error = max(error, fabsf(heightAt(r, c) - approx));
+			}
+		}
+		// Errors never shrink with coarser LODs, so selection can stop early
+		chunk.lods[l].error = error;
+	}
+
+	// Skirts drop deep enough to cover the largest step between two LODs
+	float depth = max(settings.minSkirtDepth, error);
+	b.minY -= depth;
+	for (int r = 0; r <= m; r++) {
+		for (int c = 0; c <= n; c++) {
+			if (r != 0 && r != m && c != 0 && c != n)
+				continue;
+			Vertex v = chunkVertices[(size_t)r * columns + c];
+			v.Position.y -= depth;
+			chunkVertices[skirtVertex(n, m, r, c)] = v;
+		}
+	}
+}
+
+void ChunkedTerrain::chunksTouching(int x0, int z0, int x1, int z1, vector<int>& out) const {
+	out.clear();
+	if (x0 >= x1 || z0 >= z1)
+		return;
+	for (size_t i = 0; i < chunks.size(); i++) {
+		const TerrainChunk& chunk = chunks[i];
+		// Samples x0 - 1 .. x1 have a changed sample or neighbour
+		if (chunk.x0 <= x1 && chunk.x0 + chunk.cellsX >= x0 - 1 && chunk.z0 <= z1 && chunk.z0 + chunk.cellsZ >= z0 - 1)
+			out.push_back((int)i);
+	}
+}
+
+void ChunkedTerrain::rebuildChunks(const HeightGrid& grid, const vector<int>& which, ThreadPool& pool) {
+	// The grid vertices of each chunk exactly as MeshBuilder makes them:
+	// same positions, and normals from the same rows, one column wider on
+	// each side so only map edges get one-sided differences
+	const MeshSettings& mesh = settings.mesh;
+	float step = spacing;
+	float originX = -0.5f * step * (mapWidth - 1);
+	float originZ = -0.5f * step * (mapHeight - 1);
+	pool.parallelFor(0, (int)which.size(), [&](int k) {
+		TerrainChunk& chunk = chunks[which[k]];
+		int columns = chunk.cellsX + 1;
+		int first = max(chunk.x0 - 1, 0);
+		int span = min(chunk.x0 + chunk.cellsX + 1, mapWidth - 1) - first + 1;
+		vector<float> prev(span), mid(span), next(span), nx(span), ny(span), nz(span);
+		auto worldRow = [&](int z, float* out) {
+			const float* src = grid.row(z) + first;
+			for (int i = 0; i < span; i++)
+				out[i] = src[i] * mesh.heightScale + mesh.heightOffset;
+		};
+
+		vector<Vertex> window((size_t)columns * (chunk.cellsZ + 1));
+		for (int r = 0; r <= chunk.cellsZ; r++) {
+			int z = chunk.z0 + r;
+			int zp = max(z - 1, 0), zn = min(z + 1, mapHeight - 1);
+			worldRow(zp, prev.data());
+			worldRow(z, mid.data());
+			worldRow(zn, next.data());
+			float invDz = zn > zp ? 1.0f / (step * (zn - zp)) : 0.0f;
+			computeNormalRow(prev.data(), mid.data(), next.data(), span, step, invDz, nx.data(), ny.data(), nz.data());
+			float pz = originZ + step * z;
+			for (int c = 0; c < columns; c++) {
+				int x = chunk.x0 + c, i = x - first;
+				window[(size_t)r * columns + c] = Vertex(originX + step * x, mid[i], pz, nx[i], ny[i], nz[i]);
+			}
+		}
+
+		vector<Vertex> chunkVertices;
+		buildChunk(chunk, window.data(), columns, chunkVertices);
+		copy(chunkVertices.begin(), chunkVertices.end(), vertices.begin() + chunk.firstVertex);
+	});
+	buildQuadtree();
+}
+
+int ChunkedTerrain::selectLod(const TerrainChunk& chunk, const LodCamera& camera) const {
+	// Distance from the camera to the closest point of the chunk's box
+	const ChunkBounds& b = chunk.bounds;
+	float dx = max(max(b.minX - camera.x, camera.x - b.maxX), 0.0f);
+	float dy = max(max(b.minY - camera.y, camera.y - b.maxY), 0.0f);
+	float dz = max(max(b.minZ - camera.z, camera.z - b.maxZ), 0.0f);
+	float distance = sqrtf(dx * dx + dy * dy + dz * dz);
+
+	// A world-space error e at distance d covers e * k / d pixels
+	float k = camera.viewportHeight / (2.0f * tanf(0.5f * camera.fovY));
+	float allowed = camera.maxPixelError * distance / k;
+	int lod = 0;
+	while (lod + 1 < (int)chunk.lods.size() && chunk.lods[lod + 1].error <= allowed)
+		lod++;
+	return lod;
+}
+
+size_t ChunkedTerrain::selectLods(const LodCamera& camera, vector<int>& lods) const {
+	lods.resize(chunks.size());
+	size_t count = 0;
+	for (size_t i = 0; i < chunks.size(); i++) {
+		lods[i] = selectLod(chunks[i], camera);
+		count += chunks[i].lods[lods[i]].triangleCount;
+	}
+	return count;
+}
+
+size_t ChunkedTerrain::cullNode(const Frustum& frustum, int level, int x, int z, bool inside, vector<int>& lods) const {
+	// Nodes on the right and far edges of a level can have fewer children
+	int w = levelWidths[level];
+	if (x >= w || (size_t)z * w + x >= levels[level].size())
+		return 0;
+	if (!inside) {
+		FrustumTest test = testBounds(frustum, levels[level][(size_t)z * w + x]);
+		if (test == FrustumTest::Outside) {
+			// Every chunk under the node goes without a test of its own
+			int span = 1 << level;
+			for (int cz = z * span; cz < min((z + 1) * span, chunksZ); cz++)
+				for (int cx = x * span; cx < min((x + 1) * span, chunksX); cx++)
+					lods[(size_t)cz * chunksX + cx] = CULLED_LOD;
+			return 0;
+		}
+		// Nothing under a node inside the frustum needs testing either
+		inside = test == FrustumTest::Inside;
+	}
+	if (level == 0) {
+		int lod = lods[(size_t)z * chunksX + x];
+		return chunks[(size_t)z * chunksX + x].lods[lod].triangleCount;
+	}
+	size_t count = 0;
+	for (int cz = 2 * z; cz < 2 * z + 2; cz++)
+		for (int cx = 2 * x; cx < 2 * x + 2; cx++)
+			count += cullNode(frustum, level - 1, cx, cz, inside, lods);
+	return count;
+}
+
+size_t ChunkedTerrain::cullChunks(const Matrix4& viewProjection, vector<int>& lods) const {
+	if (levels.empty())
+		return 0;
+	return cullNode(Frustum(viewProjection), (int)levels.size() - 1, 0, 0, false, lods);
+}
+
+size_t ChunkedTerrain::cullChunksFlat(const Matrix4& viewProjection, vector<int>& lods) const {
+	Frustum frustum(viewProjection);
+	size_t count = 0;
+	for (size_t i = 0; i < chunks.size(); i++) {
+		if (testBounds(frustum, chunks[i].bounds) == FrustumTest::Outside)
+			lods[i] = CULLED_LOD;
+		else
+			count += chunks[i].lods[lods[i]].triangleCount;
+	}
+	return count;
+}
@@ -0,0 +1,119 @@
+// Terrain split into fixed-size chunks, each with a chain of LOD index lists
+// (geomipmapping: LOD l keeps every 2^l-th sample). Skirts hang below every
+// chunk border so neighbouring chunks at different LODs never show cracks.
+// Chunks of the same size share their index lists (see GridIndices.h).
+// A quadtree of min/max boxes over the chunks culls them against the view
+// frustum. Building, LOD selection and culling are plain CPU code and need
+// no device
+#pragma once
+
+#include "MeshBuilder.h"
+#include "GridIndices.h"
+#include "Frustum.h"
+#include <vector>
+
+struct ChunkSettings {
+	// Cells along a chunk side, a power of two up to MAX_CHUNK_CELLS
+	int chunkCells;
+	// Number of LODs, including the full resolution one
+	int lodCount;
+	// Skirts reach at least this far below the border, and never less than
+	// the chunk's largest LOD error
+	float minSkirtDepth;
+	IndexOrder order;
+	MeshSettings mesh;
+
+	ChunkSettings() : chunkCells(64), lodCount(5), minSkirtDepth(1.0f), order(IndexOrder::CacheOptimized) {}
+};
+
+struct ChunkBounds {
+	float minX, minY, minZ;
+	float maxX, maxY, maxZ;
+};
+
+struct ChunkLod {
+	// Range of the LOD's indices in ChunkedTerrain::indices, shared by all
+	// chunks of the same size; strips when the order is IndexOrder::Strip
+	unsigned int firstIndex;
+	unsigned int indexCount;
+	unsigned int triangleCount;
+	// Largest vertical distance between the full resolution samples and this LOD
+	float error;
+};
+
+struct TerrainChunk {
+	// First sample and size in cells; chunks on the far map edges can be smaller
+	int x0, z0;
+	int cellsX, cellsZ;
+	ChunkBounds bounds;
+	// Vertices of the chunk in ChunkedTerrain::vertices; indices are relative
+	// to firstVertex (draw with it as the base vertex)
+	unsigned int firstVertex;
+	unsigned int vertexCount;
+	std::vector<ChunkLod> lods;
+};
+
+// LOD of a chunk outside the view frustum: draw nothing
+const int CULLED_LOD = -1;
+
+struct LodCamera {
+	float x, y, z;
+	// Vertical field of view in radians and viewport height in pixels
+	float fovY;
+	float viewportHeight;
+	// Largest screen-space error, in pixels, a chunk may show
+	float maxPixelError;
+
+	LodCamera() : x(0.0f), y(0.0f), z(0.0f), fovY(3.14159265f / 4.0f), viewportHeight(600.0f), maxPixelError(2.0f) {}
+};
+
+class ChunkedTerrain {
+public:
+	std::vector<Vertex> vertices;
+	std::vector<std::uint16_t> indices;
+	std::vector<TerrainChunk> chunks;
+public:
+	ChunkedTerrain(int width, int height, const HeightRowSource& source, const ChunkSettings& settings = ChunkSettings());
+
+	// Coarsest LOD whose projected error stays under camera.maxPixelError
+	int selectLod(const TerrainChunk& chunk, const LodCamera& camera) const;
+	// Pick every chunk's LOD; returns the number of triangles they draw
+	size_t selectLods(const LodCamera& camera, std::vector<int>& lods) const;
+	// Set lods to CULLED_LOD for every chunk whose box is outside the frustum
+	// of viewProjection (the viewer's g_View * g_Projection), walking the
+	// quadtree; lods come from selectLods. Returns the triangles left to draw
+	size_t cullChunks(const Matrix4& viewProjection, std::vector<int>& lods) const;
+	// Same result from testing every chunk on its own, for reference
+	size_t cullChunksFlat(const Matrix4& viewProjection, std::vector<int>& lods) const;
+
+	// Chunks whose vertices depend on samples [x0, x1) x [z0, z1): those
+	// holding one of them or, through the normals, one of their neighbours
+	void chunksTouching(int x0, int z0, int x1, int z1, std::vector<int>& out) const;
+	// Rebuild the vertices, bounds and LOD errors of the given chunks from
+	// grid, the map the terrain was built from after some of it changed, and
+	// refresh the quadtree. Every chunk keeps its range of vertices, so only
+	// those ranges need uploading again; the result is the same as building
+	// the terrain from grid anew
+	void rebuildChunks(const HeightGrid& grid, const std::vector<int>& which, ThreadPool& pool = ThreadPool::shared());
+	// Triangles of the whole map at full resolution, without skirts
+	size_t fullTriangleCount() const { return triangles; }
+	IndexOrder getIndexOrder() const { return settings.order; }
+	// World distance between neighbouring samples, MeshBuilder::spacing()
+	float getSpacing() const { return spacing; }
+private:
+	ChunkSettings settings;
+	size_t triangles;
+	int mapWidth, mapHeight;
+	float spacing;
+	int chunksX, chunksZ;
+	// Quadtree of bounds, one grid per level: level 0 holds the chunk boxes
+	// and every node above covers up to 2x2 nodes of the level below
+	std::vector<std::vector<ChunkBounds>> levels;
+	std::vector<int> levelWidths;
+
+	// Vertices, bounds and LOD errors of chunk from the grid vertices of its
+	// samples: origin is its first one and rows are stride vertices apart
+	void buildChunk(TerrainChunk& chunk, const Vertex* origin, size_t stride, std::vector<Vertex>& chunkVertices) const;
+	void buildQuadtree();
+	size_t cullNode(const Frustum& frustum, int level, int x, int z, bool inside, std::vector<int>& lods) const;
+};
@@ -0,0 +1,81 @@
+#include "DomainWarp.h"
+#include <algorithm>
+
+using namespace std;
+
+// The second field samples the same noise further along, so the two
+// components are uncorrelated
+constexpr double SECOND_X = 5.2;
+constexpr double SECOND_Y = 1.3;
+
+DomainWarp::DomainWarp(unsigned int seed, const WarpSettings& _settings)
+	: settings(_settings), noise(seed, _settings.fractal) {
+	settings.cellSize = max(1, settings.cellSize);
+}
+
+void DomainWarp::field(double dx, double dy, double z, int x0, int z0, int w, int h, WarpField& out) const {
+	int cell = settings.cellSize;
+	out.cellSize = cell;
+	out.nodeX = x0 / cell;
+	out.nodeZ = z0 / cell;
+	// One node past the last sample's cell, for the interpolation
+	int extra = cell > 1 ? 2 : 1;
+	out.columns = (x0 + w - 1) / cell - out.nodeX + extra;
+	out.rows = (z0 + h - 1) / cell - out.nodeZ + extra;
+	out.offsetX.resize((size_t)out.columns * out.rows);
+	out.offsetY.resize((size_t)out.columns * out.rows);
+
+	double f = settings.frequency;
+	float amplitude = (float)settings.amplitude;
+	vector<double> x(out.columns), y(out.columns), x2(out.columns), y2(out.columns);
+	for (int c = 0; c < out.columns; c++) {
+		x[c] = dx * ((out.nodeX + c) * cell) * f;
+		x2[c] = x[c] + SECOND_X;
+	}
+	for (int r = 0; r < out.rows; r++) {
+		double row = dy * ((out.nodeZ + r) * cell) * f;
+		fill(y.begin(), y.end(), row);
+		fill(y2.begin(), y2.end(), row + SECOND_Y);
+		float* ox = &out.offsetX[(size_t)r * out.columns];
+		float* oy = &out.offsetY[(size_t)r * out.columns];
+		noise.noisePoints(z, x.data(), y.data(), out.columns, ox);
+		noise.noisePoints(z, x2.data(), y2.data(), out.columns, oy);
+		for (int c = 0; c < out.columns; c++) {
+			ox[c] = amplitude * (2.0f * ox[c] - 1.0f);
+			oy[c] = amplitude * (2.0f * oy[c] - 1.0f);
+		}
+	}
+}
+
+void DomainWarp::warpRow(const WarpField& field, double dx, double dy, int x0, int j, int count, double* x, double* y) const {
+	int cell = field.cellSize;
+	double row = dy * j;
+	int local = j - field.nodeZ * cell;
+	int r = local / cell;
+	const float* topX = &field.offsetX[(size_t)r * field.columns];
+	const float* topY = &field.offsetY[(size_t)r * field.columns];
+	if (cell == 1) {
+		for (int k = 0; k < count; k++) {
+			int c = x0 + k - field.nodeX;
+			x[k] = dx * (x0 + k) + topX[c];
+			y[k] = row + topY[c];
+		}
+		return;
+	}
+
+	const float* bottomX = topX + field.columns;
+	const float* bottomY = topY + field.columns;
+	float inverse = 1.0f / cell;
+	float fz = (local - r * cell) * inverse;
+	for (int k = 0; k < count; k++) {
+		int i = x0 + k - field.nodeX * cell;
+		int c = i / cell;
+		float fx = (i - c * cell) * inverse;
+		float tx = topX[c] + fx * (topX[c + 1] - topX[c]);
+		float bx = bottomX[c] + fx * (bottomX[c + 1] - bottomX[c]);
+		float ty = topY[c] + fx * (topY[c + 1] - topY[c]);
+		float by = bottomY[c] + fx * (bottomY[c + 1] - bottomY[c]);
+		x[k] = dx * (x0 + k) + (tx + fz * (bx - tx));
+		y[k] = row + (ty + fz * (by - ty));
+	}
+}
@@ -0,0 +1,54 @@
+// Domain warping: the terrain is sampled at p + amplitude * d(p), where d is a
+// pair of fractal noise fields, which bends ridges and valleys into flowing
+// shapes. d costs two more fractal evaluations per sample, but it is much
+// smoother than the terrain it moves, so it is evaluated on a coarse lattice
+// of nodes cellSize samples apart and bilinearly upsampled
+#pragma once
+
+#include "FractalNoise.h"
+#include <vector>
+
+struct WarpSettings {
+	// Largest displacement, in noise units of the warped fractal; 0 turns the
+	// warp off
+	double amplitude;
+	// Warp noise frequency relative to the warped fractal
+	double frequency;
+	// Image samples between lattice nodes; 1 evaluates the warp at every sample
+	int cellSize;
+	FractalSettings fractal;
+
+	WarpSettings() : amplitude(0.0), frequency(0.5), cellSize(4) { fractal.octaves = 3; }
+};
+
+// Displacements at the lattice nodes covering a block of samples. Computed
+// once, a field serves every octave and every layer sampled over the block
+struct WarpField {
+	// Node (0, 0) is image sample (nodeX * cellSize, nodeZ * cellSize)
+	int nodeX, nodeZ;
+	int cellSize;
+	int columns, rows;
+	// Node displacements along the noise x and y axes, row-major
+	std::vector<float> offsetX, offsetY;
+
+	WarpField() : nodeX(0), nodeZ(0), cellSize(1), columns(0), rows(0) {}
+};
+
+class DomainWarp {
+	WarpSettings settings;
+	FractalNoise noise;
+public:
+	DomainWarp(unsigned int seed, const WarpSettings& settings = WarpSettings());
+
+	bool enabled() const { return settings.amplitude != 0.0; }
+	// Field covering samples [x0, x0 + w) x [z0, z0 + h) of an image whose
+	// sample (i, j) is the noise point (dx * i, dy * j). A node's value only
+	// depends on its own index, so neighbouring blocks agree on shared nodes
+	// and a sample gets the same bits from any tiling
+	void field(double dx, double dy, double z, int x0, int z0, int w, int h, WarpField& out) const;
+	// Warped noise points of the count samples of image row j from x0 on;
+	// the field must cover them
+	void warpRow(const WarpField& field, double dx, double dy, int x0, int j, int count, double* x, double* y) const;
+
+	const WarpSettings& getSettings() const { return settings; }
+};
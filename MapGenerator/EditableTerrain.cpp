@@ -0,0 +1,200 @@
+#include "EditableTerrain.h"
+#include <algorithm>
+#include <cmath>
+
+using namespace std;
+
+namespace {
+
+// Samples of already eroded map around regenerated tiles that their erosion sees
+const int EROSION_MARGIN = 16;
+
+}
+
+EditableTerrain::EditableTerrain(const HeightGrid& heights, const HeightmapSettings& _settings, const ChunkSettings& chunkSettings)
+	: grid(heights), settings(_settings), generator(new HeightmapGenerator(_settings)),
+	chunked(new ChunkedTerrain(heights.width, heights.height, gridRows(grid), chunkSettings)),
+	picker(new TerrainQuery(grid, chunkSettings.mesh)), eroded(false) {
+	tileSize = max(1, settings.tileSize);
+	tilesX = (grid.width + tileSize - 1) / tileSize;
+	tilesZ = (grid.height + tileSize - 1) / tileSize;
+	dirtyTiles.assign((size_t)tilesX * tilesZ, 0);
+	dirtyChunks.assign(chunked->chunks.size(), 0);
+}
+
+void EditableTerrain::sampleAt(float x, float z, int& sx, int& sz) const {
+	float step = chunked->getSpacing();
+	if (step <= 0.0f) {
+		sx = sz = 0;
+		return;
+	}
+	float u = x / step + 0.5f * (grid.width - 1), v = z / step + 0.5f * (grid.height - 1);
+	sx = min(max((int)floorf(u + 0.5f), 0), grid.width - 1);
+	sz = min(max((int)floorf(v + 0.5f), 0), grid.height - 1);
+}
+
+void EditableTerrain::applyBrush(const Brush& brush) {
+	float step = chunked->getSpacing();
+	if (step <= 0.0f || brush.radius <= 0.0f)
+		return;
+
+	// Brush in samples, and the samples it reaches
+	float cu = brush.x / step + 0.5f * (grid.width - 1), cv = brush.z / step + 0.5f * (grid.height - 1);
+	float r = brush.radius / step;
+	int x0 = max((int)ceilf(cu - r), 0), x1 = min((int)floorf(cu + r), grid.width - 1) + 1;
+	int z0 = max((int)ceilf(cv - r), 0), z1 = min((int)floorf(cv + r), grid.height - 1) + 1;
+	if (x0 >= x1 || z0 >= z1)
+		return;
+
+	// Smooth averages the neighbours as they were before the stroke
+	HeightGrid before;
+	if (brush.mode == BrushMode::Smooth) {
+		before = HeightGrid(x1 - x0 + 2, z1 - z0 + 2);
+		for (int z = 0; z < before.height; z++)
+			for (int x = 0; x < before.width; x++)
+				before.at(x, z) = grid.at(min(max(x0 - 1 + x, 0), grid.width - 1), min(max(z0 - 1 + z, 0), grid.height - 1));
+	}
+
+	for (int z = z0; z < z1; z++) {
+		float* row = grid.row(z);
+		for (int x = x0; x < x1; x++) {
+			float du = (x - cu) / r, dv = (z - cv) / r;
+			float d2 = du * du + dv * dv;
+			if (d2 >= 1.0f)
+				continue;
+			// Smooth falloff, 1 at the centre and flat at the rim
+			float weight = (1.0f - d2) * (1.0f - d2);
+			float value = row[x];
+			switch (brush.mode) {
+			case BrushMode::Raise:
+				value += brush.strength * weight;
+				break;
+			case BrushMode::Lower:
+				value -= brush.strength * weight;
+				break;
+			case BrushMode::Flatten:
+				value += (brush.target - value) * min(brush.strength * weight, 1.0f);
+				break;
+			case BrushMode::Smooth: {
+				int bx = x - x0 + 1, bz = z - z0 + 1;
+				float average = 0.25f * (before.at(bx - 1, bz) + before.at(bx + 1, bz) + before.at(bx, bz - 1) + before.at(bx, bz + 1));
+				value += (average - value) * min(brush.strength * weight, 1.0f);
+				break;
+			}
+			}
+			row[x] = min(max(value, 0.0f), 1.0f);
+		}
+	}
+	markChanged(x0, z0, x1, z1);
+}
+
+void EditableTerrain::setSettings(const HeightmapSettings& _settings) {
+	settings = _settings;
+	generator.reset(new HeightmapGenerator(settings));
+	// Tiles are the generator's unit of work, so their size follows it
+	tileSize = max(1, settings.tileSize);
+	tilesX = (grid.width + tileSize - 1) / tileSize;
+	tilesZ = (grid.height + tileSize - 1) / tileSize;
+	dirtyTiles.assign((size_t)tilesX * tilesZ, 1);
+}
+
+void EditableTerrain::regenerate(int x0, int z0, int x1, int z1) {
+	x0 = max(x0, 0);
+	z0 = max(z0, 0);
+	x1 = min(x1, grid.width);
+	z1 = min(z1, grid.height);
+	if (x0 >= x1 || z0 >= z1)
+		return;
+	for (int tz = z0 / tileSize; tz <= (z1 - 1) / tileSize; tz++)
+		for (int tx = x0 / tileSize; tx <= (x1 - 1) / tileSize; tx++)
+			dirtyTiles[(size_t)tz * tilesX + tx] = 1;
+}
+
+void EditableTerrain::setErosion(const ErosionSettings& settings) {
+	eroded = true;
+	erosion = settings;
+}
+
+bool EditableTerrain::pending() const {
+	return find(dirtyTiles.begin(), dirtyTiles.end(), 1) != dirtyTiles.end()
+		|| find(dirtyChunks.begin(), dirtyChunks.end(), 1) != dirtyChunks.end();
+}
+
+void EditableTerrain::markChanged(int x0, int z0, int x1, int z1) {
+	chunked->chunksTouching(x0, z0, x1, z1, touched);
+	for (int i : touched)
+		dirtyChunks[i] = 1;
+	Region region = { x0, z0, x1, z1 };
+	changedRegions.push_back(region);
+}
+
+vector<int> EditableTerrain::update(ThreadPool& pool) {
+	vector<int> tiles;
+	for (size_t i = 0; i < dirtyTiles.size(); i++)
+		if (dirtyTiles[i])
+			tiles.push_back((int)i);
+	// Tiles write disjoint samples, so they regenerate side by side
+	pool.parallelFor(0, (int)tiles.size(), [&](int k) {
+		int tx = tiles[k] % tilesX, tz = tiles[k] / tilesX;
+		int x0 = tx * tileSize, z0 = tz * tileSize;
+		generator->generateTile(grid, x0, z0, min(tileSize, grid.width - x0), min(tileSize, grid.height - z0));
+	});
+	if (eroded && !tiles.empty())
+		erodeTiles(tiles, pool);
+	for (int t : tiles) {
+		int x0 = (t % tilesX) * tileSize, z0 = (t / tilesX) * tileSize;
+		markChanged(x0, z0, min(x0 + tileSize, grid.width), min(z0 + tileSize, grid.height));
+		dirtyTiles[t] = 0;
+	}
+
+	vector<int> changed;
+	for (size_t i = 0; i < dirtyChunks.size(); i++) {
+		if (dirtyChunks[i]) {
+			changed.push_back((int)i);
+			dirtyChunks[i] = 0;
+		}
+	}
+	if (!changed.empty())
+		chunked->rebuildChunks(grid, changed, pool);
+	for (const Region& region : changedRegions)
+		picker->update(grid, region.x0, region.z0, region.x1, region.z1);
+	changedRegions.clear();
+	return changed;
+}
+
+void EditableTerrain::erodeTiles(const vector<int>& tiles, ThreadPool& pool) {
+	// The whole map regenerated: erode it as one, like generate() then Erosion::run()
+	if (tiles.size() == dirtyTiles.size()) {
+		Erosion(erosion).run(grid, pool);
+		return;
+	}
+
+	// Otherwise every tile alone in its own padded window. All windows are
+	// cut before any is eroded, so a tile only sees its own margin as it was
+	// after regeneration and not the order tiles are processed in
+	vector<HeightGrid> windows(tiles.size());
+	vector<Region> bounds(tiles.size());
+	for (size_t i = 0; i < tiles.size(); i++) {
+		int tx = (tiles[i] % tilesX) * tileSize, tz = (tiles[i] / tilesX) * tileSize;
+		Region& b = bounds[i];
+		b.x0 = max(tx - EROSION_MARGIN, 0);
+		b.z0 = max(tz - EROSION_MARGIN, 0);
+		b.x1 = min(tx + tileSize + EROSION_MARGIN, grid.width);
+		b.z1 = min(tz + tileSize + EROSION_MARGIN, grid.height);
+		windows[i] = HeightGrid(b.x1 - b.x0, b.z1 - b.z0);
+		for (int z = b.z0; z < b.z1; z++)
+			copy(grid.row(z) + b.x0, grid.row(z) + b.x1, windows[i].row(z - b.z0));
+	}
+
+	// Only the tile takes the result; the margin stays as it was
+	Erosion eroder(erosion);
+	for (size_t i = 0; i < tiles.size(); i++) {
+		eroder.run(windows[i], pool);
+		int tx = (tiles[i] % tilesX) * tileSize, tz = (tiles[i] / tilesX) * tileSize;
+		int w = min(tileSize, grid.width - tx);
+		for (int z = tz; z < min(tz + tileSize, grid.height); z++) {
+			const float* src = windows[i].row(z - bounds[i].z0) + (tx - bounds[i].x0);
+			copy(src, src + w, grid.row(z) + tx);
+		}
+	}
+}
@@ -0,0 +1,95 @@
+// A heightmap and its chunked terrain kept in step through interactive edits.
+// Brush strokes change samples in place; parameter changes and explicit
+// requests mark map tiles for regeneration. Both only mark: update() then
+// regenerates the marked tiles, rebuilds just the chunks whose vertices
+// depend on a changed sample (normals reach one sample past it) and reports
+// them, so a viewer re-uploads those vertex ranges and nothing else. A
+// TerrainQuery of the map, for picking, is refreshed over the same samples.
+//
+// Regenerated tiles are the generator's raw output unless setErosion() is
+// given the settings the map was eroded with. Then they are eroded again.
+// Regenerating the whole map erodes it as one, which gives exactly the map
+// generated and then eroded. Otherwise every tile erodes on its own, in a
+// window padded with the neighbouring samples, which are read but not
+// written back. A tile's result then only depends on the tile and that
+// margin, never on which other tiles were regenerated with it, and costs
+// the same on any map size. It is not what eroding the whole map again
+// would give, and can show a small step along the tile edges. Brush strokes
+// are never eroded
+#pragma once
+
+#include "HeightmapGenerator.h"
+#include "Erosion.h"
+#include "ChunkedTerrain.h"
+#include "TerrainQuery.h"
+#include "ThreadPool.h"
+#include <memory>
+#include <vector>
+
+enum class BrushMode { Raise, Lower, Flatten, Smooth };
+
+struct Brush {
+	BrushMode mode;
+	// Centre and radius in world units, on the terrain's xz plane
+	float x, z;
+	float radius;
+	// Height change at the centre, in [0, 1] map units, for Raise and Lower;
+	// the blend towards the target or the neighbours' average otherwise
+	float strength;
+	// Map value Flatten pulls towards
+	float target;
+
+	Brush() : mode(BrushMode::Raise), x(0.0f), z(0.0f), radius(8.0f), strength(0.02f), target(0.5f) {}
+};
+
+class EditableTerrain {
+	// Samples [x0, x1) x [z0, z1) changed since the last update()
+	struct Region {
+		int x0, z0, x1, z1;
+	};
+
+	HeightGrid grid;
+	HeightmapSettings settings;
+	std::unique_ptr<HeightmapGenerator> generator;
+	std::unique_ptr<ChunkedTerrain> chunked;
+	std::unique_ptr<TerrainQuery> picker;
+	bool eroded;
+	ErosionSettings erosion;
+	int tileSize, tilesX, tilesZ;
+	// Tiles to regenerate and chunks to rebuild on the next update()
+	std::vector<char> dirtyTiles;
+	std::vector<char> dirtyChunks;
+	std::vector<int> touched;
+	std::vector<Region> changedRegions;
+public:
+	// heights need not come from the generator (eroded, loaded from a file);
+	// only tiles marked for regeneration are replaced by its output
+	EditableTerrain(const HeightGrid& heights, const HeightmapSettings& settings = HeightmapSettings(),
+		const ChunkSettings& chunkSettings = ChunkSettings());
+
+	// Change the samples under the brush and mark their chunks
+	void applyBrush(const Brush& brush);
+	// New generator parameters; every tile is regenerated on the next update
+	void setSettings(const HeightmapSettings& settings);
+	// Mark the tiles overlapping samples [x0, x1) x [z0, z1) for regeneration
+	void regenerate(int x0, int z0, int x1, int z1);
+	// Erode regenerated tiles with these settings from now on
+	void setErosion(const ErosionSettings& settings);
+
+	// Regenerate the marked tiles, rebuild the chunks that changed and refresh
+	// query(); returns the chunks' indices in terrain().chunks, whose vertex
+	// ranges need uploading
+	std::vector<int> update(ThreadPool& pool = ThreadPool::shared());
+	bool pending() const;
+
+	const ChunkedTerrain& terrain() const { return *chunked; }
+	const HeightGrid& heights() const { return grid; }
+	// Heights and rays against the map as of the last update()
+	const TerrainQuery& query() const { return *picker; }
+	// Map sample nearest to world (x, z), clamped to the map
+	void sampleAt(float x, float z, int& sx, int& sz) const;
+private:
+	// Mark the chunks of a change to samples [x0, x1) x [z0, z1)
+	void markChanged(int x0, int z0, int x1, int z1);
+	void erodeTiles(const std::vector<int>& tiles, ThreadPool& pool);
+};
@@ -0,0 +1,242 @@
+#include "Erosion.h"
+#include <algorithm>
+#include <cmath>
+
+using namespace std;
+
+Erosion::Erosion(const ErosionSettings& _settings) : settings(_settings), width(0), height(0), stride(0) {
+}
+
+void Erosion::load(const HeightGrid& heights) {
+	width = heights.width;
+	height = heights.height;
+	stride = width + 2;
+	size_t cells = (size_t)stride * (height + 2);
+
+	terrain.assign(cells, 0.0f);
+	for (int z = 0; z < height; z++) {
+		const float* src = heights.row(z);
+		float* dst = &terrain[(size_t)(z + 1) * stride + 1];
+		for (int x = 0; x < width; x++)
+			dst[x] = src[x] * settings.heightScale;
+	}
+	fillBorder();
+
+	// The border of every other buffer stays zero: no water, sediment or
+	// flow ever enters from outside the map
+	water.assign(cells, 0.0f);
+	sediment.assign(cells, 0.0f);
+	moved.assign(cells, 0.0f);
+	flowL.assign(cells, 0.0f);
+	flowR.assign(cells, 0.0f);
+	flowT.assign(cells, 0.0f);
+	flowB.assign(cells, 0.0f);
+	velocityX.assign(cells, 0.0f);
+	velocityZ.assign(cells, 0.0f);
+	tilt.assign(cells, 0.0f);
+}
+
+void Erosion::store(HeightGrid& heights) const {
+	float inverse = 1.0f / settings.heightScale;
+	for (int z = 0; z < height; z++) {
+		const float* src = &terrain[(size_t)(z + 1) * stride + 1];
+		float* dst = heights.row(z);
+		for (int x = 0; x < width; x++)
+			dst[x] = src[x] * inverse;
+	}
+}
+
+void Erosion::fillBorder() {
+	for (int z = 1; z <= height; z++) {
+		float* row = &terrain[(size_t)z * stride];
+		row[0] = row[1];
+		row[width + 1] = row[width];
+	}
+	copy(&terrain[stride], &terrain[2 * (size_t)stride], &terrain[0]);
+	copy(&terrain[(size_t)height * stride], &terrain[(size_t)(height + 1) * stride], &terrain[(size_t)(height + 1) * stride]);
+}
+
+void Erosion::forBands(ThreadPool& pool, void (Erosion::*phase)(int z0, int z1)) {
+	int rows = max(1, settings.bandRows);
+	int bands = (height + rows - 1) / rows;
+	pool.parallelFor(0, bands, [&](int band) {
+		int z0 = band * rows;
+		(this->*phase)(z0, min(z0 + rows, height));
+	});
+}
+
+// Outflow of every cell from the height of its water surface above each
+// neighbour, scaled down where it would drain more water than the cell holds
+void Erosion::flowPhase(int z0, int z1) {
+	const HydraulicSettings& h = settings.hydraulic;
+	float gain = h.timeStep * h.pipe;
+	for (int z = z0; z < z1; z++) {
+		// Nothing flows over the map edge
+		float maskT = z > 0 ? 1.0f : 0.0f;
+		float maskB = z < height - 1 ? 1.0f : 0.0f;
+		size_t row = (size_t)(z + 1) * stride + 1;
+		for (int x = 0; x < width; x++) {
+			size_t i = row + x;
+			float maskL = x > 0 ? 1.0f : 0.0f;
+			float maskR = x < width - 1 ? 1.0f : 0.0f;
+			float surface = terrain[i] + water[i];
+			float l = max(0.0f, flowL[i] + gain * (surface - terrain[i - 1] - water[i - 1])) * maskL;
+			float r = max(0.0f, flowR[i] + gain * (surface - terrain[i + 1] - water[i + 1])) * maskR;
+			float t = max(0.0f, flowT[i] + gain * (surface - terrain[i - stride] - water[i - stride])) * maskT;
+			float b = max(0.0f, flowB[i] + gain * (surface - terrain[i + stride] - water[i + stride])) * maskB;
+			float k = min(1.0f, water[i] / max((l + r + t + b) * h.timeStep, 1e-20f));
+			flowL[i] = l * k;
+			flowR[i] = r * k;
+			flowT[i] = t * k;
+			flowB[i] = b * k;
+		}
+	}
+}
+
+// New water depth from the net flow, velocity from the flow through the cell
+// and the sine of the terrain slope for the transport capacity
+void Erosion::waterPhase(int z0, int z1) {
+	const HydraulicSettings& h = settings.hydraulic;
+	for (int z = z0; z < z1; z++) {
+		size_t row = (size_t)(z + 1) * stride + 1;
+		for (int x = 0; x < width; x++) {
+			size_t i = row + x;
+			float in = flowR[i - 1] + flowL[i + 1] + flowB[i - stride] + flowT[i + stride];
+			float out = flowL[i] + flowR[i] + flowT[i] + flowB[i];
+			float before = water[i];
+			float after = max(0.0f, before + h.timeStep * (in - out));
+			water[i] = after;
+
+			float mean = 0.5f * (before + after);
+			float throughX = 0.5f * (flowR[i - 1] - flowL[i] + flowR[i] - flowL[i + 1]);
+			float throughZ = 0.5f * (flowB[i - stride] - flowT[i] + flowB[i] - flowT[i + stride]);
+			// Films of water too thin to carry anything don't get a velocity
+			float inverse = mean > 1e-4f ? 1.0f / mean : 0.0f;
+			velocityX[i] = throughX * inverse;
+			velocityZ[i] = throughZ * inverse;
+
+			float gx = 0.5f * (terrain[i + 1] - terrain[i - 1]);
+			float gz = 0.5f * (terrain[i + stride] - terrain[i - stride]);
+			float g2 = gx * gx + gz * gz;
+			tilt[i] = max(sqrtf(g2 / (1.0f + g2)), h.minTilt);
+		}
+	}
+}
+
+// Dissolve terrain where the water could carry more, deposit where it carries too much
+void Erosion::erodePhase(int z0, int z1) {
+	const HydraulicSettings& h = settings.hydraulic;
+	for (int z = z0; z < z1; z++) {
+		size_t row = (size_t)(z + 1) * stride + 1;
+		for (int x = 0; x < width; x++) {
+			size_t i = row + x;
+			float speed = sqrtf(velocityX[i] * velocityX[i] + velocityZ[i] * velocityZ[i]);
+			float surplus = h.capacity * tilt[i] * speed * water[i] - sediment[i];
+			float amount = surplus > 0.0f ? h.dissolve * surplus : h.deposit * surplus;
+			terrain[i] -= amount;
+			sediment[i] += amount;
+		}
+	}
+}
+
+// Carry sediment along the velocity (semi-Lagrangian: fetch it from upstream),
+// then evaporate and rain
+void Erosion::transportPhase(int z0, int z1) {
+	const HydraulicSettings& h = settings.hydraulic;
+	float keep = 1.0f - h.evaporation * h.timeStep;
+	float rain = h.rain * h.timeStep;
+	for (int z = z0; z < z1; z++) {
+		size_t row = (size_t)(z + 1) * stride + 1;
+		for (int x = 0; x < width; x++) {
+			size_t i = row + x;
+			float px = min(max(x - velocityX[i] * h.timeStep, 0.0f), (float)(width - 1));
+			float pz = min(max(z - velocityZ[i] * h.timeStep, 0.0f), (float)(height - 1));
+			int x0 = (int)px, zs = (int)pz;
+			float fx = px - x0, fz = pz - zs;
+			int x1 = x0 + (x0 < width - 1 ? 1 : 0);
+			int zn = zs + (zs < height - 1 ? 1 : 0);
+			const float* a = &sediment[(size_t)(zs + 1) * stride + 1];
+			const float* b = &sediment[(size_t)(zn + 1) * stride + 1];
+			float top = a[x0] + fx * (a[x1] - a[x0]);
+			float bottom = b[x0] + fx * (b[x1] - b[x0]);
+			moved[i] = top + fz * (bottom - top);
+
+			water[i] = water[i] * keep + rain;
+		}
+	}
+}
+
+void Erosion::hydraulic(HeightGrid& heights, ThreadPool& pool) {
+	if (heights.width < 2 || heights.height < 2)
+		return;
+	load(heights);
+	float rain = settings.hydraulic.rain * settings.hydraulic.timeStep;
+	for (int z = 0; z < height; z++)
+		fill(&water[(size_t)(z + 1) * stride + 1], &water[(size_t)(z + 1) * stride + 1 + width], rain);
+
+	for (int i = 0; i < settings.hydraulic.iterations; i++) {
+		forBands(pool, &Erosion::flowPhase);
+		forBands(pool, &Erosion::waterPhase);
+		forBands(pool, &Erosion::erodePhase);
+		fillBorder();
+		forBands(pool, &Erosion::transportPhase);
+		sediment.swap(moved);
+	}
+
+	for (size_t i = 0; i < terrain.size(); i++)
+		terrain[i] += sediment[i];
+	store(heights);
+}
+
+// Material above the talus leaves towards every lower neighbour in
+// proportion to the drop, half the largest excess at most
+void Erosion::thermalOutflowPhase(int z0, int z1) {
+	const ThermalSettings& t = settings.thermal;
+	for (int z = z0; z < z1; z++) {
+		size_t row = (size_t)(z + 1) * stride + 1;
+		for (int x = 0; x < width; x++) {
+			size_t i = row + x;
+			float h = terrain[i];
+			float dl = h - terrain[i - 1], dr = h - terrain[i + 1];
+			float dt = h - terrain[i - stride], db = h - terrain[i + stride];
+			float el = max(dl - t.talus, 0.0f), er = max(dr - t.talus, 0.0f);
+			float et = max(dt - t.talus, 0.0f), eb = max(db - t.talus, 0.0f);
+			float total = el + er + et + eb;
+			float largest = max(max(el, er), max(et, eb));
+			float scale = total > 0.0f ? 0.5f * t.rate * largest / total : 0.0f;
+			flowL[i] = el * scale;
+			flowR[i] = er * scale;
+			flowT[i] = et * scale;
+			flowB[i] = eb * scale;
+		}
+	}
+}
+
+void Erosion::thermalApplyPhase(int z0, int z1) {
+	for (int z = z0; z < z1; z++) {
+		size_t row = (size_t)(z + 1) * stride + 1;
+		for (int x = 0; x < width; x++) {
+			size_t i = row + x;
+			float in = flowR[i - 1] + flowL[i + 1] + flowB[i - stride] + flowT[i + stride];
+			float out = flowL[i] + flowR[i] + flowT[i] + flowB[i];
+			terrain[i] += in - out;
+		}
+	}
+}
+
+void Erosion::thermal(HeightGrid& heights, ThreadPool& pool) {
+	if (heights.width < 2 || heights.height < 2)
+		return;
+	load(heights);
+	for (int i = 0; i < settings.thermal.iterations; i++) {
+		fillBorder();
+		forBands(pool, &Erosion::thermalOutflowPhase);
+		forBands(pool, &Erosion::thermalApplyPhase);
+	}
+	store(heights);
+}
+
+void Erosion::run(HeightGrid& heights, ThreadPool& pool) {
+	hydraulic(heights, pool);
+	thermal(heights, pool);
+}
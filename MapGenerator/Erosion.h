@@ -0,0 +1,90 @@
+// Grid erosion run on a height grid before meshing: hydraulic erosion with the
+// virtual pipe model (water, sediment and outflow flux per cell) and thermal
+// erosion that moves material down slopes steeper than the talus.
+//
+// Every iteration is a short sequence of phases. A phase only writes the cells
+// it owns and only reads values the previous phase finished, so row bands run
+// in parallel and the result is bit-identical for any pool size
+#pragma once
+
+#include "HeightGrid.h"
+#include "ThreadPool.h"
+#include <vector>
+
+struct HydraulicSettings {
+	int iterations;
+	float timeStep;
+	// Water added to every cell per unit of time
+	float rain;
+	// Pipe cross-section * gravity / pipe length
+	float pipe;
+	// Sediment a unit of water can carry at unit slope and speed
+	float capacity;
+	// Fractions of the capacity surplus dissolved or deficit deposited per step
+	float dissolve;
+	float deposit;
+	// Water lost per unit of time, as a fraction
+	float evaporation;
+	// Flat ground still carries a little sediment
+	float minTilt;
+
+	HydraulicSettings() : iterations(100), timeStep(0.05f), rain(0.02f), pipe(9.81f), capacity(1.0f),
+		dissolve(0.3f), deposit(0.3f), evaporation(0.02f), minTilt(0.05f) {}
+};
+
+struct ThermalSettings {
+	int iterations;
+	// Largest stable height difference between neighbours, in cells
+	float talus;
+	// Fraction of the excess that slides per iteration
+	float rate;
+
+	ThermalSettings() : iterations(50), talus(0.6f), rate(0.5f) {}
+};
+
+struct ErosionSettings {
+	// Grid values are multiplied by this to get heights in cells (neighbours
+	// are one unit apart); slopes, talus and capacities are in those units
+	float heightScale;
+	// Rows handed to a task at once
+	int bandRows;
+	HydraulicSettings hydraulic;
+	ThermalSettings thermal;
+
+	ErosionSettings() : heightScale(32.0f), bandRows(32) {}
+};
+
+class Erosion {
+	ErosionSettings settings;
+	int width, height;
+	// Row length of the padded buffers: one cell of border on every side
+	int stride;
+	std::vector<float> terrain, water, sediment, moved;
+	// Outflow towards -x, +x, -z and +z
+	std::vector<float> flowL, flowR, flowT, flowB;
+	std::vector<float> velocityX, velocityZ, tilt;
+public:
+	Erosion(const ErosionSettings& settings = ErosionSettings());
+
+	// Run settings.hydraulic.iterations steps. Sediment still suspended at
+	// the end settles where it is and the water is dropped
+	void hydraulic(HeightGrid& heights, ThreadPool& pool);
+	void thermal(HeightGrid& heights, ThreadPool& pool);
+	// Hydraulic then thermal erosion
+	void run(HeightGrid& heights, ThreadPool& pool);
+
+	const ErosionSettings& getSettings() const { return settings; }
+private:
+	void load(const HeightGrid& heights);
+	void store(HeightGrid& heights) const;
+	// Copy the outermost cells of terrain into the border
+	void fillBorder();
+	void forBands(ThreadPool& pool, void (Erosion::*phase)(int z0, int z1));
+
+	void flowPhase(int z0, int z1);
+	void waterPhase(int z0, int z1);
+	void erodePhase(int z0, int z1);
+	void transportPhase(int z0, int z1);
+	void thermalOutflowPhase(int z0, int z1);
+	void thermalApplyPhase(int z0, int z1);
+};
@@ -0,0 +1,259 @@
+#include "FractalNoise.h"
+#include <cmath>
+#include <algorithm>
+
+// Samples evaluated per octave before moving on to the next one
+constexpr int ROW_CHUNK = 256;
+
+FractalNoise::FractalNoise(unsigned int seed, const FractalSettings& _settings)
+	: pn(seed), settings(_settings) {
+	// Eroded mode needs derivatives, which only the 3D Perlin backend has
+	if (settings.mode == FractalMode::Eroded)
+		settings.type = NoiseType::Perlin3D;
+	source = makeNoise(settings.type, seed);
+
+	int octaves = std::max(1, settings.octaves);
+	double total = 0.0;
+	double f = 1.0, a = 1.0;
+	for (int i = 0; i < octaves; i++) {
+		frequency.push_back(f);
+		weight.push_back(a);
+		// Octave 0 stays on the plain lattice so one octave equals the base noise
+		offset.push_back(i * 19.1876);
+		total += a;
+		f *= settings.lacunarity;
+		a *= settings.gain;
+	}
+	for (double& w : weight)
+		w /= total;
+
+	// Every octave contributes a value in [0, weight], so dropping the tail
+	// changes the output by at most the sum of the dropped weights
+	activeOctaves = octaves;
+	double remaining = 0.0;
+	while (activeOctaves > 1 && remaining + weight[activeOctaves - 1] <= settings.epsilon) {
+		remaining += weight[activeOctaves - 1];
+		activeOctaves--;
+	}
+}
+
+// Map a raw octave value in [0, 1] to its contribution before weighting
+static inline double shape(FractalMode mode, double n) {
+	switch (mode) {
+	case FractalMode::Ridged: {
+		double r = 1.0 - fabs(2.0 * n - 1.0);
+		return r * r;
+	}
+	case FractalMode::Billow:
+		return fabs(2.0 * n - 1.0);
+	default:
+		return n;
+	}
+}
+
+// d shape / d n
+static inline double shapeSlope(FractalMode mode, double n) {
+	double s = 2.0 * n - 1.0;
+	double sign = s < 0.0 ? -1.0 : 1.0;
+	switch (mode) {
+	case FractalMode::Ridged:
+		return -4.0 * (1.0 - fabs(s)) * sign;
+	case FractalMode::Billow:
+		return 2.0 * sign;
+	default:
+		return 1.0;
+	}
+}
+
+// Shape the raw octave values in place and add them with weight w to dst,
+// which the first octave overwrites
+static void addOctave(FractalMode mode, float w, bool first, float* octave, int n, float* dst) {
+	switch (mode) {
+	case FractalMode::Ridged:
+		for (int k = 0; k < n; k++) {
+			float r = 1.0f - fabsf(2.0f * octave[k] - 1.0f);
+			octave[k] = r * r;
+		}
+		break;
+	case FractalMode::Billow:
+		for (int k = 0; k < n; k++)
+			octave[k] = fabsf(2.0f * octave[k] - 1.0f);
+		break;
+	default:
+		break;
+	}
+
+	if (first) {
+		for (int k = 0; k < n; k++)
+			dst[k] = w * octave[k];
+	}
+	else {
+		for (int k = 0; k < n; k++)
+			dst[k] += w * octave[k];
+	}
+}
+
+NoiseSample FractalNoise::accumulate(double x, double y, double z, bool wide) const {
+	NoiseSample sum = { 0.0, 0.0, 0.0, 0.0 };
+	double slopeX = 0.0, slopeY = 0.0;
+	for (int i = 0; i < activeOctaves; i++) {
+		double f = frequency[i];
+		double px = x * f + offset[i], py = y * f + offset[i], pz = z * f + offset[i];
+		NoiseSample n = wide ? pn.noiseWideDerivative(px, py, pz) : pn.noiseDerivative(px, py, pz);
+
+		double value, slope;
+		if (settings.mode == FractalMode::Eroded) {
+			slopeX += n.dx;
+			slopeY += n.dy;
+			double damping = 1.0 / (1.0 + slopeX * slopeX + slopeY * slopeY);
+			value = n.value * damping;
+			slope = damping;
+		}
+		else {
+			value = shape(settings.mode, n.value);
+			slope = shapeSlope(settings.mode, n.value);
+		}
+		double scale = weight[i] * slope * f;
+		sum.value += weight[i] * value;
+		sum.dx += scale * n.dx;
+		sum.dy += scale * n.dy;
+		sum.dz += scale * n.dz;
+	}
+	return sum;
+}
+
+NoiseSample FractalNoise::noiseDerivative(double x, double y, double z) const {
+	return accumulate(x, y, z, false);
+}
+
+NoiseSample FractalNoise::noiseWideDerivative(double x, double y, double z) const {
+	return accumulate(x, y, z, true);
+}
+
+double FractalNoise::noise(double x, double y, double z) const {
+	// The damping needs every octave's derivatives
+	if (settings.mode == FractalMode::Eroded)
+		return accumulate(x, y, z, false).value;
+	double sum = 0.0;
+	bool perlin = settings.type == NoiseType::Perlin3D;
+	for (int i = 0; i < activeOctaves; i++) {
+		double f = frequency[i];
+		double px = x * f + offset[i], py = y * f + offset[i], pz = z * f + offset[i];
+		double n = perlin ? pn.noise(px, py, pz) : source->noise(px, py, pz);
+		sum += weight[i] * shape(settings.mode, n);
+	}
+	return sum;
+}
+
+double FractalNoise::noiseWide(double x, double y, double z) const {
+	if (settings.mode == FractalMode::Eroded)
+		return accumulate(x, y, z, true).value;
+	double sum = 0.0;
+	for (int i = 0; i < activeOctaves; i++) {
+		double f = frequency[i];
+		double n = pn.noiseWide(x * f + offset[i], y * f + offset[i], z * f + offset[i]);
+		sum += weight[i] * shape(settings.mode, n);
+	}
+	return sum;
+}
+
+void FractalNoise::noiseRow(double y, double z, double x0, double dx, int count, float* out) const {
+	if (activeOctaves == 1 && settings.mode == FractalMode::FBM) {
+		source->noiseRow(y, z, x0, dx, count, out);
+		return;
+	}
+	// The damping needs every octave's derivatives
+	if (settings.mode == FractalMode::Eroded) {
+		float dX[ROW_CHUNK], dY[ROW_CHUNK];
+		for (int start = 0; start < count; start += ROW_CHUNK) {
+			int n = std::min(ROW_CHUNK, count - start);
+			noiseDerivativeRow(y, z, x0 + dx * start, dx, n, out + start, dX, dY);
+		}
+		return;
+	}
+
+	float octave[ROW_CHUNK];
+	for (int start = 0; start < count; start += ROW_CHUNK) {
+		int n = std::min(ROW_CHUNK, count - start);
+		float* dst = out + start;
+		double xs = x0 + dx * start;
+
+		for (int i = 0; i < activeOctaves; i++) {
+			double f = frequency[i];
+			source->noiseRow(y * f + offset[i], z * f + offset[i], xs * f + offset[i], dx * f, n, octave);
+
+			addOctave(settings.mode, (float)weight[i], i == 0, octave, n, dst);
+		}
+	}
+}
+
+void FractalNoise::noisePoints(double z, const double* x, const double* y, int count, float* out) const {
+	if (settings.mode == FractalMode::Eroded) {
+		for (int k = 0; k < count; k++)
+			out[k] = (float)accumulate(x[k], y[k], z, false).value;
+		return;
+	}
+
+	bool perlin = settings.type == NoiseType::Perlin3D;
+	double px[ROW_CHUNK], py[ROW_CHUNK];
+	float octave[ROW_CHUNK];
+	for (int start = 0; start < count; start += ROW_CHUNK) {
+		int n = std::min(ROW_CHUNK, count - start);
+		float* dst = out + start;
+
+		for (int i = 0; i < activeOctaves; i++) {
+			double f = frequency[i];
+			for (int k = 0; k < n; k++) {
+				px[k] = x[start + k] * f + offset[i];
+				py[k] = y[start + k] * f + offset[i];
+			}
+			double pz = z * f + offset[i];
+			if (perlin)
+				pn.noisePoints(pz, px, py, n, octave);
+			else {
+				for (int k = 0; k < n; k++)
+					octave[k] = (float)source->noise(px[k], py[k], pz);
+			}
+			addOctave(settings.mode, (float)weight[i], i == 0, octave, n, dst);
+		}
+	}
+}
+
+void FractalNoise::noiseDerivativeRow(double y, double z, double x0, double dx, int count, float* value, float* dX, float* dY) const {
+	float octave[ROW_CHUNK], octaveX[ROW_CHUNK], octaveY[ROW_CHUNK];
+	// Running slope sums of Eroded mode
+	float slopeX[ROW_CHUNK], slopeY[ROW_CHUNK];
+	for (int start = 0; start < count; start += ROW_CHUNK) {
+		int n = std::min(ROW_CHUNK, count - start);
+		double xs = x0 + dx * start;
+		std::fill(value + start, value + start + n, 0.0f);
+		std::fill(dX + start, dX + start + n, 0.0f);
+		std::fill(dY + start, dY + start + n, 0.0f);
+		std::fill(slopeX, slopeX + n, 0.0f);
+		std::fill(slopeY, slopeY + n, 0.0f);
+
+		for (int i = 0; i < activeOctaves; i++) {
+			double f = frequency[i];
+			pn.noiseDerivativeRow(y * f + offset[i], z * f + offset[i], xs * f + offset[i], dx * f, n, octave, octaveX, octaveY);
+
+			float w = (float)weight[i];
+			float wf = (float)(weight[i] * f);
+			for (int k = 0; k < n; k++) {
+				float shaped, slope;
+				if (settings.mode == FractalMode::Eroded) {
+					slopeX[k] += octaveX[k];
+					slopeY[k] += octaveY[k];
+					slope = 1.0f / (1.0f + slopeX[k] * slopeX[k] + slopeY[k] * slopeY[k]);
+					shaped = octave[k] * slope;
+				}
+				else {
+					shaped = (float)shape(settings.mode, octave[k]);
+					slope = (float)shapeSlope(settings.mode, octave[k]);
+				}
+				value[start + k] += w * shaped;
+				dX[start + k] += wf * slope * octaveX[k];
+				dY[start + k] += wf * slope * octaveY[k];
+			}
+		}
+	}
+}
@@ -0,0 +1,78 @@
+// Fractal sums of Perlin noise octaves (fBm, ridged, billow and eroded)
+#pragma once
+
+#include "PerlinNoise.h"
+#include "NoiseSource.h"
+#include <memory>
+#include <vector>
+
+enum class FractalMode {
+	FBM,
+	Ridged,
+	Billow,
+	// fBm where every octave is damped by the slope accumulated so far,
+	// 1 / (1 + |d|^2): steep ground stays smooth, flat ground gets the detail,
+	// which looks like eroded terrain. d sums the x and y derivatives of the
+	// octaves in their own lattice units
+	Eroded
+};
+
+struct FractalSettings {
+	// Backend of noise() and noiseRow(); the wide and derivative variants
+	// are always classic 3D Perlin, and so is Eroded mode
+	NoiseType type;
+	FractalMode mode;
+	int octaves;
+	// Frequency multiplier between octaves
+	double lacunarity;
+	// Amplitude multiplier between octaves
+	double gain;
+	// Octaves whose combined weight can't move the output by more than this are
+	// skipped; half a quantization step keeps the quantized output unchanged
+	double epsilon;
+
+	FractalSettings() : type(NoiseType::Perlin3D), mode(FractalMode::FBM), octaves(1), lacunarity(2.0), gain(0.5), epsilon(0.5 / 65535.0) {}
+};
+
+class FractalNoise {
+	PerlinNoise pn;
+	FractalSettings settings;
+	// Backend picked by settings.type; shared so copies stay cheap
+	std::shared_ptr<const NoiseSource> source;
+	// Per-octave tables: frequency, weight (amplitude over the total amplitude)
+	// and a coordinate offset that decorrelates the octave lattices
+	std::vector<double> frequency;
+	std::vector<double> weight;
+	std::vector<double> offset;
+	int activeOctaves;
+public:
+	FractalNoise(unsigned int seed, const FractalSettings& settings = FractalSettings());
+
+	// Value in [0, 1]; a single fBm octave is exactly PerlinNoise::noise
+	double noise(double x, double y, double z) const;
+	// Fill out[i] with the fractal value at (x0 + dx * i, y, z). The row is
+	// processed in cache-sized chunks, each chunk accumulating every octave
+	// before moving on
+	void noiseRow(double y, double z, double x0, double dx, int count, float* out) const;
+	// Fill out[i] with the fractal value at (x[i], y[i], z), for points that
+	// don't lie on a row such as domain-warped coordinates. Evaluated in the
+	// same chunks as noiseRow(), through PerlinNoise::noisePoints for the 3D
+	// Perlin backend and one sample at a time for the others
+	void noisePoints(double z, const double* x, const double* y, int count, float* out) const;
+	// noise() over PerlinNoise::noiseWide, for unbounded world coordinates
+	double noiseWide(double x, double y, double z) const;
+	// noise() with derivatives, each octave's scaled by its frequency and
+	// weight. In Eroded mode the damping factors count as constants
+	NoiseSample noiseDerivative(double x, double y, double z) const;
+	NoiseSample noiseWideDerivative(double x, double y, double z) const;
+	// Rows of noiseDerivative(), without the z derivative, chunked like noiseRow()
+	void noiseDerivativeRow(double y, double z, double x0, double dx, int count, float* value, float* dX, float* dY) const;
+
+	// Octaves actually evaluated after the epsilon cut-off
+	int getActiveOctaves() const { return activeOctaves; }
+	const FractalSettings& getSettings() const { return settings; }
+	const PerlinNoise& getPerlin() const { return pn; }
+	const NoiseSource& getSource() const { return *source; }
+private:
+	NoiseSample accumulate(double x, double y, double z, bool wide) const;
+};
@@ -0,0 +1,49 @@
+// View frustum planes taken from a view * projection matrix (Gribb and
+// Hartmann), for culling boxes on the CPU before anything is submitted
+#pragma once
+
+#include "Matrix4.h"
+#include <cmath>
+
+enum class FrustumTest { Outside, Intersecting, Inside };
+
+struct Frustum {
+	// a, b, c, d with a * x + b * y + c * z + d >= 0 inside, (a, b, c) unit length:
+	// left, right, bottom, top, near and far
+	float planes[6][4];
+
+	// Row vectors and D3D clip space: -w <= x, y <= w and 0 <= z <= w
+	explicit Frustum(const Matrix4& viewProjection) {
+		const float (&m)[4][4] = viewProjection.m;
+		for (int i = 0; i < 4; i++) {
+			planes[0][i] = m[i][3] + m[i][0];
+			planes[1][i] = m[i][3] - m[i][0];
+			planes[2][i] = m[i][3] + m[i][1];
+			planes[3][i] = m[i][3] - m[i][1];
+			planes[4][i] = m[i][2];
+			planes[5][i] = m[i][3] - m[i][2];
+		}
+		for (float* p : planes) {
+			float length = sqrtf(p[0] * p[0] + p[1] * p[1] + p[2] * p[2]);
+			for (int i = 0; i < 4; i++)
+				p[i] /= length;
+		}
+	}
+
+	// Axis-aligned box against every plane: outside as soon as its corner
+	// furthest along a plane's normal is behind it, inside when the nearest
+	// corner is in front of all of them
+	FrustumTest testBox(float minX, float minY, float minZ, float maxX, float maxY, float maxZ) const {
+		FrustumTest result = FrustumTest::Inside;
+		for (const float* p : planes) {
+			float farX = p[0] >= 0.0f ? maxX : minX, nearX = p[0] >= 0.0f ? minX : maxX;
+			float farY = p[1] >= 0.0f ? maxY : minY, nearY = p[1] >= 0.0f ? minY : maxY;
+			float farZ = p[2] >= 0.0f ? maxZ : minZ, nearZ = p[2] >= 0.0f ? minZ : maxZ;
+			if (p[0] * farX + p[1] * farY + p[2] * farZ + p[3] < 0.0f)
+				return FrustumTest::Outside;
+			if (p[0] * nearX + p[1] * nearY + p[2] * nearZ + p[3] < 0.0f)
+				result = FrustumTest::Intersecting;
+		}
+		return result;
+	}
+};
@@ -0,0 +1,227 @@
+#include "GridIndices.h"
+#include <algorithm>
+#include <cmath>
+
+using namespace std;
+
+int skirtVertex(int n, int m, int r, int c) {
+	int base = (n + 1) * (m + 1);
+	if (r == 0) return base + c;
+	if (c == n) return base + n + r;
+	if (r == m) return base + n + m + (n - c);
+	return base + 2 * n + m + (m - r);
+}
+
+void lodSamples(int cells, int step, vector<int>& out) {
+	out.clear();
+	for (int i = 0; i < cells; i += step)
+		out.push_back(i);
+	out.push_back(cells);
+}
+
+void buildGridIndices(int n, int m, int step, IndexOrder order, vector<uint16_t>& out) {
+	int columns = n + 1;
+	vector<int> xs, zs;
+	lodSamples(n, step, xs);
+	lodSamples(m, step, zs);
+
+	// Border samples of this LOD in skirt order
+	vector<pair<int, int>> loop;
+	for (size_t k = 0; k < xs.size(); k++)
+		loop.push_back(make_pair(0, xs[k]));
+	for (size_t k = 1; k < zs.size(); k++)
+		loop.push_back(make_pair(zs[k], n));
+	for (size_t k = xs.size() - 1; k-- > 0;)
+		loop.push_back(make_pair(m, xs[k]));
+	for (size_t k = zs.size() - 1; k-- > 0;)
+		loop.push_back(make_pair(zs[k], 0));
+
+	if (order == IndexOrder::Strip) {
+		// Alternating top and bottom samples give the same grid triangles, with
+		// the same diagonal and winding, as the list below. Skirt quads come out
+		// split along their other diagonal, which nobody can see
+		for (size_t i = 0; i + 1 < zs.size(); i++) {
+			if (i > 0)
+				out.push_back(STRIP_RESTART);
+			for (size_t j = 0; j < xs.size(); j++) {
+				out.push_back((uint16_t)(zs[i] * columns + xs[j]));
+				out.push_back((uint16_t)(zs[i + 1] * columns + xs[j]));
+			}
+		}
+		out.push_back(STRIP_RESTART);
+		for (size_t k = 0; k < loop.size(); k++) {
+			out.push_back((uint16_t)skirtVertex(n, m, loop[k].first, loop[k].second));
+			out.push_back((uint16_t)(loop[k].first * columns + loop[k].second));
+		}
+		return;
+	}
+
+	size_t first = out.size();
+	for (size_t i = 0; i + 1 < zs.size(); i++) {
+		for (size_t j = 0; j + 1 < xs.size(); j++) {
+			uint16_t topLeft = (uint16_t)(zs[i] * columns + xs[j]);
+			uint16_t topRight = (uint16_t)(zs[i] * columns + xs[j + 1]);
+			uint16_t bottomLeft = (uint16_t)(zs[i + 1] * columns + xs[j]);
+			uint16_t bottomRight = (uint16_t)(zs[i + 1] * columns + xs[j + 1]);
+
+			out.push_back(topLeft);
+			out.push_back(bottomLeft);
+			out.push_back(topRight);
+
+			out.push_back(topRight);
+			out.push_back(bottomLeft);
+			out.push_back(bottomRight);
+		}
+	}
+
+	// Walking the border in loop order keeps the skirt triangles facing outwards
+	for (size_t k = 0; k + 1 < loop.size(); k++) {
+		uint16_t top0 = (uint16_t)(loop[k].first * columns + loop[k].second);
+		uint16_t top1 = (uint16_t)(loop[k + 1].first * columns + loop[k + 1].second);
+		uint16_t bottom0 = (uint16_t)skirtVertex(n, m, loop[k].first, loop[k].second);
+		uint16_t bottom1 = (uint16_t)skirtVertex(n, m, loop[k + 1].first, loop[k + 1].second);
+
+		out.push_back(top0);
+		out.push_back(top1);
+		out.push_back(bottom0);
+
+		out.push_back(top1);
+		out.push_back(bottom1);
+		out.push_back(bottom0);
+	}
+
+	if (order == IndexOrder::CacheOptimized)
+		optimizeVertexCache(&out[first], out.size() - first, chunkVertexCount(n, m));
+}
+
+namespace {
+
+// Vertex score of Forsyth's optimizer: recently used vertices score high, the
+// three of the last triangle a little less so they are not reused at once,
+// and vertices with few triangles left get a boost so they retire early
+float vertexScore(int cachePosition, int valence, int cacheSize) {
+	if (valence == 0)
+		return -1.0f;
+	float score = 0.0f;
+	if (cachePosition >= 0) {
+		if (cachePosition < 3)
+			score = 0.75f;
+		else
+			score = powf(1.0f - (float)(cachePosition - 3) / (cacheSize - 3), 1.5f);
+	}
+	return score + 2.0f / sqrtf((float)valence);
+}
+
+}
+
+void optimizeVertexCache(uint16_t* indices, size_t count, int vertexCount, int cacheSize) {
+	int triangleCount = (int)(count / 3);
+	if (triangleCount < 2)
+		return;
+	cacheSize = max(cacheSize, 4);
+
+	// Triangles of every vertex, as offsets into one array
+	vector<int> valence(vertexCount, 0);
+	for (size_t i = 0; i < (size_t)triangleCount * 3; i++)
+		valence[indices[i]]++;
+	vector<int> firstTriangle(vertexCount + 1, 0);
+	for (int v = 0; v < vertexCount; v++)
+		firstTriangle[v + 1] = firstTriangle[v] + valence[v];
+	vector<int> adjacency(firstTriangle[vertexCount]);
+	vector<int> fill(firstTriangle.begin(), firstTriangle.end() - 1);
+	for (int t = 0; t < triangleCount; t++)
+		for (int k = 0; k < 3; k++)
+			adjacency[fill[indices[t * 3 + k]]++] = t;
+
+	vector<int> cachePosition(vertexCount, -1);
+	vector<float> score(vertexCount);
+	for (int v = 0; v < vertexCount; v++)
+		score[v] = vertexScore(-1, valence[v], cacheSize);
+	vector<float> triangleScore(triangleCount);
+	for (int t = 0; t < triangleCount; t++)
+		triangleScore[t] = score[indices[t * 3]] + score[indices[t * 3 + 1]] + score[indices[t * 3 + 2]];
+
+	vector<char> emitted(triangleCount, 0);
+	vector<uint16_t> result;
+	result.reserve((size_t)triangleCount * 3);
+	vector<int> cache, nextCache;
+	int best = 0;
+	int scan = 0;
+	for (int done = 0; done < triangleCount; done++) {
+		if (best < 0) {
+			// Nothing in the cache touches a live triangle: take the best one left
+			float bestScore = -1.0f;
+			while (emitted[scan])
+				scan++;
+			for (int t = scan; t < triangleCount; t++) {
+				if (!emitted[t] && triangleScore[t] > bestScore) {
+					bestScore = triangleScore[t];
+					best = t;
+				}
+			}
+		}
+
+		emitted[best] = 1;
+		const uint16_t* tri = indices + (size_t)best * 3;
+		nextCache.assign(tri, tri + 3);
+		for (int k = 0; k < 3; k++) {
+			int v = tri[k];
+			result.push_back((uint16_t)v);
+			// Drop the triangle from the vertex's live list
+			int* begin = &adjacency[firstTriangle[v]];
+			int* end = begin + valence[v];
+			*find(begin, end, best) = *(end - 1);
+			valence[v]--;
+		}
+		for (int v : cache)
+			if (v != tri[0] && v != tri[1] && v != tri[2])
+				nextCache.push_back(v);
+		cache.swap(nextCache);
+
+		// Vertices pushed out of the cache lose their position score
+		for (size_t i = 0; i < cache.size(); i++) {
+			int v = cache[i];
+			cachePosition[v] = i < (size_t)cacheSize ? (int)i : -1;
+			score[v] = vertexScore(cachePosition[v], valence[v], cacheSize);
+		}
+		for (size_t i = 0; i < cache.size(); i++) {
+			int v = cache[i];
+			for (int a = firstTriangle[v]; a < firstTriangle[v] + valence[v]; a++) {
+				int t = adjacency[a];
+				triangleScore[t] = score[indices[t * 3]] + score[indices[t * 3 + 1]] + score[indices[t * 3 + 2]];
+			}
+		}
+		if (cache.size() > (size_t)cacheSize)
+			cache.resize(cacheSize);
+
+		best = -1;
+		float bestScore = -1.0f;
+		for (int v : cache) {
+			for (int a = firstTriangle[v]; a < firstTriangle[v] + valence[v]; a++) {
+				int t = adjacency[a];
+				if (triangleScore[t] > bestScore) {
+					bestScore = triangleScore[t];
+					best = t;
+				}
+			}
+		}
+	}
+	copy(result.begin(), result.end(), indices);
+}
+
+void stripToList(const uint16_t* indices, size_t count, vector<uint16_t>& out) {
+	out.clear();
+	size_t start = 0;
+	for (size_t i = 0; i <= count; i++) {
+		if (i < count && indices[i] != STRIP_RESTART)
+			continue;
+		// Odd triangles of a strip swap their first two vertices
+		for (size_t k = start; k + 2 < i; k++) {
+			bool odd = ((k - start) & 1) != 0;
+			out.push_back(indices[odd ? k + 1 : k]);
+			out.push_back(indices[odd ? k : k + 1]);
+			out.push_back(indices[k + 2]);
+		}
+		start = i + 1;
+	}
+}
@@ -0,0 +1,72 @@
+// Index patterns for one chunk of the regular grid. A chunk of n x m cells has
+// (n + 1) * (m + 1) grid vertices in row-major order followed by 2 * (n + m)
+// skirt vertices, one below each border sample in loop order (see
+// skirtVertex). A pattern depends only on the chunk size, the LOD step and the
+// order, so every chunk of the same size draws from one shared copy with
+// 16-bit indices and its own base vertex
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+enum class IndexOrder {
+	// Cells row by row, two triangles each, like the whole-map mesh
+	RowMajor,
+	// One triangle strip per row of cells and one for the skirts, separated
+	// by STRIP_RESTART
+	Strip,
+	// Triangle list reordered for the post-transform vertex cache
+	CacheOptimized
+};
+
+// Strip cut value of 16-bit index buffers
+const std::uint16_t STRIP_RESTART = 0xFFFF;
+
+// Largest chunk side, in cells, whose vertices fit 16-bit indices
+const int MAX_CHUNK_CELLS = 128;
+
+inline int chunkVertexCount(int cellsX, int cellsZ) {
+	return (cellsX + 1) * (cellsZ + 1) + 2 * (cellsX + cellsZ);
+}
+
+// Vertex below border sample (r, c). Skirt vertices follow the border: +x
+// along the first row, +z along the last column, -x along the last row and
+// -z along the first column, starting at (0, 0)
+int skirtVertex(int cellsX, int cellsZ, int r, int c);
+
+// Sample positions LOD step keeps along an axis of cells cells: every step-th
+// sample plus the last one, so partial chunks still reach their border
+void lodSamples(int cells, int step, std::vector<int>& out);
+
+// Append the grid and skirt indices of a chunk at LOD step to out
+void buildGridIndices(int cellsX, int cellsZ, int step, IndexOrder order, std::vector<std::uint16_t>& out);
+
+// Reorder the triangles of a list in place to reduce vertex cache misses
+// (Forsyth's linear-speed optimizer), keeping the winding of every triangle
+void optimizeVertexCache(std::uint16_t* indices, size_t count, int vertexCount, int cacheSize = 32);
+
+// Triangle list equivalent of strips with restarts
+void stripToList(const std::uint16_t* indices, size_t count, std::vector<std::uint16_t>& out);
+
+// Average cache misses per triangle (ACMR) of a triangle list through a FIFO
+// post-transform cache of cacheSize vertices. 0.5 is the limit for a large
+// grid, 3 means no reuse at all
+template<class Index>
+double simulateAcmr(const Index* indices, size_t count, int cacheSize = 16) {
+	if (count < 3)
+		return 0.0;
+	Index largest = 0;
+	for (size_t i = 0; i < count; i++)
+		largest = indices[i] > largest ? indices[i] : largest;
+
+	// A vertex is cached while fewer than cacheSize misses followed its own
+	std::vector<std::int64_t> loaded((size_t)largest + 1, -1);
+	std::int64_t misses = 0;
+	for (size_t i = 0; i < count; i++) {
+		std::int64_t& when = loaded[indices[i]];
+		if (when < 0 || misses - when >= cacheSize)
+			when = misses++;
+	}
+	return (double)misses / (double)(count / 3);
+}
@@ -0,0 +1,188 @@
+#include "HeightFile.h"
+#include "HeightmapView.h"
+#include <iostream>
+#include <algorithm>
+#include <cstring>
+#include <cmath>
+
+unsigned int heightFormatBytes(HeightFormat format) {
+	return format == HeightFormat::Float32 ? 4 : 2;
+}
+
+const char* heightFormatName(HeightFormat format) {
+	switch (format) {
+	case HeightFormat::UNorm16: return "unorm16";
+	case HeightFormat::Half:    return "half";
+	default:                    return "float32";
+	}
+}
+
+std::uint16_t floatToHalf(float value) {
+	std::uint32_t f;
+	memcpy(&f, &value, 4);
+	std::uint32_t sign = (f >> 16) & 0x8000;
+	std::uint32_t exponent = (f >> 23) & 0xff;
+	std::uint32_t mantissa = f & 0x7fffff;
+
+	// NaN and infinity
+	if (exponent == 0xff)
+		return (std::uint16_t)(sign | 0x7c00 | (mantissa ? 0x200 : 0));
+
+	int e = (int)exponent - 127 + 15;
+	if (e >= 31)
+		return (std::uint16_t)(sign | 0x7c00);
+
+	if (e <= 0) {
+		// Subnormal half, or zero once the value is too small
+		if (e < -10)
+			return (std::uint16_t)sign;
+		mantissa |= 0x800000;
+		int shift = 14 - e;
+		std::uint32_t half = mantissa >> shift;
+		std::uint32_t rest = mantissa & ((1u << shift) - 1);
+		std::uint32_t halfway = 1u << (shift - 1);
+		if (rest > halfway || (rest == halfway && (half & 1)))
+			half++;
+		return (std::uint16_t)(sign | half);
+	}
+
+	std::uint32_t half = sign | (std::uint32_t)e << 10 | mantissa >> 13;
+	std::uint32_t rest = mantissa & 0x1fff;
+	// A carry out of the mantissa correctly bumps the exponent
+	if (rest > 0x1000 || (rest == 0x1000 && (half & 1)))
+		half++;
+	return (std::uint16_t)half;
+}
+
+float halfToFloat(std::uint16_t half) {
+	std::uint32_t sign = (std::uint32_t)(half & 0x8000) << 16;
+	std::uint32_t exponent = (half >> 10) & 0x1f;
+	std::uint32_t mantissa = half & 0x3ff;
+	std::uint32_t f;
+
+	if (exponent == 0) {
+		if (mantissa == 0) {
+			f = sign;
+		}
+		else {
+			// Normalize the subnormal
+			exponent = 127 - 15 + 1;
+			while ((mantissa & 0x400) == 0) {
+				mantissa <<= 1;
+				exponent--;
+			}
+			f = sign | exponent << 23 | (mantissa & 0x3ff) << 13;
+		}
+	}
+	else if (exponent == 31) {
+		f = sign | 0x7f800000 | mantissa << 13;
+	}
+	else {
+		f = sign | (exponent - 15 + 127) << 23 | mantissa << 13;
+	}
+
+	float value;
+	memcpy(&value, &f, 4);
+	return value;
+}
+
+void unorm16Range(float low, float high, float& scale, float& offset) {
+	offset = low;
+	scale = high > low ? (high - low) / 65535.0f : 1.0f;
+}
+
+HeightFileWriter::HeightFileWriter() : stream_buffer(1 << 20), rowsWritten(0) {
+	memset(&header, 0, sizeof(header));
+}
+
+bool HeightFileWriter::open(const std::string& fname, HeightFormat format, int width, int height, float scale, float offset) {
+	memcpy(header.magic, HEIGHT_FILE_MAGIC, 4);
+	header.version = HEIGHT_FILE_VERSION;
+	header.format = (std::uint32_t)format;
+	header.width = (std::uint32_t)width;
+	header.height = (std::uint32_t)height;
+	header.scale = scale;
+	header.offset = offset;
+	header.reserved = 0;
+	rowsWritten = 0;
+
+	out.rdbuf()->pubsetbuf(stream_buffer.data(), stream_buffer.size());
+	out.open(fname.c_str(), std::ios::out | std::ios::binary);
+	if (!out.is_open()) {
+		std::cout << "Error. Unable to open " << fname << std::endl;
+		return false;
+	}
+	// The header and samples are written in host order, which is little
+	// endian on every platform we build for
+	out.write((const char*)&header, sizeof(header));
+	return (bool)out;
+}
+
+bool HeightFileWriter::writeRows(int count, const float* heights) {
+	if (rowsWritten + count > header.height)
+		return false;
+
+	size_t n = (size_t)count * header.width;
+	HeightFormat format = (HeightFormat)header.format;
+	if (format == HeightFormat::Float32 && header.scale == 1.0f && header.offset == 0.0f) {
+		out.write((const char*)heights, n * 4);
+	}
+	else {
+		row_buffer.resize(n * heightFormatBytes(format));
+		float inv = 1.0f / header.scale;
+		if (format == HeightFormat::UNorm16) {
+			std::uint16_t* dst = (std::uint16_t*)row_buffer.data();
+			for (size_t i = 0; i < n; i++) {
+				float code = (heights[i] - header.offset) * inv + 0.5f;
+				dst[i] = (std::uint16_t)std::min(std::max(code, 0.0f), 65535.0f);
+			}
+		}
+		else if (format == HeightFormat::Half) {
+			std::uint16_t* dst = (std::uint16_t*)row_buffer.data();
+			for (size_t i = 0; i < n; i++)
+				dst[i] = floatToHalf((heights[i] - header.offset) * inv);
+		}
+		else {
+			float* dst = (float*)row_buffer.data();
+			for (size_t i = 0; i < n; i++)
+				dst[i] = (heights[i] - header.offset) * inv;
+		}
+		out.write((const char*)row_buffer.data(), row_buffer.size());
+	}
+	rowsWritten += count;
+	return (bool)out;
+}
+
+bool HeightFileWriter::close() {
+	if (!out.is_open())
+		return false;
+	out.flush();
+	bool ok = (bool)out && rowsWritten == header.height;
+	out.close();
+	return ok;
+}
+
+bool writeHeightFile(const std::string& fname, const HeightGrid& grid, HeightFormat format) {
+	float scale = 1.0f, offset = 0.0f;
+	if (format == HeightFormat::UNorm16 && !grid.data.empty()) {
+		auto range = std::minmax_element(grid.data.begin(), grid.data.end());
+		unorm16Range(*range.first, *range.second, scale, offset);
+	}
+
+	HeightFileWriter writer;
+	if (!writer.open(fname, format, grid.width, grid.height, scale, offset))
+		return false;
+	writer.writeRows(grid.height, grid.data.data());
+	return writer.close();
+}
+
+bool readHeightFile(const std::string& fname, HeightGrid& grid) {
+	HeightmapView view;
+	if (!view.open(fname))
+		return false;
+
+	grid = HeightGrid(view.getWidth(), view.getHeight());
+	for (int z = 0; z < grid.height; z++)
+		view.decodeRow(z, grid.row(z));
+	return true;
+}
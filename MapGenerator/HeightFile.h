@@ -0,0 +1,64 @@
+// Compact height files (.hgt): a small header followed by rows of 16-bit
+// unsigned, half float or 32-bit float samples, little endian. The stored
+// value maps to a height through the header's scale and offset:
+//     height = stored * scale + offset
+// where stored is the integer code for UNorm16 and the value itself otherwise
+#pragma once
+
+#include "HeightGrid.h"
+#include <string>
+#include <fstream>
+#include <vector>
+#include <cstdint>
+
+enum class HeightFormat : std::uint32_t {
+	UNorm16 = 1,
+	Half = 2,
+	Float32 = 3
+};
+
+struct HeightFileHeader {
+	char magic[4];
+	std::uint32_t version;
+	std::uint32_t format;
+	std::uint32_t width;
+	std::uint32_t height;
+	float scale;
+	float offset;
+	std::uint32_t reserved;
+};
+
+constexpr char HEIGHT_FILE_MAGIC[4] = { 'M', 'G', 'H', 'T' };
+constexpr std::uint32_t HEIGHT_FILE_VERSION = 1;
+
+unsigned int heightFormatBytes(HeightFormat format);
+const char* heightFormatName(HeightFormat format);
+
+// IEEE 754 binary16 conversion, round to nearest even
+std::uint16_t floatToHalf(float value);
+float halfToFloat(std::uint16_t half);
+
+// Scale and offset for storing heights in [low, high] at full 16-bit precision
+void unorm16Range(float low, float high, float& scale, float& offset);
+
+// Streams rows of float heights into a height file, quantizing on the way
+class HeightFileWriter {
+	std::ofstream out;
+	std::vector<char> stream_buffer;
+	std::vector<unsigned char> row_buffer;
+	HeightFileHeader header;
+	unsigned int rowsWritten;
+public:
+	HeightFileWriter();
+	// UNorm16 needs a meaningful scale/offset (see unorm16Range); the float
+	// formats are normally written with scale 1 and offset 0
+	bool open(const std::string& fname, HeightFormat format, int width, int height, float scale = 1.0f, float offset = 0.0f);
+	bool writeRows(int count, const float* heights);
+	// False if the file is incomplete or a write failed
+	bool close();
+};
+
+// Write a whole grid; UNorm16 fits its scale/offset to the grid's range
+bool writeHeightFile(const std::string& fname, const HeightGrid& grid, HeightFormat format);
+// Read a whole file into a grid of decoded heights
+bool readHeightFile(const std::string& fname, HeightGrid& grid);
@@ -0,0 +1,19 @@
+// Row-major grid of height samples
+#pragma once
+
+#include <vector>
+#include <cstddef>
+
+struct HeightGrid {
+	int width;
+	int height;
+	std::vector<float> data;
+
+	HeightGrid() : width(0), height(0) {}
+	HeightGrid(int _width, int _height) : width(_width), height(_height), data((size_t)_width * _height) {}
+
+	float* row(int z) { return &data[(size_t)z * width]; }
+	const float* row(int z) const { return &data[(size_t)z * width]; }
+	float& at(int x, int z) { return data[(size_t)z * width + x]; }
+	float at(int x, int z) const { return data[(size_t)z * width + x]; }
+};
@@ -0,0 +1,128 @@
+#include "HeightmapGenerator.h"
+#include <algorithm>
+
+HeightmapGenerator::HeightmapGenerator(const HeightmapSettings& _settings)
+	: settings(_settings), fractal(_settings.seed, _settings.fractal), warp(_settings.seed + 1, _settings.warp) {
+}
+
+void HeightmapGenerator::fillTile(float* dst, size_t stride, int width, int height, int x0, int z0, int w, int h) const {
+	if (warp.enabled()) {
+		fillWarpedTile(dst, stride, width, height, x0, z0, w, h);
+		return;
+	}
+	double dx = settings.frequency / width;
+	double dy = settings.frequency / height;
+
+	for (int i = 0; i < h; i++)
+		fractal.noiseRow(dy * (z0 + i), settings.z, dx * x0, dx, w, dst + i * stride);
+}
+
+void HeightmapGenerator::fillWarpedTile(float* dst, size_t stride, int width, int height, int x0, int z0, int w, int h) const {
+	double dx = settings.frequency / width;
+	double dy = settings.frequency / height;
+
+	WarpField field;
+	warp.field(dx, dy, settings.z, x0, z0, w, h, field);
+	std::vector<double> x(w), y(w);
+	for (int i = 0; i < h; i++) {
+		warp.warpRow(field, dx, dy, x0, z0 + i, w, x.data(), y.data());
+		fractal.noisePoints(settings.z, x.data(), y.data(), w, dst + i * stride);
+	}
+}
+
+void HeightmapGenerator::generateTile(HeightGrid& grid, int x0, int z0, int w, int h) const {
+	fillTile(&grid.at(x0, z0), grid.width, grid.width, grid.height, x0, z0, w, h);
+}
+
+// Fill rows [z0, z0 + rows) of a width x height image into dst, one tile at a time
+void HeightmapGenerator::fillBand(float* dst, int width, int height, int z0, int rows, ThreadPool& pool) const {
+	int tile = settings.tileSize;
+	int tilesX = (width + tile - 1) / tile;
+	int tilesZ = (rows + tile - 1) / tile;
+
+	pool.parallelFor(0, tilesX * tilesZ, [&](int t) {
+		int tx = (t % tilesX) * tile;
+		int tz = (t / tilesX) * tile;
+		fillTile(dst + (size_t)tz * width + tx, width, width, height, tx, z0 + tz,
+			std::min(tile, width - tx), std::min(tile, rows - tz));
+	});
+}
+
+void HeightmapGenerator::generate(HeightGrid& grid, ThreadPool& pool) const {
+	fillBand(grid.data.data(), grid.width, grid.height, 0, grid.height, pool);
+}
+
+HeightRowSource HeightmapGenerator::rowSource(int width, int height) const {
+	return [this, width, height](int z, float* out) { fillTile(out, width, width, height, 0, z, width, 1); };
+}
+
+SlopeRowSource HeightmapGenerator::slopeSource(int width, int height) const {
+	return [this, width, height](int z, float* out, float* slopeX, float* slopeZ) {
+		double dx = settings.frequency / width;
+		double dy = settings.frequency / height;
+		if (warp.enabled()) {
+			// Heights exactly as fillWarpedTile() makes them, slopes of the
+			// fractal at the same warped points
+			WarpField field;
+			warp.field(dx, dy, settings.z, 0, z, width, 1, field);
+			std::vector<double> x(width), y(width);
+			warp.warpRow(field, dx, dy, 0, z, width, x.data(), y.data());
+			fractal.noisePoints(settings.z, x.data(), y.data(), width, out);
+			for (int i = 0; i < width; i++) {
+				NoiseSample sample = fractal.noiseDerivative(x[i], y[i], settings.z);
+				slopeX[i] = (float)sample.dx;
+				slopeZ[i] = (float)sample.dy;
+			}
+		}
+		else
+			fractal.noiseDerivativeRow(dy * z, settings.z, 0.0, dx, width, out, slopeX, slopeZ);
+		// Per noise unit to per sample
+		for (int x = 0; x < width; x++) {
+			slopeX[x] *= (float)dx;
+			slopeZ[x] *= (float)dy;
+		}
+	};
+}
+
+HeightGrid HeightmapGenerator::generate(int width, int height) const {
+	HeightGrid grid(width, height);
+	generate(grid, ThreadPool::shared());
+	return grid;
+}
+
+bool HeightmapGenerator::generateToFile(const std::string& fname, int width, int height, HeightFormat format, ThreadPool& pool) const {
+	float scale = 1.0f, offset = 0.0f;
+	if (format == HeightFormat::UNorm16)
+		unorm16Range(0.0f, 1.0f, scale, offset);
+
+	HeightFileWriter writer;
+	if (!writer.open(fname, format, width, height, scale, offset))
+		return false;
+
+	// A band is one row of tiles, enough to keep every worker busy
+	int bandRows = settings.tileSize;
+	std::vector<float> band((size_t)width * bandRows);
+	for (int z0 = 0; z0 < height; z0 += bandRows) {
+		int rows = std::min(bandRows, height - z0);
+		fillBand(band.data(), width, height, z0, rows, pool);
+		if (!writer.writeRows(rows, band.data()))
+			break;
+	}
+	return writer.close();
+}
+
+bool HeightmapGenerator::generateToFile(const std::string& fname, int width, int height, HeightFormat format) const {
+	return generateToFile(fname, width, height, format, ThreadPool::shared());
+}
+
+void generateThumbnails(const HeightmapSettings& settings, const std::vector<unsigned int>& seeds, int size,
+	std::vector<HeightGrid>& thumbnails, ThreadPool& pool) {
+	thumbnails.resize(seeds.size());
+	pool.parallelFor(0, (int)seeds.size(), [&](int i) {
+		HeightmapSettings seeded = settings;
+		seeded.seed = seeds[i];
+		HeightmapGenerator generator(seeded);
+		thumbnails[i] = HeightGrid(size, size);
+		generator.generateTile(thumbnails[i], 0, 0, size, size);
+	});
+}
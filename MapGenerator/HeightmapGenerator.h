@@ -0,0 +1,74 @@
+// Generates a heightmap from fractal Perlin noise, tile by tile over a thread pool
+#pragma once
+
+#include "FractalNoise.h"
+#include "DomainWarp.h"
+#include "HeightGrid.h"
+#include "ThreadPool.h"
+#include "MeshBuilder.h"
+#include "HeightFile.h"
+#include <string>
+#include <vector>
+
+struct HeightmapSettings {
+	unsigned int seed;
+	// Noise periods of the first octave across the whole image
+	double frequency;
+	// Slice through the 3D noise, for 2D images z can have any value
+	double z;
+	// Tiles are the unit of work handed to the pool
+	int tileSize;
+	FractalSettings fractal;
+	// Off by default; the warp noise is seeded with seed + 1
+	WarpSettings warp;
+
+	HeightmapSettings() : seed(237), frequency(10.0), z(0.8), tileSize(128) {}
+};
+
+class HeightmapGenerator {
+	HeightmapSettings settings;
+	FractalNoise fractal;
+	DomainWarp warp;
+public:
+	HeightmapGenerator(const HeightmapSettings& settings = HeightmapSettings());
+
+	// Fill the whole grid with values in [0, 1]. Every sample only depends on
+	// its own coordinates, so the result is bit-identical for any pool size
+	void generate(HeightGrid& grid, ThreadPool& pool) const;
+	HeightGrid generate(int width, int height) const;
+	// Fill the w x h tile at (x0, z0) of grid
+	void generateTile(HeightGrid& grid, int x0, int z0, int w, int h) const;
+	// Generate a width x height map straight into a height file, one band of
+	// tile rows at a time, so only a band is ever held in memory. Values are
+	// in [0, 1], which UNorm16 stores with a 1 / 65535 step
+	bool generateToFile(const std::string& fname, int width, int height, HeightFormat format, ThreadPool& pool) const;
+	bool generateToFile(const std::string& fname, int width, int height, HeightFormat format) const;
+	// Rows of a width x height map computed on request, for building meshes
+	// without holding the map. The generator must outlive the source. With
+	// the domain warp on, every row builds its own warp field (two rows of
+	// nodes for one row of samples), which costs about as much as the row
+	// itself; generate() shares a field across a whole tile
+	HeightRowSource rowSource(int width, int height) const;
+	// Same with the analytic derivatives of every sample, for exact normals.
+	// Heights match rowSource() with or without the domain warp, but the
+	// slopes are the fractal's at the warped points and leave out the warp's
+	// own stretching, so warped normals are approximate
+	SlopeRowSource slopeSource(int width, int height) const;
+
+	const HeightmapSettings& getSettings() const { return settings; }
+	const FractalNoise& getNoise() const { return fractal; }
+private:
+	// Fill the w x h tile at (x0, z0) of a width x height image; dst points at
+	// the tile's first sample and rows are stride floats apart
+	void fillTile(float* dst, size_t stride, int width, int height, int x0, int z0, int w, int h) const;
+	// fillTile() through the domain warp: one warp field for the tile, then
+	// every row at its warped points
+	void fillWarpedTile(float* dst, size_t stride, int width, int height, int x0, int z0, int w, int h) const;
+	void fillBand(float* dst, int width, int height, int z0, int rows, ThreadPool& pool) const;
+};
+
+// Previews for searching seed space: thumbnails[i] is the size x size map of
+// settings with the seed seeds[i]. Every seed is one task on the pool and
+// is generated on a single thread
+void generateThumbnails(const HeightmapSettings& settings, const std::vector<unsigned int>& seeds, int size,
+	std::vector<HeightGrid>& thumbnails, ThreadPool& pool);
@@ -0,0 +1,159 @@
+#include "HeightmapView.h"
+#include "HeightFile.h"
+#include "pnm.h"
+#include <iostream>
+#include <cstring>
+
+HeightmapView::HeightmapView()
+	: samples(nullptr), width(0), height(0), stride(0), encoding(HeightEncoding::Gray8), scale(0.0f), offset(0.0f) {
+}
+
+HeightmapView::HeightmapView(const std::string& fname) : HeightmapView() {
+	open(fname);
+}
+
+bool HeightmapView::open(const std::string& fname) {
+	samples = nullptr;
+	if (!file.open(fname)) {
+		std::cout << "Error. Unable to map " << fname << std::endl;
+		return false;
+	}
+
+	if (file.size() >= 4 && memcmp(file.data(), HEIGHT_FILE_MAGIC, 4) == 0)
+		return openHeightFile(fname);
+
+	pnm_header hdr;
+	std::uint64_t dataOffset;
+	if (!pnm_parse_header(file.data(), file.size(), hdr, dataOffset)) {
+		std::cout << "Error. " << fname << " is not a complete binary PPM/PGM file" << std::endl;
+		file.close();
+		return false;
+	}
+
+	width = (int)hdr.width;
+	height = (int)hdr.height;
+	stride = (int)(hdr.channels * hdr.bytes_per_sample());
+	if (hdr.bytes_per_sample() == 2) {
+		encoding = HeightEncoding::Gray16;
+		scale = 1.0f / hdr.max_col_val;
+	}
+	else if (hdr.channels == 3) {
+		encoding = HeightEncoding::RGB24;
+		scale = 1.0f / (256.0f * 256.0f * 256.0f);
+	}
+	else {
+		encoding = HeightEncoding::Gray8;
+		scale = 1.0f / hdr.max_col_val;
+	}
+	offset = 0.0f;
+	samples = file.data() + dataOffset;
+	return true;
+}
+
+bool HeightmapView::openHeightFile(const std::string& fname) {
+	HeightFileHeader header;
+	if (file.size() < sizeof(header)) {
+		std::cout << "Error. " << fname << " has a truncated header" << std::endl;
+		file.close();
+		return false;
+	}
+	memcpy(&header, file.data(), sizeof(header));
+
+	HeightFormat format = (HeightFormat)header.format;
+	if (header.version != HEIGHT_FILE_VERSION ||
+		(format != HeightFormat::UNorm16 && format != HeightFormat::Half && format != HeightFormat::Float32) ||
+		file.size() < sizeof(header) + (std::uint64_t)header.width * header.height * heightFormatBytes(format)) {
+		std::cout << "Error. " << fname << " is not a complete height file" << std::endl;
+		file.close();
+		return false;
+	}
+
+	width = (int)header.width;
+	height = (int)header.height;
+	stride = (int)heightFormatBytes(format);
+	encoding = format == HeightFormat::UNorm16 ? HeightEncoding::UNorm16 :
+		format == HeightFormat::Half ? HeightEncoding::Half : HeightEncoding::Float32;
+	scale = header.scale;
+	offset = header.offset;
+	samples = file.data() + sizeof(header);
+	return true;
+}
+
+bool HeightmapView::openRaw(const std::string& fname, int _width, int _height) {
+	samples = nullptr;
+	if (!file.open(fname)) {
+		std::cout << "Error. Unable to map " << fname << std::endl;
+		return false;
+	}
+	if (file.size() < (std::uint64_t)_width * _height * 2) {
+		std::cout << "Error. " << fname << " is smaller than " << _width << "x" << _height << " 16-bit samples" << std::endl;
+		file.close();
+		return false;
+	}
+
+	width = _width;
+	height = _height;
+	stride = 2;
+	encoding = HeightEncoding::UNorm16;
+	scale = 1.0f / 65535.0f;
+	offset = 0.0f;
+	samples = file.data();
+	return true;
+}
+
+// Stored value of one sample, before scale and offset
+static inline float decode(HeightEncoding encoding, const unsigned char* s) {
+	switch (encoding) {
+	case HeightEncoding::RGB24:
+		return (float)(s[2] | s[1] << 8 | s[0] << 16);
+	case HeightEncoding::Gray16:
+		return (float)(s[0] << 8 | s[1]);
+	case HeightEncoding::UNorm16:
+		return (float)(s[0] | s[1] << 8);
+	case HeightEncoding::Half:
+		return halfToFloat((std::uint16_t)(s[0] | s[1] << 8));
+	case HeightEncoding::Float32: {
+		float f;
+		memcpy(&f, s, 4);
+		return f;
+	}
+	default:
+		return (float)s[0];
+	}
+}
+
+float HeightmapView::sample(int x, int z) const {
+	const unsigned char* s = samples + ((size_t)z * width + x) * stride;
+	return decode(encoding, s) * scale + offset;
+}
+
+void HeightmapView::decodeRow(int z, float* out) const {
+	const unsigned char* s = samples + (size_t)z * width * stride;
+	// Hoist the encoding switch out of the loop
+	switch (encoding) {
+	case HeightEncoding::RGB24:
+		for (int x = 0; x < width; x++, s += stride)
+			out[x] = decode(HeightEncoding::RGB24, s) * scale + offset;
+		break;
+	case HeightEncoding::Gray16:
+		for (int x = 0; x < width; x++, s += stride)
+			out[x] = decode(HeightEncoding::Gray16, s) * scale + offset;
+		break;
+	case HeightEncoding::UNorm16:
+		for (int x = 0; x < width; x++, s += stride)
+			out[x] = decode(HeightEncoding::UNorm16, s) * scale + offset;
+		break;
+	case HeightEncoding::Half:
+		for (int x = 0; x < width; x++, s += stride)
+			out[x] = decode(HeightEncoding::Half, s) * scale + offset;
+		break;
+	case HeightEncoding::Float32:
+		for (int x = 0; x < width; x++, s += stride)
+			out[x] = decode(HeightEncoding::Float32, s) * scale + offset;
+		break;
+	default:
+		for (int x = 0; x < width; x++, s += stride)
+			out[x] = decode(HeightEncoding::Gray8, s) * scale + offset;
+		break;
+	}
+}
@@ -0,0 +1,54 @@
+// Read-only, zero-copy view of a heightmap file (.hgt height file, PPM/PGM or
+// raw). The file is memory mapped and heights are decoded in place on access,
+// so opening a map costs no copy and pages are only brought in when they are read
+#pragma once
+
+#include "MappedFile.h"
+#include <string>
+
+// How heights are stored in the mapped file
+enum class HeightEncoding {
+	// P6 8-bit: b | g << 8 | r << 16 as a 24-bit integer
+	RGB24,
+	// P5 8-bit, or the first channel of P6 16-bit
+	Gray8,
+	Gray16,
+	// Height files, and headerless 16-bit little endian samples
+	UNorm16,
+	Half,
+	Float32
+};
+
+class HeightmapView {
+	MappedFile file;
+	const unsigned char* samples;
+	int width;
+	int height;
+	// Distance in bytes between horizontally adjacent samples
+	int stride;
+	HeightEncoding encoding;
+	// height = stored * scale + offset
+	float scale;
+	float offset;
+
+	bool openHeightFile(const std::string& fname);
+public:
+	HeightmapView();
+	HeightmapView(const std::string& fname);
+
+	// Map a height file or a binary PPM/PGM file (P5 or P6, 8 or 16 bits)
+	bool open(const std::string& fname);
+	// Map a headerless file of width x height 16-bit little endian samples
+	bool openRaw(const std::string& fname, int width, int height);
+
+	bool isOpen() const { return samples != nullptr; }
+	int getWidth() const { return width; }
+	int getHeight() const { return height; }
+	HeightEncoding getEncoding() const { return encoding; }
+
+	// Height of the sample at (x, z), which must be inside the map. Image
+	// files give [0, 1], height files whatever their scale and offset say
+	float sample(int x, int z) const;
+	// Decode the whole row z into out[0 .. width)
+	void decodeRow(int z, float* out) const;
+};
@@ -0,0 +1,26 @@
+// Read-only memory mapping of a whole file
+#pragma once
+
+#include <string>
+#include <cstdint>
+
+class MappedFile {
+	const unsigned char* bytes;
+	std::uint64_t length;
+#ifdef _WIN32
+	void* file;
+	void* mapping;
+#endif
+public:
+	MappedFile();
+	~MappedFile();
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+
+	bool open(const std::string& fname);
+	void close();
+
+	bool isOpen() const { return bytes != nullptr; }
+	const unsigned char* data() const { return bytes; }
+	std::uint64_t size() const { return length; }
+};
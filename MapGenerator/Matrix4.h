@@ -0,0 +1,69 @@
+// Row-major 4x4 matrix for row vectors (v * M), built like the DirectXMath
+// calls the viewer makes, so CPU code can reproduce its transforms without
+// the DirectX headers
+#pragma once
+
+#include "Vertex.h"
+#include <cmath>
+
+struct Matrix4 {
+	float m[4][4];
+
+	static Matrix4 identity() {
+		Matrix4 r = {};
+		r.m[0][0] = r.m[1][1] = r.m[2][2] = r.m[3][3] = 1.0f;
+		return r;
+	}
+
+	// XMMatrixLookAtLH
+	static Matrix4 lookAtLH(const Float3& eye, const Float3& at, const Float3& up) {
+		Float3 zAxis = normalize(Float3(at.x - eye.x, at.y - eye.y, at.z - eye.z));
+		Float3 xAxis = normalize(cross(up, zAxis));
+		Float3 yAxis = cross(zAxis, xAxis);
+		Matrix4 r = {};
+		r.m[0][0] = xAxis.x; r.m[0][1] = yAxis.x; r.m[0][2] = zAxis.x;
+		r.m[1][0] = xAxis.y; r.m[1][1] = yAxis.y; r.m[1][2] = zAxis.y;
+		r.m[2][0] = xAxis.z; r.m[2][1] = yAxis.z; r.m[2][2] = zAxis.z;
+		r.m[3][0] = -dot(xAxis, eye);
+		r.m[3][1] = -dot(yAxis, eye);
+		r.m[3][2] = -dot(zAxis, eye);
+		r.m[3][3] = 1.0f;
+		return r;
+	}
+
+	// XMMatrixPerspectiveFovLH: depth 0 at nearZ and 1 at farZ
+	static Matrix4 perspectiveFovLH(float fovY, float aspect, float nearZ, float farZ) {
+		float h = 1.0f / tanf(0.5f * fovY);
+		float range = farZ / (farZ - nearZ);
+		Matrix4 r = {};
+		r.m[0][0] = h / aspect;
+		r.m[1][1] = h;
+		r.m[2][2] = range;
+		r.m[2][3] = 1.0f;
+		r.m[3][2] = -range * nearZ;
+		return r;
+	}
+
+	Matrix4 operator*(const Matrix4& b) const {
+		Matrix4 r;
+		for (int i = 0; i < 4; i++)
+			for (int j = 0; j < 4; j++)
+				r.m[i][j] = m[i][0] * b.m[0][j] + m[i][1] * b.m[1][j] + m[i][2] * b.m[2][j] + m[i][3] * b.m[3][j];
+		return r;
+	}
+
+	// (x, y, z, w) * M
+	void transform(float x, float y, float z, float w, float out[4]) const {
+		for (int j = 0; j < 4; j++)
+			out[j] = x * m[0][j] + y * m[1][j] + z * m[2][j] + w * m[3][j];
+	}
+private:
+	static float dot(const Float3& a, const Float3& b) { return a.x * b.x + a.y * b.y + a.z * b.z; }
+	static Float3 cross(const Float3& a, const Float3& b) {
+		return Float3(a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x);
+	}
+	static Float3 normalize(const Float3& v) {
+		float length = sqrtf(dot(v, v));
+		return Float3(v.x / length, v.y / length, v.z / length);
+	}
+};
@@ -0,0 +1,157 @@
+#include "MeshBuilder.h"
+#include "NormalPass.h"
+#include <algorithm>
+
+MeshBuilder::MeshBuilder(int _width, int _height, const HeightRowSource& _source, const MeshSettings& _settings)
+	: width(_width), height(_height), source(_source), settings(_settings) {
+}
+
+MeshBuilder::MeshBuilder(int _width, int _height, const SlopeRowSource& _slopes, const MeshSettings& _settings)
+	: width(_width), height(_height), slopes(_slopes), settings(_settings) {
+}
+
+HeightRowSource gridRows(const HeightGrid& grid) {
+	return [&grid](int z, float* out) { std::copy(grid.row(z), grid.row(z) + grid.width, out); };
+}
+
+float MeshBuilder::spacing() const {
+	int longest = std::max(width, height);
+	return longest > 1 ? settings.extent / (longest - 1) : 0.0f;
+}
+
+void MeshBuilder::buildBand(int z0, int z1, const Output& output) const {
+	if (slopes) {
+		buildSlopeBand(z0, z1, output);
+		return;
+	}
+	float step = spacing();
+
+	// World heights of rows z0 - 1 .. z1, clamped to the map
+	int first = std::max(z0 - 1, 0);
+	int last = std::min(z1, height - 1);
+	std::vector<float> rows((size_t)width * (last - first + 1));
+	for (int z = first; z <= last; z++) {
+		float* row = &rows[(size_t)(z - first) * width];
+		source(z, row);
+		for (int x = 0; x < width; x++)
+			row[x] = row[x] * settings.heightScale + settings.heightOffset;
+	}
+
+	std::vector<float> nx(width), ny(width), nz(width);
+	for (int z = z0; z < z1; z++) {
+		int zp = std::max(z - 1, 0), zn = std::min(z + 1, height - 1);
+		const float* prev = &rows[(size_t)(zp - first) * width];
+		const float* mid = &rows[(size_t)(z - first) * width];
+		const float* next = &rows[(size_t)(zn - first) * width];
+		float invDz = zn > zp ? 1.0f / (step * (zn - zp)) : 0.0f;
+		computeNormalRow(prev, mid, next, width, step, invDz, nx.data(), ny.data(), nz.data());
+
+		writeRow(z, mid, nx.data(), ny.data(), nz.data(), output);
+	}
+}
+
+void MeshBuilder::buildSlopeBand(int z0, int z1, const Output& output) const {
+	float step = spacing();
+	float scale = step > 0.0f ? settings.heightScale / step : 0.0f;
+	std::vector<float> row(width), slopeX(width), slopeZ(width);
+	std::vector<float> nx(width), ny(width), nz(width);
+	for (int z = z0; z < z1; z++) {
+		slopes(z, row.data(), slopeX.data(), slopeZ.data());
+		for (int x = 0; x < width; x++)
+			row[x] = row[x] * settings.heightScale + settings.heightOffset;
+		slopeNormalRow(slopeX.data(), slopeZ.data(), width, scale, nx.data(), ny.data(), nz.data());
+		writeRow(z, row.data(), nx.data(), ny.data(), nz.data(), output);
+	}
+}
+
+void MeshBuilder::writeRow(int z, const float* heights, const float* nx, const float* ny, const float* nz, const Output& output) const {
+	float step = spacing();
+	float originX = -0.5f * step * (width - 1);
+	float originZ = -0.5f * step * (height - 1);
+
+	float pz = originZ + step * z;
+	size_t v = (size_t)z * width;
+	float* p = output.positions + v * output.stride;
+	for (int x = 0; x < width; x++, p += output.stride) {
+		p[0] = originX + step * x;
+		p[1] = heights[x];
+		p[2] = pz;
+	}
+
+	if (output.packed) {
+		std::uint32_t* n = output.packed + v;
+		for (int x = 0; x < width; x++)
+			n[x] = packOctahedral(nx[x], ny[x], nz[x]);
+	}
+	else {
+		float* n = output.normals + v * output.stride;
+		for (int x = 0; x < width; x++, n += output.stride) {
+			n[0] = nx[x];
+			n[1] = ny[x];
+			n[2] = nz[x];
+		}
+	}
+}
+
+void MeshBuilder::buildVertices(const Output& output, ThreadPool& pool) const {
+	int band = std::max(1, settings.bandRows);
+	int bands = (height + band - 1) / band;
+	pool.parallelFor(0, bands, [&](int b) {
+		buildBand(b * band, std::min(height, (b + 1) * band), output);
+	});
+}
+
+void MeshBuilder::buildInterleaved(std::vector<Vertex>& vertices, ThreadPool& pool) const {
+	vertices.resize(vertexCount());
+	if (vertices.empty())
+		return;
+	Output output = { &vertices[0].Position.x, &vertices[0].Normal.x, sizeof(Vertex) / sizeof(float), nullptr };
+	buildVertices(output, pool);
+}
+
+void MeshBuilder::buildStreams(std::vector<float>& positions, std::vector<float>& normals, ThreadPool& pool) const {
+	positions.resize(vertexCount() * 3);
+	normals.resize(vertexCount() * 3);
+	if (positions.empty())
+		return;
+	Output output = { positions.data(), normals.data(), 3, nullptr };
+	buildVertices(output, pool);
+}
+
+void MeshBuilder::buildStreams(std::vector<float>& positions, std::vector<std::uint32_t>& normals, ThreadPool& pool) const {
+	positions.resize(vertexCount() * 3);
+	normals.resize(vertexCount());
+	if (positions.empty())
+		return;
+	Output output = { positions.data(), nullptr, 3, normals.data() };
+	buildVertices(output, pool);
+}
+
+void MeshBuilder::buildIndices(std::vector<unsigned int>& indices, ThreadPool& pool) const {
+	indices.resize(indexCount());
+	if (indices.empty())
+		return;
+
+	int band = std::max(1, settings.bandRows);
+	int bands = (height - 1 + band - 1) / band;
+	pool.parallelFor(0, bands, [&](int b) {
+		int z1 = std::min(height - 1, (b + 1) * band);
+		for (int i = b * band; i < z1; i++) {
+			size_t index = (size_t)6 * i * (width - 1);
+			for (int j = 0; j < width - 1; j++) {
+				unsigned int topLeft = (unsigned int)i * width + j;
+				unsigned int topRight = topLeft + 1;
+				unsigned int bottomLeft = (unsigned int)(i + 1) * width + j;
+				unsigned int bottomRight = bottomLeft + 1;
+
+				indices[index++] = topLeft;
+				indices[index++] = bottomLeft;
+				indices[index++] = topRight;
+
+				indices[index++] = topRight;
+				indices[index++] = bottomLeft;
+				indices[index++] = bottomRight;
+			}
+		}
+	});
+}
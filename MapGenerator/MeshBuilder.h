@@ -0,0 +1,75 @@
+// Builds the regular grid mesh of a heightmap, in parallel over bands of rows.
+// Buffers are sized exactly (one vertex per sample), maps need not be square,
+// and vertices come out either interleaved as Vertex or as separate position
+// and normal streams. Heights are decoded once per band and normals come from
+// the vectorized normal pass, normalized, with clamped edges
+#pragma once
+
+#include "Vertex.h"
+#include "ThreadPool.h"
+#include "HeightGrid.h"
+#include <vector>
+#include <functional>
+#include <cstdint>
+
+// Decodes row z of the height source into out[0 .. width), values in [0, 1]
+typedef std::function<void(int z, float* out)> HeightRowSource;
+
+// Row z like HeightRowSource, plus the exact derivative of every value per
+// sample step along x (slopeX) and z (slopeZ)
+typedef std::function<void(int z, float* out, float* slopeX, float* slopeZ)> SlopeRowSource;
+
+// Rows of an in-memory grid; the grid must outlive the source
+HeightRowSource gridRows(const HeightGrid& grid);
+
+struct MeshSettings {
+	// World size of the longer side of the map; the mesh is centred on the origin
+	float extent;
+	// World height = value * heightScale + heightOffset
+	float heightScale;
+	float heightOffset;
+	// Rows handed to a task at once
+	int bandRows;
+
+	MeshSettings() : extent(800.0f), heightScale(80.0f), heightOffset(-40.0f), bandRows(32) {}
+};
+
+class MeshBuilder {
+	int width;
+	int height;
+	HeightRowSource source;
+	SlopeRowSource slopes;
+	MeshSettings settings;
+public:
+	MeshBuilder(int width, int height, const HeightRowSource& source, const MeshSettings& settings = MeshSettings());
+	// Normals from the source's derivatives: exact, and every row is decoded
+	// once instead of together with its neighbours
+	MeshBuilder(int width, int height, const SlopeRowSource& source, const MeshSettings& settings = MeshSettings());
+
+	size_t vertexCount() const { return (size_t)width * height; }
+	size_t indexCount() const { return width < 2 || height < 2 ? 0 : (size_t)6 * (width - 1) * (height - 1); }
+	// Distance between neighbouring samples in world units
+	float spacing() const;
+
+	void buildInterleaved(std::vector<Vertex>& vertices, ThreadPool& pool) const;
+	// positions and normals get 3 floats per vertex each
+	void buildStreams(std::vector<float>& positions, std::vector<float>& normals, ThreadPool& pool) const;
+	// Same with octahedral-packed normals, 4 bytes per vertex (see packOctahedral)
+	void buildStreams(std::vector<float>& positions, std::vector<std::uint32_t>& normals, ThreadPool& pool) const;
+	void buildIndices(std::vector<unsigned int>& indices, ThreadPool& pool) const;
+private:
+	// Where vertex components go; consecutive vertices are stride floats apart.
+	// packed replaces normals when it is set
+	struct Output {
+		float* positions;
+		float* normals;
+		size_t stride;
+		std::uint32_t* packed;
+	};
+	// Write vertices of rows [z0, z1)
+	void buildBand(int z0, int z1, const Output& output) const;
+	void buildSlopeBand(int z0, int z1, const Output& output) const;
+	// Write row z from its world heights and normals
+	void writeRow(int z, const float* heights, const float* nx, const float* ny, const float* nz, const Output& output) const;
+	void buildVertices(const Output& output, ThreadPool& pool) const;
+};
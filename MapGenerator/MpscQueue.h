@@ -0,0 +1,54 @@
+// Unbounded lock-free queue for many producers and one consumer (Vyukov's
+// intrusive MPSC list). Producers never wait on each other or on the consumer:
+// a push is one atomic exchange. A pop can miss an element whose push is half
+// done and will see it on the next call
+#pragma once
+
+#include <atomic>
+#include <utility>
+
+template<class T>
+class MpscQueue {
+	struct Node {
+		std::atomic<Node*> next;
+		T value;
+		Node() : next(nullptr) {}
+	};
+	// Producers append at head; the consumer owns tail, a node whose value has
+	// already been taken
+	std::atomic<Node*> head;
+	Node* tail;
+public:
+	MpscQueue() {
+		Node* stub = new Node();
+		head.store(stub);
+		tail = stub;
+	}
+	~MpscQueue() {
+		T value;
+		while (pop(value)) {
+		}
+		delete tail;
+	}
+	MpscQueue(const MpscQueue&) = delete;
+	MpscQueue& operator=(const MpscQueue&) = delete;
+
+	// Any thread
+	void push(T value) {
+		Node* node = new Node();
+		node->value = std::move(value);
+		Node* prev = head.exchange(node, std::memory_order_acq_rel);
+		prev->next.store(node, std::memory_order_release);
+	}
+
+	// Consumer thread only; false when nothing is ready
+	bool pop(T& value) {
+		Node* next = tail->next.load(std::memory_order_acquire);
+		if (!next)
+			return false;
+		value = std::move(next->value);
+		delete tail;
+		tail = next;
+		return true;
+	}
+};
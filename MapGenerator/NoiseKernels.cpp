@@ -0,0 +1,737 @@
+#include "NoiseKernels.h"
+#include <cmath>
+#include <algorithm>
+#include <cstdint>
+
+// Everything that only depends on y and z is computed once per row. Along a
+// row the lattice y and z are fixed, so the four hashes of the cube corners
+// at lattice x = L only depend on L; they are looked up once per lattice
+// column and packed as nibbles (y0z0, y1z0, y0z1, y1z1) into hashes[L & 255].
+// Real is the precision of the kernels that use it
+template <class Real>
+struct RowSetup {
+	Real y, z;
+	Real v, w;
+	alignas(32) int hashes[256];
+};
+
+template <class Real>
+static inline Real fade(Real t) {
+	return t * t * t * (t * (t * 6 - 15) + 10);
+}
+
+template <class Real>
+static inline Real lerp(Real t, Real a, Real b) {
+	return a + t * (b - a);
+}
+
+template <class Real>
+static inline Real grad(int hash, Real x, Real y, Real z) {
+	int h = hash & 15;
+	Real u = h < 8 ? x : y,
+		v = h < 4 ? y : h == 12 || h == 14 ? x : z;
+	return ((h & 1) == 0 ? u : -u) + ((h & 2) == 0 ? v : -v);
+}
+
+// Index is the element type of the permutation table
+template <class Real, class Index>
+static void setupRow(RowSetup<Real>& r, const Index* p, Real y, Real z, Real x0, Real dx, int count) {
+	int Y = (int)std::floor(y) & 255;
+	int Z = (int)std::floor(z) & 255;
+	r.y = y - std::floor(y);
+	r.z = z - std::floor(z);
+	r.v = fade(r.y);
+	r.w = fade(r.z);
+
+	// Only the lattice columns the row touches are needed
+	double xa = x0, xb = x0 + dx * (count - 1);
+	if (xb < xa)
+		std::swap(xa, xb);
+	double first = floor(xa), last = floor(xb) + 1;
+	int columns = last - first >= 255 ? 256 : (int)(last - first) + 1;
+	int L0 = (int)first & 255;
+
+	for (int k = 0; k < columns; k++) {
+		int L = (L0 + k) & 255;
+		int A = p[L] + Y;
+		int AA = p[A] + Z;
+		int AB = p[A + 1] + Z;
+		r.hashes[L] = (p[AA] & 15) | (p[AB] & 15) << 4 | (p[AA + 1] & 15) << 8 | (p[AB + 1] & 15) << 12;
+	}
+}
+
+// Scalar reference for one sample of a row, identical to PerlinNoise::noise
+static inline double sampleScalar(const RowSetup<double>& r, double x) {
+	int X = (int)floor(x) & 255;
+	x -= floor(x);
+	double u = fade(x);
+
+	int hA = r.hashes[X];
+	int hB = r.hashes[(X + 1) & 255];
+
+	double y = r.y, z = r.z;
+	double res = lerp(r.w, lerp(r.v, lerp(u, grad(hA, x, y, z), grad(hB, x - 1, y, z)), lerp(u, grad(hA >> 4, x, y - 1, z), grad(hB >> 4, x - 1, y - 1, z))), lerp(r.v, lerp(u, grad(hA >> 8, x, y, z - 1), grad(hB >> 8, x - 1, y, z - 1)), lerp(u, grad(hA >> 12, x, y - 1, z - 1), grad(hB >> 12, x - 1, y - 1, z - 1))));
+	return (res + 1.0) / 2.0;
+}
+
+static void rowScalar(const RowSetup<double>& r, double x0, double dx, int count, float* out) {
+	for (int i = 0; i < count; i++)
+		out[i] = (float)sampleScalar(r, x0 + dx * i);
+}
+
+// Single precision: the same operations in float, so lattice coordinates
+// keep about 7 significant digits instead of 16
+static inline float sampleFloat(const RowSetup<float>& r, float x) {
+	float fl = std::floor(x);
+	int X = (int)fl & 255;
+	x -= fl;
+	float u = fade(x);
+
+	int hA = r.hashes[X];
+	int hB = r.hashes[(X + 1) & 255];
+
+	float y = r.y, z = r.z;
+	float res = lerp(r.w, lerp(r.v, lerp(u, grad(hA, x, y, z), grad(hB, x - 1, y, z)), lerp(u, grad(hA >> 4, x, y - 1, z), grad(hB >> 4, x - 1, y - 1, z))), lerp(r.v, lerp(u, grad(hA >> 8, x, y, z - 1), grad(hB >> 8, x - 1, y, z - 1)), lerp(u, grad(hA >> 12, x, y - 1, z - 1), grad(hB >> 12, x - 1, y - 1, z - 1))));
+	return (res + 1.0f) * 0.5f;
+}
+
+static void rowFloatScalar(const RowSetup<float>& r, float x0, float dx, int count, float* out) {
+	for (int i = 0; i < count; i++)
+		out[i] = sampleFloat(r, x0 + dx * i);
+}
+
+// fade'(t) = 30 t^2 (t - 1)^2
+static inline double fadeSlope(double t) {
+	return 30.0 * t * t * (t - 1.0) * (t - 1.0);
+}
+
+// x and y components of the gradient direction grad() uses
+static inline void gradAxes(int hash, double& gx, double& gy) {
+	int h = hash & 15;
+	double su = (h & 1) == 0 ? 1.0 : -1.0;
+	double sv = (h & 2) == 0 ? 1.0 : -1.0;
+	gx = (h < 8 ? su : 0.0) + (h == 12 || h == 14 ? sv : 0.0);
+	gy = (h < 8 ? 0.0 : su) + (h < 4 ? sv : 0.0);
+}
+
+// One sample of PerlinNoise::noiseDerivative, without the z derivative
+static inline void derivativeScalar(const RowSetup<double>& r, double dv, double x, float& value, float& dX, float& dY) {
+	int X = (int)floor(x) & 255;
+	x -= floor(x);
+	double u = fade(x);
+	double du = fadeSlope(x);
+
+	int hA = r.hashes[X];
+	int hB = r.hashes[(X + 1) & 255];
+	int hash[8] = { hA, hB, hA >> 4, hB >> 4, hA >> 8, hB >> 8, hA >> 12, hB >> 12 };
+
+	double y = r.y, z = r.z, v = r.v, w = r.w;
+	double a = grad(hash[0], x, y, z);
+	double b = grad(hash[1], x - 1, y, z);
+	double c = grad(hash[2], x, y - 1, z);
+	double d = grad(hash[3], x - 1, y - 1, z);
+	double e = grad(hash[4], x, y, z - 1);
+	double f = grad(hash[5], x - 1, y, z - 1);
+	double g = grad(hash[6], x, y - 1, z - 1);
+	double h = grad(hash[7], x - 1, y - 1, z - 1);
+	double res = lerp(w, lerp(v, lerp(u, a, b), lerp(u, c, d)), lerp(v, lerp(u, e, f), lerp(u, g, h)));
+
+	double gx[8], gy[8];
+	for (int i = 0; i < 8; i++)
+		gradAxes(hash[i], gx[i], gy[i]);
+	double bx = lerp(w, lerp(v, lerp(u, gx[0], gx[1]), lerp(u, gx[2], gx[3])), lerp(v, lerp(u, gx[4], gx[5]), lerp(u, gx[6], gx[7])));
+	double by = lerp(w, lerp(v, lerp(u, gy[0], gy[1]), lerp(u, gy[2], gy[3])), lerp(v, lerp(u, gy[4], gy[5]), lerp(u, gy[6], gy[7])));
+
+	double k1 = b - a, k2 = c - a;
+	double k4 = a - b - c + d, k5 = a - c - e + g, k6 = a - b - e + f;
+	double k7 = -a + b + c - d + e - f - g + h;
+	value = (float)((res + 1.0) / 2.0);
+	dX = (float)(0.5 * (bx + du * (k1 + k4 * v + k6 * w + k7 * v * w)));
+	dY = (float)(0.5 * (by + dv * (k2 + k4 * u + k5 * w + k7 * u * w)));
+}
+
+void perlinDerivativeRowScalar(const int* p, double y, double z, double x0, double dx, int count,
+	float* value, float* dX, float* dY) {
+	RowSetup<double> r;
+	setupRow(r, p, y, z, x0, dx, count);
+	double dv = fadeSlope(r.y);
+	for (int i = 0; i < count; i++)
+		derivativeScalar(r, dv, x0 + dx * i, value[i], dX[i], dY[i]);
+}
+
+// Samples at scattered (x, y) of one z slice. Only z is shared, so the setup
+// folds the z half of the hash chain into a table indexed by A = p[X] + Y:
+// hashes[A] packs the corner hashes p[AA], p[AB], p[AA + 1], p[AB + 1] as
+// nibbles in the same order as RowSetup (y0z0, y1z0, y0z1, y1z1)
+struct PlaneSetup {
+	double z, w;
+	alignas(32) int hashes[512];
+};
+
+static void setupPlane(PlaneSetup& s, const int* p, double z) {
+	int Z = (int)floor(z) & 255;
+	s.z = z - floor(z);
+	s.w = fade(s.z);
+	// A = p[X] + Y is at most 510
+	for (int A = 0; A < 511; A++) {
+		int AA = p[A] + Z;
+		int AB = p[A + 1] + Z;
+		s.hashes[A] = (p[AA] & 15) | (p[AB] & 15) << 4 | (p[AA + 1] & 15) << 8 | (p[AB + 1] & 15) << 12;
+	}
+	s.hashes[511] = 0;
+}
+
+// One sample, identical to PerlinNoise::noise(x, y, s.z)
+static inline double samplePoint(const int* p, const PlaneSetup& s, double x, double y) {
+	int X = (int)floor(x) & 255;
+	int Y = (int)floor(y) & 255;
+	x -= floor(x);
+	y -= floor(y);
+	double u = fade(x);
+	double v = fade(y);
+
+	int hA = s.hashes[p[X] + Y];
+	int hB = s.hashes[p[X + 1] + Y];
+
+	double z = s.z, w = s.w;
+	double res = lerp(w, lerp(v, lerp(u, grad(hA, x, y, z), grad(hB, x - 1, y, z)), lerp(u, grad(hA >> 4, x, y - 1, z), grad(hB >> 4, x - 1, y - 1, z))), lerp(v, lerp(u, grad(hA >> 8, x, y, z - 1), grad(hB >> 8, x - 1, y, z - 1)), lerp(u, grad(hA >> 12, x, y - 1, z - 1), grad(hB >> 12, x - 1, y - 1, z - 1))));
+	return (res + 1.0) / 2.0;
+}
+
+void perlinPointsScalar(const int* p, double z, const double* x, const double* y, int count, float* out) {
+	PlaneSetup s;
+	setupPlane(s, p, z);
+	for (int i = 0; i < count; i++)
+		out[i] = (float)samplePoint(p, s, x[i], y[i]);
+}
+
+#if defined(MAPGEN_X86)
+
+// SSE4.1: two samples per iteration. There is no gather, so the packed corner
+// hashes are fetched with scalar loads and everything else runs in vector registers
+
+// grad() without branches: h holds two hashes in the low 32-bit lanes
+MAPGEN_TARGET_SSE41 static inline __m128d gradSSE41(__m128i h, __m128d x, __m128d y, __m128d z) {
+	h = _mm_and_si128(h, _mm_set1_epi32(15));
+	// Widen the 32-bit lane masks to 64 bits so they line up with the doubles
+	__m128i lt8 = _mm_cvtepi32_epi64(_mm_cmplt_epi32(h, _mm_set1_epi32(8)));
+	__m128i lt4 = _mm_cvtepi32_epi64(_mm_cmplt_epi32(h, _mm_set1_epi32(4)));
+	__m128i is12or14 = _mm_cvtepi32_epi64(_mm_or_si128(_mm_cmpeq_epi32(h, _mm_set1_epi32(12)), _mm_cmpeq_epi32(h, _mm_set1_epi32(14))));
+	__m128i bit0 = _mm_cvtepi32_epi64(_mm_slli_epi32(h, 31));
+	__m128i bit1 = _mm_cvtepi32_epi64(_mm_slli_epi32(_mm_srli_epi32(h, 1), 31));
+
+	__m128d u = _mm_blendv_pd(y, x, _mm_castsi128_pd(lt8));
+	__m128d v = _mm_blendv_pd(_mm_blendv_pd(z, x, _mm_castsi128_pd(is12or14)), y, _mm_castsi128_pd(lt4));
+	// Flip the sign bit where the hash asks for it
+	__m128d sign = _mm_set1_pd(-0.0);
+	u = _mm_xor_pd(u, _mm_and_pd(_mm_castsi128_pd(bit0), sign));
+	v = _mm_xor_pd(v, _mm_and_pd(_mm_castsi128_pd(bit1), sign));
+	return _mm_add_pd(u, v);
+}
+
+MAPGEN_TARGET_SSE41 static inline __m128d fadeSSE41(__m128d t) {
+	__m128d r = _mm_sub_pd(_mm_mul_pd(t, _mm_set1_pd(6)), _mm_set1_pd(15));
+	r = _mm_add_pd(_mm_mul_pd(t, r), _mm_set1_pd(10));
+	return _mm_mul_pd(_mm_mul_pd(_mm_mul_pd(t, t), t), r);
+}
+
+MAPGEN_TARGET_SSE41 static inline __m128d lerpSSE41(__m128d t, __m128d a, __m128d b) {
+	return _mm_add_pd(a, _mm_mul_pd(t, _mm_sub_pd(b, a)));
+}
+
+MAPGEN_TARGET_SSE41 static void rowSSE41(const RowSetup<double>& r, double x0, double dx, int count, float* out) {
+	const __m128d one = _mm_set1_pd(1.0);
+	const __m128d vy = _mm_set1_pd(r.y), vy1 = _mm_set1_pd(r.y - 1);
+	const __m128d vz = _mm_set1_pd(r.z), vz1 = _mm_set1_pd(r.z - 1);
+	const __m128d v = _mm_set1_pd(r.v), w = _mm_set1_pd(r.w);
+
+	int i = 0;
+	for (; i + 2 <= count; i += 2) {
+		__m128d x = _mm_add_pd(_mm_set1_pd(x0), _mm_mul_pd(_mm_set1_pd(dx), _mm_set_pd(i + 1, i)));
+		__m128d fl = _mm_floor_pd(x);
+		__m128i X = _mm_and_si128(_mm_cvttpd_epi32(fl), _mm_set1_epi32(255));
+		__m128i X1 = _mm_and_si128(_mm_add_epi32(X, _mm_set1_epi32(1)), _mm_set1_epi32(255));
+		x = _mm_sub_pd(x, fl);
+		__m128d u = fadeSSE41(x);
+		__m128d x1 = _mm_sub_pd(x, one);
+
+		__m128i hA = _mm_set_epi32(0, 0, r.hashes[_mm_extract_epi32(X, 1)], r.hashes[_mm_extract_epi32(X, 0)]);
+		__m128i hB = _mm_set_epi32(0, 0, r.hashes[_mm_extract_epi32(X1, 1)], r.hashes[_mm_extract_epi32(X1, 0)]);
+
+		__m128d g0 = gradSSE41(hA, x, vy, vz);
+		__m128d g1 = gradSSE41(hB, x1, vy, vz);
+		__m128d g2 = gradSSE41(_mm_srli_epi32(hA, 4), x, vy1, vz);
+		__m128d g3 = gradSSE41(_mm_srli_epi32(hB, 4), x1, vy1, vz);
+		__m128d g4 = gradSSE41(_mm_srli_epi32(hA, 8), x, vy, vz1);
+		__m128d g5 = gradSSE41(_mm_srli_epi32(hB, 8), x1, vy, vz1);
+		__m128d g6 = gradSSE41(_mm_srli_epi32(hA, 12), x, vy1, vz1);
+		__m128d g7 = gradSSE41(_mm_srli_epi32(hB, 12), x1, vy1, vz1);
+
+		__m128d res = lerpSSE41(w,
+			lerpSSE41(v, lerpSSE41(u, g0, g1), lerpSSE41(u, g2, g3)),
+			lerpSSE41(v, lerpSSE41(u, g4, g5), lerpSSE41(u, g6, g7)));
+		res = _mm_mul_pd(_mm_add_pd(res, one), _mm_set1_pd(0.5));
+
+		_mm_storel_pi((__m64*)(out + i), _mm_cvtpd_ps(res));
+	}
+	for (; i < count; i++)
+		out[i] = (float)sampleScalar(r, x0 + dx * i);
+}
+
+// AVX2: four samples per iteration with the packed corner hashes fetched by gathers
+
+MAPGEN_TARGET_AVX2 static inline __m256d gradAVX2(__m128i h, __m256d x, __m256d y, __m256d z) {
+	h = _mm_and_si128(h, _mm_set1_epi32(15));
+	__m256d lt8 = _mm256_castsi256_pd(_mm256_cvtepi32_epi64(_mm_cmplt_epi32(h, _mm_set1_epi32(8))));
+	__m256d lt4 = _mm256_castsi256_pd(_mm256_cvtepi32_epi64(_mm_cmplt_epi32(h, _mm_set1_epi32(4))));
+	__m256d is12or14 = _mm256_castsi256_pd(_mm256_cvtepi32_epi64(_mm_or_si128(_mm_cmpeq_epi32(h, _mm_set1_epi32(12)), _mm_cmpeq_epi32(h, _mm_set1_epi32(14)))));
+	__m256d bit0 = _mm256_castsi256_pd(_mm256_cvtepi32_epi64(_mm_slli_epi32(h, 31)));
+	__m256d bit1 = _mm256_castsi256_pd(_mm256_cvtepi32_epi64(_mm_slli_epi32(_mm_srli_epi32(h, 1), 31)));
+
+	__m256d u = _mm256_blendv_pd(y, x, lt8);
+	__m256d v = _mm256_blendv_pd(_mm256_blendv_pd(z, x, is12or14), y, lt4);
+	__m256d sign = _mm256_set1_pd(-0.0);
+	u = _mm256_xor_pd(u, _mm256_and_pd(bit0, sign));
+	v = _mm256_xor_pd(v, _mm256_and_pd(bit1, sign));
+	return _mm256_add_pd(u, v);
+}
+
+MAPGEN_TARGET_AVX2 static inline __m256d fadeAVX2(__m256d t) {
+	__m256d r = _mm256_sub_pd(_mm256_mul_pd(t, _mm256_set1_pd(6)), _mm256_set1_pd(15));
+	r = _mm256_add_pd(_mm256_mul_pd(t, r), _mm256_set1_pd(10));
+	return _mm256_mul_pd(_mm256_mul_pd(_mm256_mul_pd(t, t), t), r);
+}
+
+MAPGEN_TARGET_AVX2 static inline __m256d lerpAVX2(__m256d t, __m256d a, __m256d b) {
+	return _mm256_add_pd(a, _mm256_mul_pd(t, _mm256_sub_pd(b, a)));
+}
+
+MAPGEN_TARGET_AVX2 static void rowAVX2(const RowSetup<double>& r, double x0, double dx, int count, float* out) {
+	const __m256d one = _mm256_set1_pd(1.0);
+	const __m256d vy = _mm256_set1_pd(r.y), vy1 = _mm256_set1_pd(r.y - 1);
+	const __m256d vz = _mm256_set1_pd(r.z), vz1 = _mm256_set1_pd(r.z - 1);
+	const __m256d v = _mm256_set1_pd(r.v), w = _mm256_set1_pd(r.w);
+
+	int i = 0;
+	for (; i + 4 <= count; i += 4) {
+		__m256d x = _mm256_add_pd(_mm256_set1_pd(x0), _mm256_mul_pd(_mm256_set1_pd(dx), _mm256_set_pd(i + 3, i + 2, i + 1, i)));
+		__m256d fl = _mm256_floor_pd(x);
+		__m128i X = _mm_and_si128(_mm256_cvttpd_epi32(fl), _mm_set1_epi32(255));
+		__m128i X1 = _mm_and_si128(_mm_add_epi32(X, _mm_set1_epi32(1)), _mm_set1_epi32(255));
+		x = _mm256_sub_pd(x, fl);
+		__m256d u = fadeAVX2(x);
+		__m256d x1 = _mm256_sub_pd(x, one);
+
+		__m128i hA = _mm_i32gather_epi32(r.hashes, X, 4);
+		__m128i hB = _mm_i32gather_epi32(r.hashes, X1, 4);
+
+		__m256d g0 = gradAVX2(hA, x, vy, vz);
+		__m256d g1 = gradAVX2(hB, x1, vy, vz);
+		__m256d g2 = gradAVX2(_mm_srli_epi32(hA, 4), x, vy1, vz);
+		__m256d g3 = gradAVX2(_mm_srli_epi32(hB, 4), x1, vy1, vz);
+		__m256d g4 = gradAVX2(_mm_srli_epi32(hA, 8), x, vy, vz1);
+		__m256d g5 = gradAVX2(_mm_srli_epi32(hB, 8), x1, vy, vz1);
+		__m256d g6 = gradAVX2(_mm_srli_epi32(hA, 12), x, vy1, vz1);
+		__m256d g7 = gradAVX2(_mm_srli_epi32(hB, 12), x1, vy1, vz1);
+
+		__m256d res = lerpAVX2(w,
+			lerpAVX2(v, lerpAVX2(u, g0, g1), lerpAVX2(u, g2, g3)),
+			lerpAVX2(v, lerpAVX2(u, g4, g5), lerpAVX2(u, g6, g7)));
+		res = _mm256_mul_pd(_mm256_add_pd(res, one), _mm256_set1_pd(0.5));
+
+		_mm_storeu_ps(out + i, _mm256_cvtpd_ps(res));
+	}
+	for (; i < count; i++)
+		out[i] = (float)sampleScalar(r, x0 + dx * i);
+}
+
+// gradAxes() without branches
+MAPGEN_TARGET_AVX2 static inline void gradAxesAVX2(__m128i h, __m256d& gx, __m256d& gy) {
+	h = _mm_and_si128(h, _mm_set1_epi32(15));
+	__m256d lt8 = _mm256_castsi256_pd(_mm256_cvtepi32_epi64(_mm_cmplt_epi32(h, _mm_set1_epi32(8))));
+	__m256d lt4 = _mm256_castsi256_pd(_mm256_cvtepi32_epi64(_mm_cmplt_epi32(h, _mm_set1_epi32(4))));
+	__m256d is12or14 = _mm256_castsi256_pd(_mm256_cvtepi32_epi64(_mm_or_si128(_mm_cmpeq_epi32(h, _mm_set1_epi32(12)), _mm_cmpeq_epi32(h, _mm_set1_epi32(14)))));
+	__m256d bit0 = _mm256_castsi256_pd(_mm256_cvtepi32_epi64(_mm_slli_epi32(h, 31)));
+	__m256d bit1 = _mm256_castsi256_pd(_mm256_cvtepi32_epi64(_mm_slli_epi32(_mm_srli_epi32(h, 1), 31)));
+
+	__m256d one = _mm256_set1_pd(1.0), sign = _mm256_set1_pd(-0.0);
+	__m256d su = _mm256_xor_pd(one, _mm256_and_pd(bit0, sign));
+	__m256d sv = _mm256_xor_pd(one, _mm256_and_pd(bit1, sign));
+	gx = _mm256_add_pd(_mm256_and_pd(lt8, su), _mm256_and_pd(is12or14, sv));
+	gy = _mm256_add_pd(_mm256_andnot_pd(lt8, su), _mm256_and_pd(lt4, sv));
+}
+
+MAPGEN_TARGET_AVX2 static inline __m256d fadeSlopeAVX2(__m256d t) {
+	__m256d t1 = _mm256_sub_pd(t, _mm256_set1_pd(1.0));
+	return _mm256_mul_pd(_mm256_mul_pd(_mm256_mul_pd(_mm256_mul_pd(_mm256_set1_pd(30.0), t), t), t1), t1);
+}
+
+MAPGEN_TARGET_AVX2 static inline __m256d blendAVX2(__m256d u, __m256d v, __m256d w, const __m256d* k) {
+	return lerpAVX2(w,
+		lerpAVX2(v, lerpAVX2(u, k[0], k[1]), lerpAVX2(u, k[2], k[3])),
+		lerpAVX2(v, lerpAVX2(u, k[4], k[5]), lerpAVX2(u, k[6], k[7])));
+}
+
+MAPGEN_TARGET_AVX2 void perlinDerivativeRowAVX2(const int* p, double y, double z, double x0, double dx, int count,
+	float* value, float* dX, float* dY) {
+	RowSetup<double> r;
+	setupRow(r, p, y, z, x0, dx, count);
+	double dvScalar = fadeSlope(r.y);
+	const __m256d one = _mm256_set1_pd(1.0), half = _mm256_set1_pd(0.5);
+	const __m256d vy = _mm256_set1_pd(r.y), vy1 = _mm256_set1_pd(r.y - 1);
+	const __m256d vz = _mm256_set1_pd(r.z), vz1 = _mm256_set1_pd(r.z - 1);
+	const __m256d v = _mm256_set1_pd(r.v), w = _mm256_set1_pd(r.w), dv = _mm256_set1_pd(dvScalar);
+
+	int i = 0;
+	for (; i + 4 <= count; i += 4) {
+		__m256d x = _mm256_add_pd(_mm256_set1_pd(x0), _mm256_mul_pd(_mm256_set1_pd(dx), _mm256_set_pd(i + 3, i + 2, i + 1, i)));
+		__m256d fl = _mm256_floor_pd(x);
+		__m128i X = _mm_and_si128(_mm256_cvttpd_epi32(fl), _mm_set1_epi32(255));
+		__m128i X1 = _mm_and_si128(_mm_add_epi32(X, _mm_set1_epi32(1)), _mm_set1_epi32(255));
+		x = _mm256_sub_pd(x, fl);
+		__m256d u = fadeAVX2(x);
+		__m256d du = fadeSlopeAVX2(x);
+		__m256d x1 = _mm256_sub_pd(x, one);
+
+		__m128i hA = _mm_i32gather_epi32(r.hashes, X, 4);
+		__m128i hB = _mm_i32gather_epi32(r.hashes, X1, 4);
+		__m128i hash[8] = { hA, hB, _mm_srli_epi32(hA, 4), _mm_srli_epi32(hB, 4),
+			_mm_srli_epi32(hA, 8), _mm_srli_epi32(hB, 8), _mm_srli_epi32(hA, 12), _mm_srli_epi32(hB, 12) };
+
+		__m256d k[8];
+		k[0] = gradAVX2(hash[0], x, vy, vz);
+		k[1] = gradAVX2(hash[1], x1, vy, vz);
+		k[2] = gradAVX2(hash[2], x, vy1, vz);
+		k[3] = gradAVX2(hash[3], x1, vy1, vz);
+		k[4] = gradAVX2(hash[4], x, vy, vz1);
+		k[5] = gradAVX2(hash[5], x1, vy, vz1);
+		k[6] = gradAVX2(hash[6], x, vy1, vz1);
+		k[7] = gradAVX2(hash[7], x1, vy1, vz1);
+		__m256d res = blendAVX2(u, v, w, k);
+
+		__m256d gx[8], gy[8];
+		for (int c = 0; c < 8; c++)
+			gradAxesAVX2(hash[c], gx[c], gy[c]);
+		__m256d bx = blendAVX2(u, v, w, gx);
+		__m256d by = blendAVX2(u, v, w, gy);
+
+		// Same association as the scalar kernel
+		__m256d a = k[0], b = k[1], c = k[2], d = k[3], e = k[4], f = k[5], g = k[6], h = k[7];
+		__m256d k1 = _mm256_sub_pd(b, a), k2 = _mm256_sub_pd(c, a);
+		__m256d k4 = _mm256_add_pd(_mm256_sub_pd(_mm256_sub_pd(a, b), c), d);
+		__m256d k5 = _mm256_add_pd(_mm256_sub_pd(_mm256_sub_pd(a, c), e), g);
+		__m256d k6 = _mm256_add_pd(_mm256_sub_pd(_mm256_sub_pd(a, b), e), f);
+		__m256d k7 = _mm256_add_pd(_mm256_xor_pd(a, _mm256_set1_pd(-0.0)), b);
+		k7 = _mm256_sub_pd(_mm256_add_pd(k7, c), d);
+		k7 = _mm256_sub_pd(_mm256_add_pd(k7, e), f);
+		k7 = _mm256_add_pd(_mm256_sub_pd(k7, g), h);
+
+		__m256d sx = _mm256_add_pd(_mm256_add_pd(k1, _mm256_mul_pd(k4, v)), _mm256_mul_pd(k6, w));
+		sx = _mm256_add_pd(sx, _mm256_mul_pd(_mm256_mul_pd(k7, v), w));
+		__m256d sy = _mm256_add_pd(_mm256_add_pd(k2, _mm256_mul_pd(k4, u)), _mm256_mul_pd(k5, w));
+		sy = _mm256_add_pd(sy, _mm256_mul_pd(_mm256_mul_pd(k7, u), w));
+
+		res = _mm256_mul_pd(_mm256_add_pd(res, one), half);
+		__m256d rx = _mm256_mul_pd(half, _mm256_add_pd(bx, _mm256_mul_pd(du, sx)));
+		__m256d ry = _mm256_mul_pd(half, _mm256_add_pd(by, _mm256_mul_pd(dv, sy)));
+		_mm_storeu_ps(value + i, _mm256_cvtpd_ps(res));
+		_mm_storeu_ps(dX + i, _mm256_cvtpd_ps(rx));
+		_mm_storeu_ps(dY + i, _mm256_cvtpd_ps(ry));
+	}
+	for (; i < count; i++)
+		derivativeScalar(r, dvScalar, x0 + dx * i, value[i], dX[i], dY[i]);
+}
+
+// Scattered samples, four per iteration: two gathers from the permutation for
+// p[X] and p[X + 1], two from the plane table for the packed corner hashes
+MAPGEN_TARGET_AVX2 void perlinPointsAVX2(const int* p, double z, const double* x, const double* y, int count, float* out) {
+	PlaneSetup s;
+	setupPlane(s, p, z);
+	const __m256d one = _mm256_set1_pd(1.0);
+	const __m256d vz = _mm256_set1_pd(s.z), vz1 = _mm256_set1_pd(s.z - 1);
+	const __m256d w = _mm256_set1_pd(s.w);
+	const __m128i mask = _mm_set1_epi32(255);
+
+	int i = 0;
+	for (; i + 4 <= count; i += 4) {
+		__m256d px = _mm256_loadu_pd(x + i);
+		__m256d py = _mm256_loadu_pd(y + i);
+		__m256d flx = _mm256_floor_pd(px);
+		__m256d fly = _mm256_floor_pd(py);
+		__m128i X = _mm_and_si128(_mm256_cvttpd_epi32(flx), mask);
+		__m128i Y = _mm_and_si128(_mm256_cvttpd_epi32(fly), mask);
+		px = _mm256_sub_pd(px, flx);
+		py = _mm256_sub_pd(py, fly);
+		__m256d u = fadeAVX2(px);
+		__m256d v = fadeAVX2(py);
+		__m256d px1 = _mm256_sub_pd(px, one);
+		__m256d py1 = _mm256_sub_pd(py, one);
+
+		__m128i A = _mm_add_epi32(_mm_i32gather_epi32(p, X, 4), Y);
+		__m128i B = _mm_add_epi32(_mm_i32gather_epi32(p + 1, X, 4), Y);
+		__m128i hA = _mm_i32gather_epi32(s.hashes, A, 4);
+		__m128i hB = _mm_i32gather_epi32(s.hashes, B, 4);
+
+		__m256d g0 = gradAVX2(hA, px, py, vz);
+		__m256d g1 = gradAVX2(hB, px1, py, vz);
+		__m256d g2 = gradAVX2(_mm_srli_epi32(hA, 4), px, py1, vz);
+		__m256d g3 = gradAVX2(_mm_srli_epi32(hB, 4), px1, py1, vz);
+		__m256d g4 = gradAVX2(_mm_srli_epi32(hA, 8), px, py, vz1);
+		__m256d g5 = gradAVX2(_mm_srli_epi32(hB, 8), px1, py, vz1);
+		__m256d g6 = gradAVX2(_mm_srli_epi32(hA, 12), px, py1, vz1);
+		__m256d g7 = gradAVX2(_mm_srli_epi32(hB, 12), px1, py1, vz1);
+
+		__m256d res = lerpAVX2(w,
+			lerpAVX2(v, lerpAVX2(u, g0, g1), lerpAVX2(u, g2, g3)),
+			lerpAVX2(v, lerpAVX2(u, g4, g5), lerpAVX2(u, g6, g7)));
+		res = _mm256_mul_pd(_mm256_add_pd(res, one), _mm256_set1_pd(0.5));
+
+		_mm_storeu_ps(out + i, _mm256_cvtpd_ps(res));
+	}
+	for (; i < count; i++)
+		out[i] = (float)samplePoint(p, s, x[i], y[i]);
+}
+
+// Single precision kernels: float lanes are half as wide as double lanes, so
+// SSE4.1 does four samples per iteration and AVX2 eight
+
+MAPGEN_TARGET_SSE41 static inline __m128 gradFloatSSE41(__m128i h, __m128 x, __m128 y, __m128 z) {
+	h = _mm_and_si128(h, _mm_set1_epi32(15));
+	__m128 lt8 = _mm_castsi128_ps(_mm_cmplt_epi32(h, _mm_set1_epi32(8)));
+	__m128 lt4 = _mm_castsi128_ps(_mm_cmplt_epi32(h, _mm_set1_epi32(4)));
+	__m128 is12or14 = _mm_castsi128_ps(_mm_or_si128(_mm_cmpeq_epi32(h, _mm_set1_epi32(12)), _mm_cmpeq_epi32(h, _mm_set1_epi32(14))));
+	__m128 bit0 = _mm_castsi128_ps(_mm_slli_epi32(h, 31));
+	__m128 bit1 = _mm_castsi128_ps(_mm_slli_epi32(_mm_srli_epi32(h, 1), 31));
+
+	__m128 u = _mm_blendv_ps(y, x, lt8);
+	__m128 v = _mm_blendv_ps(_mm_blendv_ps(z, x, is12or14), y, lt4);
+	u = _mm_xor_ps(u, bit0);
+	v = _mm_xor_ps(v, bit1);
+	return _mm_add_ps(u, v);
+}
+
+MAPGEN_TARGET_SSE41 static inline __m128 fadeFloatSSE41(__m128 t) {
+	__m128 r = _mm_sub_ps(_mm_mul_ps(t, _mm_set1_ps(6)), _mm_set1_ps(15));
+	r = _mm_add_ps(_mm_mul_ps(t, r), _mm_set1_ps(10));
+	return _mm_mul_ps(_mm_mul_ps(_mm_mul_ps(t, t), t), r);
+}
+
+MAPGEN_TARGET_SSE41 static inline __m128 lerpFloatSSE41(__m128 t, __m128 a, __m128 b) {
+	return _mm_add_ps(a, _mm_mul_ps(t, _mm_sub_ps(b, a)));
+}
+
+MAPGEN_TARGET_SSE41 static void rowFloatSSE41(const RowSetup<float>& r, float x0, float dx, int count, float* out) {
+	const __m128 one = _mm_set1_ps(1.0f), half = _mm_set1_ps(0.5f);
+	const __m128 vy = _mm_set1_ps(r.y), vy1 = _mm_set1_ps(r.y - 1);
+	const __m128 vz = _mm_set1_ps(r.z), vz1 = _mm_set1_ps(r.z - 1);
+	const __m128 v = _mm_set1_ps(r.v), w = _mm_set1_ps(r.w);
+
+	int i = 0;
+	for (; i + 4 <= count; i += 4) {
+		__m128 x = _mm_add_ps(_mm_set1_ps(x0), _mm_mul_ps(_mm_set1_ps(dx), _mm_cvtepi32_ps(_mm_setr_epi32(i, i + 1, i + 2, i + 3))));
+		__m128 fl = _mm_floor_ps(x);
+		__m128i X = _mm_and_si128(_mm_cvttps_epi32(fl), _mm_set1_epi32(255));
+		__m128i X1 = _mm_and_si128(_mm_add_epi32(X, _mm_set1_epi32(1)), _mm_set1_epi32(255));
+		x = _mm_sub_ps(x, fl);
+		__m128 u = fadeFloatSSE41(x);
+		__m128 x1 = _mm_sub_ps(x, one);
+
+		__m128i hA = _mm_setr_epi32(r.hashes[_mm_extract_epi32(X, 0)], r.hashes[_mm_extract_epi32(X, 1)],
+			r.hashes[_mm_extract_epi32(X, 2)], r.hashes[_mm_extract_epi32(X, 3)]);
+		__m128i hB = _mm_setr_epi32(r.hashes[_mm_extract_epi32(X1, 0)], r.hashes[_mm_extract_epi32(X1, 1)],
+			r.hashes[_mm_extract_epi32(X1, 2)], r.hashes[_mm_extract_epi32(X1, 3)]);
+
+		__m128 g0 = gradFloatSSE41(hA, x, vy, vz);
+		__m128 g1 = gradFloatSSE41(hB, x1, vy, vz);
+		__m128 g2 = gradFloatSSE41(_mm_srli_epi32(hA, 4), x, vy1, vz);
+		__m128 g3 = gradFloatSSE41(_mm_srli_epi32(hB, 4), x1, vy1, vz);
+		__m128 g4 = gradFloatSSE41(_mm_srli_epi32(hA, 8), x, vy, vz1);
+		__m128 g5 = gradFloatSSE41(_mm_srli_epi32(hB, 8), x1, vy, vz1);
+		__m128 g6 = gradFloatSSE41(_mm_srli_epi32(hA, 12), x, vy1, vz1);
+		__m128 g7 = gradFloatSSE41(_mm_srli_epi32(hB, 12), x1, vy1, vz1);
+
+		__m128 res = lerpFloatSSE41(w,
+			lerpFloatSSE41(v, lerpFloatSSE41(u, g0, g1), lerpFloatSSE41(u, g2, g3)),
+			lerpFloatSSE41(v, lerpFloatSSE41(u, g4, g5), lerpFloatSSE41(u, g6, g7)));
+		_mm_storeu_ps(out + i, _mm_mul_ps(_mm_add_ps(res, one), half));
+	}
+	for (; i < count; i++)
+		out[i] = sampleFloat(r, x0 + dx * i);
+}
+
+MAPGEN_TARGET_AVX2 static inline __m256 gradFloatAVX2(__m256i h, __m256 x, __m256 y, __m256 z) {
+	h = _mm256_and_si256(h, _mm256_set1_epi32(15));
+	__m256 lt8 = _mm256_castsi256_ps(_mm256_cmpgt_epi32(_mm256_set1_epi32(8), h));
+	__m256 lt4 = _mm256_castsi256_ps(_mm256_cmpgt_epi32(_mm256_set1_epi32(4), h));
+	__m256 is12or14 = _mm256_castsi256_ps(_mm256_or_si256(_mm256_cmpeq_epi32(h, _mm256_set1_epi32(12)), _mm256_cmpeq_epi32(h, _mm256_set1_epi32(14))));
+	__m256 bit0 = _mm256_castsi256_ps(_mm256_slli_epi32(h, 31));
+	__m256 bit1 = _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_srli_epi32(h, 1), 31));
+
+	__m256 u = _mm256_blendv_ps(y, x, lt8);
+	__m256 v = _mm256_blendv_ps(_mm256_blendv_ps(z, x, is12or14), y, lt4);
+	u = _mm256_xor_ps(u, bit0);
+	v = _mm256_xor_ps(v, bit1);
+	return _mm256_add_ps(u, v);
+}
+
+MAPGEN_TARGET_AVX2 static inline __m256 fadeFloatAVX2(__m256 t) {
+	__m256 r = _mm256_sub_ps(_mm256_mul_ps(t, _mm256_set1_ps(6)), _mm256_set1_ps(15));
+	r = _mm256_add_ps(_mm256_mul_ps(t, r), _mm256_set1_ps(10));
+	return _mm256_mul_ps(_mm256_mul_ps(_mm256_mul_ps(t, t), t), r);
+}
+
+MAPGEN_TARGET_AVX2 static inline __m256 lerpFloatAVX2(__m256 t, __m256 a, __m256 b) {
+	return _mm256_add_ps(a, _mm256_mul_ps(t, _mm256_sub_ps(b, a)));
+}
+
+MAPGEN_TARGET_AVX2 static void rowFloatAVX2(const RowSetup<float>& r, float x0, float dx, int count, float* out) {
+	const __m256 one = _mm256_set1_ps(1.0f), half = _mm256_set1_ps(0.5f);
+	const __m256 vy = _mm256_set1_ps(r.y), vy1 = _mm256_set1_ps(r.y - 1);
+	const __m256 vz = _mm256_set1_ps(r.z), vz1 = _mm256_set1_ps(r.z - 1);
+	const __m256 v = _mm256_set1_ps(r.v), w = _mm256_set1_ps(r.w);
+	const __m256i lanes = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+
+	int i = 0;
+	for (; i + 8 <= count; i += 8) {
+		__m256 index = _mm256_cvtepi32_ps(_mm256_add_epi32(_mm256_set1_epi32(i), lanes));
+		__m256 x = _mm256_add_ps(_mm256_set1_ps(x0), _mm256_mul_ps(_mm256_set1_ps(dx), index));
+		__m256 fl = _mm256_floor_ps(x);
+		__m256i X = _mm256_and_si256(_mm256_cvttps_epi32(fl), _mm256_set1_epi32(255));
+		__m256i X1 = _mm256_and_si256(_mm256_add_epi32(X, _mm256_set1_epi32(1)), _mm256_set1_epi32(255));
+		x = _mm256_sub_ps(x, fl);
+		__m256 u = fadeFloatAVX2(x);
+		__m256 x1 = _mm256_sub_ps(x, one);
+
+		__m256i hA = _mm256_i32gather_epi32(r.hashes, X, 4);
+		__m256i hB = _mm256_i32gather_epi32(r.hashes, X1, 4);
+
+		__m256 g0 = gradFloatAVX2(hA, x, vy, vz);
+		__m256 g1 = gradFloatAVX2(hB, x1, vy, vz);
+		__m256 g2 = gradFloatAVX2(_mm256_srli_epi32(hA, 4), x, vy1, vz);
+		__m256 g3 = gradFloatAVX2(_mm256_srli_epi32(hB, 4), x1, vy1, vz);
+		__m256 g4 = gradFloatAVX2(_mm256_srli_epi32(hA, 8), x, vy, vz1);
+		__m256 g5 = gradFloatAVX2(_mm256_srli_epi32(hB, 8), x1, vy, vz1);
+		__m256 g6 = gradFloatAVX2(_mm256_srli_epi32(hA, 12), x, vy1, vz1);
+		__m256 g7 = gradFloatAVX2(_mm256_srli_epi32(hB, 12), x1, vy1, vz1);
+
+		__m256 res = lerpFloatAVX2(w,
+			lerpFloatAVX2(v, lerpFloatAVX2(u, g0, g1), lerpFloatAVX2(u, g2, g3)),
+			lerpFloatAVX2(v, lerpFloatAVX2(u, g4, g5), lerpFloatAVX2(u, g6, g7)));
+		_mm256_storeu_ps(out + i, _mm256_mul_ps(_mm256_add_ps(res, one), half));
+	}
+	for (; i < count; i++)
+		out[i] = sampleFloat(r, x0 + dx * i);
+}
+
+#else
+
+static void rowSSE41(const RowSetup<double>& r, double x0, double dx, int count, float* out) {
+	rowScalar(r, x0, dx, count, out);
+}
+
+static void rowAVX2(const RowSetup<double>& r, double x0, double dx, int count, float* out) {
+	rowScalar(r, x0, dx, count, out);
+}
+
+static void rowFloatSSE41(const RowSetup<float>& r, float x0, float dx, int count, float* out) {
+	rowFloatScalar(r, x0, dx, count, out);
+}
+
+static void rowFloatAVX2(const RowSetup<float>& r, float x0, float dx, int count, float* out) {
+	rowFloatScalar(r, x0, dx, count, out);
+}
+
+void perlinDerivativeRowAVX2(const int* p, double y, double z, double x0, double dx, int count,
+	float* value, float* dX, float* dY) {
+	perlinDerivativeRowScalar(p, y, z, x0, dx, count, value, dX, dY);
+}
+
+void perlinPointsAVX2(const int* p, double z, const double* x, const double* y, int count, float* out) {
+	perlinPointsScalar(p, z, x, y, count, out);
+}
+
+#endif
+
+void perlinRowScalar(const int* p, double y, double z, double x0, double dx, int count, float* out) {
+	RowSetup<double> r;
+	setupRow(r, p, y, z, x0, dx, count);
+	rowScalar(r, x0, dx, count, out);
+}
+
+void perlinRowSSE41(const int* p, double y, double z, double x0, double dx, int count, float* out) {
+	RowSetup<double> r;
+	setupRow(r, p, y, z, x0, dx, count);
+	rowSSE41(r, x0, dx, count, out);
+}
+
+void perlinRowAVX2(const int* p, double y, double z, double x0, double dx, int count, float* out) {
+	RowSetup<double> r;
+	setupRow(r, p, y, z, x0, dx, count);
+	rowAVX2(r, x0, dx, count, out);
+}
+
+// The float bodies have their own names; route them through overloads so
+// dispatchRow stays one template
+static void rowScalar(const RowSetup<float>& r, float x0, float dx, int count, float* out) {
+	rowFloatScalar(r, x0, dx, count, out);
+}
+
+static void rowSSE41(const RowSetup<float>& r, float x0, float dx, int count, float* out) {
+	rowFloatSSE41(r, x0, dx, count, out);
+}
+
+static void rowAVX2(const RowSetup<float>& r, float x0, float dx, int count, float* out) {
+	rowFloatAVX2(r, x0, dx, count, out);
+}
+
+template <class Real, class Index>
+static void dispatchRow(SimdLevel level, const Index* p, Real y, Real z, Real x0, Real dx, int count, float* out) {
+	RowSetup<Real> r;
+	setupRow(r, p, y, z, x0, dx, count);
+	switch (level) {
+	case SimdLevel::AVX2:
+		rowAVX2(r, x0, dx, count, out);
+		break;
+	case SimdLevel::SSE41:
+		rowSSE41(r, x0, dx, count, out);
+		break;
+	default:
+		rowScalar(r, x0, dx, count, out);
+		break;
+	}
+}
+
+void perlinRow(SimdLevel level, const int* p, double y, double z, double x0, double dx, int count, float* out) {
+	dispatchRow(level, p, y, z, x0, dx, count, out);
+}
+
+void perlinRow(SimdLevel level, const std::uint8_t* p, double y, double z, double x0, double dx, int count, float* out) {
+	dispatchRow(level, p, y, z, x0, dx, count, out);
+}
+
+void perlinRow(SimdLevel level, const std::uint16_t* p, double y, double z, double x0, double dx, int count, float* out) {
+	dispatchRow(level, p, y, z, x0, dx, count, out);
+}
+
+void perlinRow(SimdLevel level, const std::uint8_t* p, float y, float z, float x0, float dx, int count, float* out) {
+	dispatchRow(level, p, y, z, x0, dx, count, out);
+}
+
+void perlinRow(SimdLevel level, const std::uint16_t* p, float y, float z, float x0, float dx, int count, float* out) {
+	dispatchRow(level, p, y, z, x0, dx, count, out);
+}
+
+void perlinDerivativeRow(SimdLevel level, const int* p, double y, double z, double x0, double dx, int count,
+	float* value, float* dX, float* dY) {
+	if (level == SimdLevel::AVX2)
+		perlinDerivativeRowAVX2(p, y, z, x0, dx, count, value, dX, dY);
+	else
+		perlinDerivativeRowScalar(p, y, z, x0, dx, count, value, dX, dY);
+}
+
+void perlinPoints(SimdLevel level, const int* p, double z, const double* x, const double* y, int count, float* out) {
+	if (level == SimdLevel::AVX2)
+		perlinPointsAVX2(p, z, x, y, count, out);
+	else
+		perlinPointsScalar(p, z, x, y, count, out);
+}
@@ -0,0 +1,40 @@
+// Row kernels behind PerlinNoise::noiseRow. Every kernel evaluates exactly the
+// same double precision operations as PerlinNoise::noise, in the same order,
+// so out[i] == (float)noise(x0 + dx * i, y, z)
+#pragma once
+
+#include "Simd.h"
+#include <cstdint>
+
+// p is the 512 entry (duplicated) permutation table
+void perlinRowScalar(const int* p, double y, double z, double x0, double dx, int count, float* out);
+void perlinRowSSE41(const int* p, double y, double z, double x0, double dx, int count, float* out);
+void perlinRowAVX2(const int* p, double y, double z, double x0, double dx, int count, float* out);
+
+// Run the kernel for the given level, falling back to the next lower one if it
+// is not compiled in on this platform
+void perlinRow(SimdLevel level, const int* p, double y, double z, double x0, double dx, int count, float* out);
+// The same over byte and 16-bit permutation tables (BasicPerlinNoise)
+void perlinRow(SimdLevel level, const std::uint8_t* p, double y, double z, double x0, double dx, int count, float* out);
+void perlinRow(SimdLevel level, const std::uint16_t* p, double y, double z, double x0, double dx, int count, float* out);
+// Single precision: the same operations in float, twice the lanes per vector.
+// out[i] == BasicPerlinNoise<float, Index>::noise(x0 + dx * i, y, z)
+void perlinRow(SimdLevel level, const std::uint8_t* p, float y, float z, float x0, float dx, int count, float* out);
+void perlinRow(SimdLevel level, const std::uint16_t* p, float y, float z, float x0, float dx, int count, float* out);
+
+// Rows of PerlinNoise::noiseDerivative: value[i] and the derivatives along x
+// and y, from the same operations in the same order, rounded to float. There
+// is no SSE4.1 derivative kernel; that level runs the scalar one
+void perlinDerivativeRowScalar(const int* p, double y, double z, double x0, double dx, int count,
+	float* value, float* dX, float* dY);
+void perlinDerivativeRowAVX2(const int* p, double y, double z, double x0, double dx, int count,
+	float* value, float* dX, float* dY);
+void perlinDerivativeRow(SimdLevel level, const int* p, double y, double z, double x0, double dx, int count,
+	float* value, float* dX, float* dY);
+
+// Samples at scattered points of one z slice, e.g. domain-warped coordinates:
+// out[i] == (float)PerlinNoise::noise(x[i], y[i], z). Like the derivative
+// rows there is no SSE4.1 kernel
+void perlinPointsScalar(const int* p, double z, const double* x, const double* y, int count, float* out);
+void perlinPointsAVX2(const int* p, double z, const double* x, const double* y, int count, float* out);
+void perlinPoints(SimdLevel level, const int* p, double z, const double* x, const double* y, int count, float* out);
@@ -0,0 +1,62 @@
+#include "NoiseSource.h"
+#include <cstdint>
+#include <new>
+
+using namespace std;
+
+const char* noiseTypeName(NoiseType type) {
+	switch (type) {
+	case NoiseType::Perlin3DFloat:
+		return "perlin3d-float";
+	case NoiseType::Perlin2D:
+		return "perlin2d";
+	case NoiseType::Simplex2D:
+		return "simplex2d";
+	case NoiseType::Simplex3D:
+		return "simplex3d";
+	default:
+		return "perlin3d";
+	}
+}
+
+int noiseCorners(NoiseType type) {
+	switch (type) {
+	case NoiseType::Perlin2D:
+		return 4;
+	case NoiseType::Simplex2D:
+		return 3;
+	case NoiseType::Simplex3D:
+		return 4;
+	default:
+		return 8;
+	}
+}
+
+void* allocateAligned(size_t size, size_t alignment) {
+	// The block starts with room for the padding and the pointer to free
+	char* raw = (char*)::operator new(size + alignment + sizeof(void*));
+	uintptr_t start = (uintptr_t)(raw + sizeof(void*));
+	char* aligned = (char*)((start + alignment - 1) & ~(uintptr_t)(alignment - 1));
+	((void**)aligned)[-1] = raw;
+	return aligned;
+}
+
+void freeAligned(void* block) {
+	if (block)
+		::operator delete(((void**)block)[-1]);
+}
+
+unique_ptr<NoiseSource> makeNoise(NoiseType type, unsigned int seed) {
+	switch (type) {
+	case NoiseType::Perlin3DFloat:
+		return unique_ptr<NoiseSource>(new NoiseBackend<PerlinNoiseF, NoiseType::Perlin3DFloat>(seed));
+	case NoiseType::Perlin2D:
+		return unique_ptr<NoiseSource>(new NoiseBackend<PerlinNoise2D, NoiseType::Perlin2D>(seed));
+	case NoiseType::Simplex2D:
+		return unique_ptr<NoiseSource>(new NoiseBackend<SimplexNoise2D, NoiseType::Simplex2D>(seed));
+	case NoiseType::Simplex3D:
+		return unique_ptr<NoiseSource>(new NoiseBackend<SimplexNoise3D, NoiseType::Simplex3D>(seed));
+	default:
+		return unique_ptr<NoiseSource>(new NoiseBackend<PerlinNoise, NoiseType::Perlin3D>(seed));
+	}
+}
@@ -0,0 +1,80 @@
+// Noise backends behind one interface. A backend is picked at runtime through
+// NoiseSource, whose virtual calls work on whole rows; the loop over a row is
+// a template instantiated for the concrete backend, so it calls the sample
+// function directly and inlines it
+#pragma once
+
+#include "PerlinNoise.h"
+#include "BasicPerlinNoise.h"
+#include "PerlinNoise2D.h"
+#include "SimplexNoise.h"
+#include <cstddef>
+#include <memory>
+
+enum class NoiseType {
+	// Classic 3D Perlin noise (PerlinNoise), 8 corners per sample
+	Perlin3D,
+	// The same in single precision (PerlinNoiseF), twice the vector lanes
+	Perlin3DFloat,
+	// Classic Perlin noise on the x-y plane, 4 corners
+	Perlin2D,
+	// Simplex noise, 3 corners in 2D and 4 in 3D
+	Simplex2D,
+	Simplex3D
+};
+
+const char* noiseTypeName(NoiseType type);
+// Corners blended per sample, i.e. gradient evaluations
+int noiseCorners(NoiseType type);
+
+// Fill out[i] with noise.noise(x0 + dx * i, y, z). Works with any type that has
+// a noise(x, y, z) member; the call is resolved at compile time
+template <class Noise>
+void fillNoiseRow(const Noise& noise, double y, double z, double x0, double dx, int count, float* out) {
+	for (int i = 0; i < count; i++)
+		out[i] = (float)noise.noise(x0 + dx * i, y, z);
+}
+
+// PerlinNoise and BasicPerlinNoise have vector row kernels
+inline void fillNoiseRow(const PerlinNoise& noise, double y, double z, double x0, double dx, int count, float* out) {
+	noise.noiseRow(y, z, x0, dx, count, out);
+}
+
+template <class Real, class Index>
+void fillNoiseRow(const BasicPerlinNoise<Real, Index>& noise, double y, double z, double x0, double dx, int count, float* out) {
+	noise.noiseRow((Real)y, (Real)z, (Real)x0, (Real)dx, count, out);
+}
+
+class NoiseSource {
+public:
+	virtual ~NoiseSource() {}
+	virtual NoiseType getType() const = 0;
+	// Value in [0, 1]; 2D backends ignore z
+	virtual double noise(double x, double y, double z) const = 0;
+	// Fill out[i] with noise(x0 + dx * i, y, z) for i < count
+	virtual void noiseRow(double y, double z, double x0, double dx, int count, float* out) const = 0;
+};
+
+// Memory aligned beyond what new guarantees before C++17
+void* allocateAligned(std::size_t size, std::size_t alignment);
+void freeAligned(void* block);
+
+template <class Noise, NoiseType Type>
+class NoiseBackend : public NoiseSource {
+	Noise kernel;
+public:
+	NoiseBackend(unsigned int seed) : kernel(seed) {}
+
+	// Some kernels keep their tables cache-line aligned
+	static void* operator new(std::size_t size) { return allocateAligned(size, alignof(NoiseBackend)); }
+	static void operator delete(void* block) { freeAligned(block); }
+
+	NoiseType getType() const override { return Type; }
+	double noise(double x, double y, double z) const override { return (double)kernel.noise(x, y, z); }
+	void noiseRow(double y, double z, double x0, double dx, int count, float* out) const override {
+		fillNoiseRow(kernel, y, z, x0, dx, count, out);
+	}
+	const Noise& getKernel() const { return kernel; }
+};
+
+std::unique_ptr<NoiseSource> makeNoise(NoiseType type, unsigned int seed);
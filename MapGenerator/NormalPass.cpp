@@ -0,0 +1,219 @@
+#include "NormalPass.h"
+#include "Simd.h"
+#include <cmath>
+#include <algorithm>
+
+// n = normalize((hL - hR) / dx, 1, (hPrev - hNext) / dz), i.e. the surface
+// normal for a y-up heightfield with z growing with the row index
+static inline void normalAt(float dhx, float dhz, float& nx, float& ny, float& nz) {
+	float inv = 1.0f / sqrtf(dhx * dhx + 1.0f + dhz * dhz);
+	nx = dhx * inv;
+	ny = inv;
+	nz = dhz * inv;
+}
+
+static void normalRowScalar(const float* prev, const float* mid, const float* next, int x0, int x1,
+	float invDx, float invDz, float* nx, float* ny, float* nz) {
+	for (int x = x0; x < x1; x++)
+		normalAt((mid[x - 1] - mid[x + 1]) * invDx, (prev[x] - next[x]) * invDz, nx[x], ny[x], nz[x]);
+}
+
+static void normalRowScalarXYZ(const float* prev, const float* mid, const float* next, int x0, int x1,
+	float invDx, float invDz, float* xyz) {
+	for (int x = x0; x < x1; x++)
+		normalAt((mid[x - 1] - mid[x + 1]) * invDx, (prev[x] - next[x]) * invDz, xyz[3 * x], xyz[3 * x + 1], xyz[3 * x + 2]);
+}
+
+#if defined(MAPGEN_X86)
+
+MAPGEN_TARGET_SSE41 static int normalRowSSE41(const float* prev, const float* mid, const float* next, int x0, int x1,
+	float invDx, float invDz, float* nx, float* ny, float* nz) {
+	const __m128 vdx = _mm_set1_ps(invDx), vdz = _mm_set1_ps(invDz), one = _mm_set1_ps(1.0f);
+	int x = x0;
+	for (; x + 4 <= x1; x += 4) {
+		__m128 dhx = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(mid + x - 1), _mm_loadu_ps(mid + x + 1)), vdx);
+		__m128 dhz = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(prev + x), _mm_loadu_ps(next + x)), vdz);
+		__m128 len = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(dhx, dhx), one), _mm_mul_ps(dhz, dhz)));
+		__m128 inv = _mm_div_ps(one, len);
+		_mm_storeu_ps(nx + x, _mm_mul_ps(dhx, inv));
+		_mm_storeu_ps(ny + x, inv);
+		_mm_storeu_ps(nz + x, _mm_mul_ps(dhz, inv));
+	}
+	return x;
+}
+
+// Four normals from x, y and z vectors to x0 y0 z0 x1 y1 z1 ... at dst
+MAPGEN_TARGET_SSE41 static inline void storeXYZ(float* dst, __m128 x, __m128 y, __m128 z) {
+	__m128 xy0 = _mm_unpacklo_ps(x, y), xy1 = _mm_unpackhi_ps(x, y);
+	__m128 yz0 = _mm_unpacklo_ps(y, z), yz1 = _mm_unpackhi_ps(y, z);
+	__m128 zx0 = _mm_unpacklo_ps(z, x), zx1 = _mm_unpackhi_ps(z, x);
+	_mm_storeu_ps(dst, _mm_shuffle_ps(xy0, zx0, _MM_SHUFFLE(3, 0, 1, 0)));
+	_mm_storeu_ps(dst + 4, _mm_shuffle_ps(yz0, xy1, _MM_SHUFFLE(1, 0, 3, 2)));
+	_mm_storeu_ps(dst + 8, _mm_shuffle_ps(zx1, yz1, _MM_SHUFFLE(3, 2, 3, 0)));
+}
+
+MAPGEN_TARGET_SSE41 static int normalRowSSE41XYZ(const float* prev, const float* mid, const float* next, int x0, int x1,
+	float invDx, float invDz, float* xyz) {
+	const __m128 vdx = _mm_set1_ps(invDx), vdz = _mm_set1_ps(invDz), one = _mm_set1_ps(1.0f);
+	int x = x0;
+	for (; x + 4 <= x1; x += 4) {
+		__m128 dhx = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(mid + x - 1), _mm_loadu_ps(mid + x + 1)), vdx);
+		__m128 dhz = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(prev + x), _mm_loadu_ps(next + x)), vdz);
+		__m128 len = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(dhx, dhx), one), _mm_mul_ps(dhz, dhz)));
+		__m128 inv = _mm_div_ps(one, len);
+		storeXYZ(xyz + 3 * x, _mm_mul_ps(dhx, inv), inv, _mm_mul_ps(dhz, inv));
+	}
+	return x;
+}
+
+MAPGEN_TARGET_AVX2 static int normalRowAVX2XYZ(const float* prev, const float* mid, const float* next, int x0, int x1,
+	float invDx, float invDz, float* xyz) {
+	const __m256 vdx = _mm256_set1_ps(invDx), vdz = _mm256_set1_ps(invDz), one = _mm256_set1_ps(1.0f);
+	int x = x0;
+	for (; x + 8 <= x1; x += 8) {
+		__m256 dhx = _mm256_mul_ps(_mm256_sub_ps(_mm256_loadu_ps(mid + x - 1), _mm256_loadu_ps(mid + x + 1)), vdx);
+		__m256 dhz = _mm256_mul_ps(_mm256_sub_ps(_mm256_loadu_ps(prev + x), _mm256_loadu_ps(next + x)), vdz);
+		__m256 len = _mm256_sqrt_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(dhx, dhx), one), _mm256_mul_ps(dhz, dhz)));
+		__m256 inv = _mm256_div_ps(one, len);
+		__m256 nx = _mm256_mul_ps(dhx, inv), nz = _mm256_mul_ps(dhz, inv);
+		storeXYZ(xyz + 3 * x, _mm256_castps256_ps128(nx), _mm256_castps256_ps128(inv), _mm256_castps256_ps128(nz));
+		storeXYZ(xyz + 3 * x + 12, _mm256_extractf128_ps(nx, 1), _mm256_extractf128_ps(inv, 1), _mm256_extractf128_ps(nz, 1));
+	}
+	return x;
+}
+
+MAPGEN_TARGET_AVX2 static int normalRowAVX2(const float* prev, const float* mid, const float* next, int x0, int x1,
+	float invDx, float invDz, float* nx, float* ny, float* nz) {
+	const __m256 vdx = _mm256_set1_ps(invDx), vdz = _mm256_set1_ps(invDz), one = _mm256_set1_ps(1.0f);
+	int x = x0;
+	for (; x + 8 <= x1; x += 8) {
+		__m256 dhx = _mm256_mul_ps(_mm256_sub_ps(_mm256_loadu_ps(mid + x - 1), _mm256_loadu_ps(mid + x + 1)), vdx);
+		__m256 dhz = _mm256_mul_ps(_mm256_sub_ps(_mm256_loadu_ps(prev + x), _mm256_loadu_ps(next + x)), vdz);
+		__m256 len = _mm256_sqrt_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(dhx, dhx), one), _mm256_mul_ps(dhz, dhz)));
+		__m256 inv = _mm256_div_ps(one, len);
+		_mm256_storeu_ps(nx + x, _mm256_mul_ps(dhx, inv));
+		_mm256_storeu_ps(ny + x, inv);
+		_mm256_storeu_ps(nz + x, _mm256_mul_ps(dhz, inv));
+	}
+	return x;
+}
+
+#endif
+
+void computeNormalRow(const float* prev, const float* mid, const float* next, int width,
+	float spacing, float invDz, float* nx, float* ny, float* nz) {
+	if (width <= 0)
+		return;
+	if (width == 1) {
+		normalAt(0.0f, (prev[0] - next[0]) * invDz, nx[0], ny[0], nz[0]);
+		return;
+	}
+
+	// One-sided differences on the first and last column
+	float invSpacing = 1.0f / spacing;
+	normalAt((mid[0] - mid[1]) * invSpacing, (prev[0] - next[0]) * invDz, nx[0], ny[0], nz[0]);
+	int last = width - 1;
+	normalAt((mid[last - 1] - mid[last]) * invSpacing, (prev[last] - next[last]) * invDz, nx[last], ny[last], nz[last]);
+
+	float invDx = 0.5f * invSpacing;
+	int x = 1;
+#if defined(MAPGEN_X86)
+	SimdLevel level = detectSimdLevel();
+	if (level == SimdLevel::AVX2)
+		x = normalRowAVX2(prev, mid, next, x, last, invDx, invDz, nx, ny, nz);
+	if (level >= SimdLevel::SSE41)
+		x = normalRowSSE41(prev, mid, next, x, last, invDx, invDz, nx, ny, nz);
+#endif
+	normalRowScalar(prev, mid, next, x, last, invDx, invDz, nx, ny, nz);
+}
+
+void computeNormalRow(const float* prev, const float* mid, const float* next, int width,
+	float spacing, float invDz, float* xyz) {
+	if (width <= 0)
+		return;
+	if (width == 1) {
+		normalAt(0.0f, (prev[0] - next[0]) * invDz, xyz[0], xyz[1], xyz[2]);
+		return;
+	}
+
+	float invSpacing = 1.0f / spacing;
+	normalAt((mid[0] - mid[1]) * invSpacing, (prev[0] - next[0]) * invDz, xyz[0], xyz[1], xyz[2]);
+	int last = width - 1;
+	normalAt((mid[last - 1] - mid[last]) * invSpacing, (prev[last] - next[last]) * invDz,
+		xyz[3 * last], xyz[3 * last + 1], xyz[3 * last + 2]);
+
+	float invDx = 0.5f * invSpacing;
+	int x = 1;
+#if defined(MAPGEN_X86)
+	SimdLevel level = detectSimdLevel();
+	if (level == SimdLevel::AVX2)
+		x = normalRowAVX2XYZ(prev, mid, next, x, last, invDx, invDz, xyz);
+	if (level >= SimdLevel::SSE41)
+		x = normalRowSSE41XYZ(prev, mid, next, x, last, invDx, invDz, xyz);
+#endif
+	normalRowScalarXYZ(prev, mid, next, x, last, invDx, invDz, xyz);
+}
+
+void slopeNormalRow(const float* slopeX, const float* slopeZ, int width, float scale, float* nx, float* ny, float* nz) {
+	for (int x = 0; x < width; x++)
+		normalAt(-slopeX[x] * scale, -slopeZ[x] * scale, nx[x], ny[x], nz[x]);
+}
+
+void computeNormals(const HeightGrid& heights, float spacing, std::vector<float>& normals, ThreadPool& pool) {
+	int width = heights.width, height = heights.height;
+	normals.resize((size_t)width * height * 3);
+
+	const int band = 32;
+	int bands = (height + band - 1) / band;
+	pool.parallelFor(0, bands, [&](int b) {
+		int z1 = std::min(height, (b + 1) * band);
+		for (int z = b * band; z < z1; z++) {
+			int zp = std::max(z - 1, 0), zn = std::min(z + 1, height - 1);
+			float invDz = zn > zp ? 1.0f / (spacing * (zn - zp)) : 0.0f;
+			computeNormalRow(heights.row(zp), heights.row(z), heights.row(zn), width, spacing, invDz, &normals[(size_t)z * width * 3]);
+		}
+	});
+}
+
+static inline std::uint32_t toSnorm16(float v) {
+	v = std::min(std::max(v, -1.0f), 1.0f);
+	return (std::uint32_t)(std::uint16_t)(std::int16_t)lrintf(v * 32767.0f);
+}
+
+static inline float fromSnorm16(std::uint32_t v) {
+	return std::max((float)(std::int16_t)(std::uint16_t)v / 32767.0f, -1.0f);
+}
+
+static inline float signNotZero(float v) {
+	return v >= 0.0f ? 1.0f : -1.0f;
+}
+
+std::uint32_t packOctahedral(float nx, float ny, float nz) {
+	// Project onto the octahedron |x| + |y| + |z| = 1 and unfold the lower
+	// half (y < 0) over the upper one; the 2D coordinates are (x, z)
+	float l1 = fabsf(nx) + fabsf(ny) + fabsf(nz);
+	float u = nx / l1, v = nz / l1;
+	if (ny < 0.0f) {
+		float fu = (1.0f - fabsf(v)) * signNotZero(u);
+		float fv = (1.0f - fabsf(u)) * signNotZero(v);
+		u = fu;
+		v = fv;
+	}
+	return toSnorm16(u) | toSnorm16(v) << 16;
+}
+
+void unpackOctahedral(std::uint32_t packed, float& nx, float& ny, float& nz) {
+	float u = fromSnorm16(packed & 0xffff);
+	float v = fromSnorm16(packed >> 16);
+	float y = 1.0f - fabsf(u) - fabsf(v);
+	if (y < 0.0f) {
+		float fu = (1.0f - fabsf(v)) * signNotZero(u);
+		float fv = (1.0f - fabsf(u)) * signNotZero(v);
+		u = fu;
+		v = fv;
+	}
+	float inv = 1.0f / sqrtf(u * u + y * y + v * v);
+	nx = u * inv;
+	ny = y * inv;
+	nz = v * inv;
+}
@@ -0,0 +1,32 @@
+// Vertex normals of a heightfield from central differences, one row at a time
+// with vector kernels. Edge samples clamp to the map and use one-sided
+// differences, so borders keep their real slope instead of dropping to 0
+#pragma once
+
+#include "HeightGrid.h"
+#include "ThreadPool.h"
+#include <cstdint>
+#include <vector>
+
+// Normalized normals of row mid (world heights) into the nx/ny/nz arrays.
+// prev and next are the neighbouring rows, or mid itself past the map edge;
+// invDz is 1 / the world distance between prev and next, spacing the world
+// distance between samples along the row
+void computeNormalRow(const float* prev, const float* mid, const float* next, int width,
+	float spacing, float invDz, float* nx, float* ny, float* nz);
+// Same normals written interleaved, x y z per sample, straight into xyz
+void computeNormalRow(const float* prev, const float* mid, const float* next, int width,
+	float spacing, float invDz, float* xyz);
+
+// Normalized normals from exact derivatives instead of neighbouring rows:
+// slopeX and slopeZ are d value / d sample along and across the row, scale
+// turns them into world height per world unit
+void slopeNormalRow(const float* slopeX, const float* slopeZ, int width, float scale, float* nx, float* ny, float* nz);
+
+// All normals of a grid of world heights, 3 floats per sample
+void computeNormals(const HeightGrid& heights, float spacing, std::vector<float>& normals, ThreadPool& pool);
+
+// Octahedral encoding of a unit normal as two snorm16 values (x in the low
+// half); 4 bytes instead of 12, with under 0.01 degree of error
+std::uint32_t packOctahedral(float nx, float ny, float nz);
+void unpackOctahedral(std::uint32_t packed, float& nx, float& ny, float& nz);
@@ -1,6 +1,7 @@
 #include "PerlinNoise.h"
+#include "NoiseKernels.h"
+#include "Random.h"
 #include <cmath>
-#include <random>
 #include <algorithm>
 #include <numeric>
 
@@ -8,19 +9,7 @@
 PerlinNoise::PerlinNoise() {
 
 	// Initialize the permutation vector with the reference values
-	p = {
-		151,160,137,91,90,15,131,13,201,95,96,53,194,233,7,225,140,36,103,30,69,142,
-		8,99,37,240,21,10,23,190, 6,148,247,120,234,75,0,26,197,62,94,252,219,203,117,
-		35,11,32,57,177,33,88,237,149,56,87,174,20,125,136,171,168, 68,175,74,165,71,
-		134,139,48,27,166,77,146,158,231,83,111,229,122,60,211,133,230,220,105,92,41,
-		55,46,245,40,244,102,143,54, 65,25,63,161,1,216,80,73,209,76,132,187,208, 89,
-		18,169,200,196,135,130,116,188,159,86,164,100,109,198,173,186, 3,64,52,217,226,
-		250,124,123,5,202,38,147,118,126,255,82,85,212,207,206,59,227,47,16,58,17,182,
-		189,28,42,223,183,170,213,119,248,152, 2,44,154,163, 70,221,153,101,155,167,
-		43,172,9,129,22,39,253, 19,98,108,110,79,113,224,232,178,185, 112,104,218,246,
-		97,228,251,34,242,193,238,210,144,12,191,179,162,241, 81,51,145,235,249,14,239,
-		107,49,192,214, 31,181,199,106,157,184, 84,204,176,115,121,50,45,127, 4,150,254,
-		138,236,205,93,222,114,67,29,24,72,243,141,128,195,78,66,215,61,156,180 };
+	p.assign(PERLIN_REFERENCE, PERLIN_REFERENCE + 256);
 	// Duplicate the permutation vector
 	p.insert(p.end(), p.begin(), p.end());
 }
@@ -32,17 +21,16 @@ PerlinNoise::PerlinNoise(unsigned int seed) {
 	// Fill p with values from 0 to 255
 	std::iota(p.begin(), p.end(), 0);
 
-	// Initialize a random engine with seed
-	std::default_random_engine engine(seed);
-
-	// Suffle  using the above random engine
-	std::shuffle(p.begin(), p.end(), engine);
+	// Shuffle with a fully specified generator, so a seed gives the same map
+	// on every platform
+	Pcg32 rng(seed);
+	portableShuffle(p.data(), 256, rng);
 
 	// Duplicate the permutation vector
 	p.insert(p.end(), p.begin(), p.end());
 }
 
-double PerlinNoise::noise(double x, double y, double z) {
+double PerlinNoise::noise(double x, double y, double z) const {
 	// Find the unit cube that contains the point
 	int X = (int)floor(x) & 255;
 	int Y = (int)floor(y) & 255;
@@ -71,18 +59,155 @@ double PerlinNoise::noise(double x, double y, double z) {
 	return (res + 1.0) / 2.0;
 }
 
-double PerlinNoise::fade(double t) {
+int PerlinNoise::wrapWide(long long lattice) const {
+	// Every block of 256 lattice points gets its own shift of the permutation,
+	// taken from a 64-bit mix of the block number. Block 0 has no shift
+	unsigned long long block = (unsigned long long)(lattice >> 8);
+	block ^= block >> 33;
+	block *= 0xff51afd7ed558ccdULL;
+	block ^= block >> 33;
+	block *= 0xc4ceb9fe1a85ec53ULL;
+	block ^= block >> 33;
+	return (int)((lattice + (long long)block) & 255);
+}
+
+double PerlinNoise::noiseWide(double x, double y, double z) const {
+	double fx = floor(x), fy = floor(y), fz = floor(z);
+	long long X = (long long)fx, Y = (long long)fy, Z = (long long)fz;
+	x -= fx;
+	y -= fy;
+	z -= fz;
+
+	double u = fade(x);
+	double v = fade(y);
+	double w = fade(z);
+
+	// The corners at X + 1 etc. may fall in the next block, so every corner
+	// coordinate is wrapped on its own rather than through p[X + 1]
+	int X0 = wrapWide(X), X1 = wrapWide(X + 1);
+	int Y0 = wrapWide(Y), Y1 = wrapWide(Y + 1);
+	int Z0 = wrapWide(Z), Z1 = wrapWide(Z + 1);
+	int A0 = p[p[X0] + Y0], A1 = p[p[X0] + Y1];
+	int B0 = p[p[X1] + Y0], B1 = p[p[X1] + Y1];
+
+	double res = lerp(w, lerp(v, lerp(u, grad(p[A0 + Z0], x, y, z), grad(p[B0 + Z0], x - 1, y, z)), lerp(u, grad(p[A1 + Z0], x, y - 1, z), grad(p[B1 + Z0], x - 1, y - 1, z))), lerp(v, lerp(u, grad(p[A0 + Z1], x, y, z - 1), grad(p[B0 + Z1], x - 1, y, z - 1)), lerp(u, grad(p[A1 + Z1], x, y - 1, z - 1), grad(p[B1 + Z1], x - 1, y - 1, z - 1))));
+	return (res + 1.0) / 2.0;
+}
+
+NoiseSample PerlinNoise::noiseDerivative(double x, double y, double z) const {
+	int X = (int)floor(x) & 255;
+	int Y = (int)floor(y) & 255;
+	int Z = (int)floor(z) & 255;
+	x -= floor(x);
+	y -= floor(y);
+	z -= floor(z);
+
+	int A = p[X] + Y;
+	int AA = p[A] + Z;
+	int AB = p[A + 1] + Z;
+	int B = p[X + 1] + Y;
+	int BA = p[B] + Z;
+	int BB = p[B + 1] + Z;
+	int hash[8] = { p[AA], p[BA], p[AB], p[BB], p[AA + 1], p[BA + 1], p[AB + 1], p[BB + 1] };
+	return blendDerivative(hash, x, y, z);
+}
+
+NoiseSample PerlinNoise::noiseWideDerivative(double x, double y, double z) const {
+	double fx = floor(x), fy = floor(y), fz = floor(z);
+	long long X = (long long)fx, Y = (long long)fy, Z = (long long)fz;
+	x -= fx;
+	y -= fy;
+	z -= fz;
+
+	int X0 = wrapWide(X), X1 = wrapWide(X + 1);
+	int Y0 = wrapWide(Y), Y1 = wrapWide(Y + 1);
+	int Z0 = wrapWide(Z), Z1 = wrapWide(Z + 1);
+	int A0 = p[p[X0] + Y0], A1 = p[p[X0] + Y1];
+	int B0 = p[p[X1] + Y0], B1 = p[p[X1] + Y1];
+	int hash[8] = { p[A0 + Z0], p[B0 + Z0], p[A1 + Z0], p[B1 + Z0], p[A0 + Z1], p[B0 + Z1], p[A1 + Z1], p[B1 + Z1] };
+	return blendDerivative(hash, x, y, z);
+}
+
+NoiseSample PerlinNoise::blendDerivative(const int* hash, double x, double y, double z) const {
+	double u = fade(x);
+	double v = fade(y);
+	double w = fade(z);
+
+	double a = grad(hash[0], x, y, z);
+	double b = grad(hash[1], x - 1, y, z);
+	double c = grad(hash[2], x, y - 1, z);
+	double d = grad(hash[3], x - 1, y - 1, z);
+	double e = grad(hash[4], x, y, z - 1);
+	double f = grad(hash[5], x - 1, y, z - 1);
+	double g = grad(hash[6], x, y - 1, z - 1);
+	double h = grad(hash[7], x - 1, y - 1, z - 1);
+	// Same operations in the same order as noise()
+	double res = lerp(w, lerp(v, lerp(u, a, b), lerp(u, c, d)), lerp(v, lerp(u, e, f), lerp(u, g, h)));
+
+	// Every corner term is linear, so the blend of the corner gradients is the
+	// derivative at fixed weights; the rest comes from the fade curves
+	double gx[8], gy[8], gz[8];
+	for (int i = 0; i < 8; i++)
+		gradVector(hash[i], gx[i], gy[i], gz[i]);
+	auto blend = [&](const double* k) {
+		return lerp(w, lerp(v, lerp(u, k[0], k[1]), lerp(u, k[2], k[3])), lerp(v, lerp(u, k[4], k[5]), lerp(u, k[6], k[7])));
+	};
+
+	// fade'(t) = 30 t^2 (t - 1)^2
+	double du = 30.0 * x * x * (x - 1.0) * (x - 1.0);
+	double dv = 30.0 * y * y * (y - 1.0) * (y - 1.0);
+	double dw = 30.0 * z * z * (z - 1.0) * (z - 1.0);
+
+	// res = k0 + k1 u + k2 v + k3 w + k4 uv + k5 vw + k6 wu + k7 uvw
+	double k1 = b - a, k2 = c - a, k3 = e - a;
+	double k4 = a - b - c + d, k5 = a - c - e + g, k6 = a - b - e + f;
+	double k7 = -a + b + c - d + e - f - g + h;
+
+	NoiseSample sample;
+	sample.value = (res + 1.0) / 2.0;
+	sample.dx = 0.5 * (blend(gx) + du * (k1 + k4 * v + k6 * w + k7 * v * w));
+	sample.dy = 0.5 * (blend(gy) + dv * (k2 + k4 * u + k5 * w + k7 * u * w));
+	sample.dz = 0.5 * (blend(gz) + dw * (k3 + k5 * v + k6 * u + k7 * u * v));
+	return sample;
+}
+
+void PerlinNoise::noiseRow(double y, double z, double x0, double dx, int count, float* out) const {
+	perlinRow(detectSimdLevel(), p.data(), y, z, x0, dx, count, out);
+}
+
+void PerlinNoise::noiseRow(double y, double z, double x0, double dx, int count, float* out, SimdLevel level) const {
+	perlinRow(level, p.data(), y, z, x0, dx, count, out);
+}
+
+void PerlinNoise::noiseDerivativeRow(double y, double z, double x0, double dx, int count, float* value, float* dX, float* dY) const {
+	perlinDerivativeRow(detectSimdLevel(), p.data(), y, z, x0, dx, count, value, dX, dY);
+}
+
+void PerlinNoise::noisePoints(double z, const double* x, const double* y, int count, float* out) const {
+	perlinPoints(detectSimdLevel(), p.data(), z, x, y, count, out);
+}
+
+double PerlinNoise::fade(double t) const {
 	return t * t * t * (t * (t * 6 - 15) + 10);
 }
 
-double PerlinNoise::lerp(double t, double a, double b) {
+double PerlinNoise::lerp(double t, double a, double b) const {
 	return a + t * (b - a);
 }
 
-double PerlinNoise::grad(int hash, double x, double y, double z) {
+double PerlinNoise::grad(int hash, double x, double y, double z) const {
 	int h = hash & 15;
 	// Convert lower 4 bits of hash into 12 gradient directions
 	double u = h < 8 ? x : y,
 		v = h < 4 ? y : h == 12 || h == 14 ? x : z;
 	return ((h & 1) == 0 ? u : -u) + ((h & 2) == 0 ? v : -v);
+}
+
+void PerlinNoise::gradVector(int hash, double& gx, double& gy, double& gz) const {
+	int h = hash & 15;
+	double su = (h & 1) == 0 ? 1.0 : -1.0;
+	double sv = (h & 2) == 0 ? 1.0 : -1.0;
+	gx = gy = gz = 0.0;
+	(h < 8 ? gx : gy) += su;
+	(h < 4 ? gy : h == 12 || h == 14 ? gx : gz) += sv;
 }
\ No newline at end of file
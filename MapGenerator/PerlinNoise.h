@@ -1,22 +1,78 @@
 #include <vector>
+#include <cstdint>
+#include "Simd.h"
 
 #ifndef PERLINNOISE_H
 #define PERLINNOISE_H
 
+// Ken Perlin's reference permutation
+constexpr std::uint8_t PERLIN_REFERENCE[256] = {
+	151,160,137,91,90,15,131,13,201,95,96,53,194,233,7,225,140,36,103,30,69,142,
+	8,99,37,240,21,10,23,190, 6,148,247,120,234,75,0,26,197,62,94,252,219,203,117,
+	35,11,32,57,177,33,88,237,149,56,87,174,20,125,136,171,168, 68,175,74,165,71,
+	134,139,48,27,166,77,146,158,231,83,111,229,122,60,211,133,230,220,105,92,41,
+	55,46,245,40,244,102,143,54, 65,25,63,161,1,216,80,73,209,76,132,187,208, 89,
+	18,169,200,196,135,130,116,188,159,86,164,100,109,198,173,186, 3,64,52,217,226,
+	250,124,123,5,202,38,147,118,126,255,82,85,212,207,206,59,227,47,16,58,17,182,
+	189,28,42,223,183,170,213,119,248,152, 2,44,154,163, 70,221,153,101,155,167,
+	43,172,9,129,22,39,253, 19,98,108,110,79,113,224,232,178,185, 112,104,218,246,
+	97,228,251,34,242,193,238,210,144,12,191,179,162,241, 81,51,145,235,249,14,239,
+	107,49,192,214, 31,181,199,106,157,184, 84,204,176,115,121,50,45,127, 4,150,254,
+	138,236,205,93,222,114,67,29,24,72,243,141,128,195,78,66,215,61,156,180 };
+
+// A noise value and its partial derivatives along x, y and z
+struct NoiseSample {
+	double value;
+	double dx, dy, dz;
+};
+
 class PerlinNoise {
 	// The permutation vector
 	std::vector<int> p;
 public:
 	// Initialize with the reference values for the permutation vector
 	PerlinNoise();
-	// Generate a new permutation vector based on the value of seed
+	// Generate a new permutation vector based on the value of seed; the
+	// permutation is the same with every compiler and standard library
 	PerlinNoise(unsigned int seed);
 	// Get a noise value, for 2D images z can have any value
-	double noise(double x, double y, double z);
+	double noise(double x, double y, double z) const;
+	// Fill out[i] with noise(x0 + dx * i, y, z) for i < count, using the widest
+	// vector kernel the CPU supports. Values equal (float)noise(...): the kernels
+	// evaluate the same double operations, so the only error is the final
+	// rounding to float (at most 3e-8 on the [0, 1] output)
+	void noiseRow(double y, double z, double x0, double dx, int count, float* out) const;
+	// Same as above with an explicit kernel, mainly for benchmarks
+	void noiseRow(double y, double z, double x0, double dx, int count, float* out, SimdLevel level) const;
+	// noise() without the 256 unit period, for worlds of any size: lattice
+	// coordinates are 64-bit and their bits above the low 8 are hashed into the
+	// permutation index. Equals noise() for coordinates in [0, 255) and costs
+	// about as much, but has no vector kernel
+	double noiseWide(double x, double y, double z) const;
+	// noise() with its analytic derivatives, from the same eight corners in one
+	// evaluation. The value is bit-identical to noise()
+	NoiseSample noiseDerivative(double x, double y, double z) const;
+	// noiseWide() with its analytic derivatives
+	NoiseSample noiseWideDerivative(double x, double y, double z) const;
+	// Rows of noiseDerivative(x0 + dx * i, y, z): the value and the derivatives
+	// along x and y, as floats, with the widest kernel available
+	void noiseDerivativeRow(double y, double z, double x0, double dx, int count, float* value, float* dX, float* dY) const;
+	// Fill out[i] with (float)noise(x[i], y[i], z): points anywhere on one z
+	// slice, for warped coordinates that don't lie on a row
+	void noisePoints(double z, const double* x, const double* y, int count, float* out) const;
+	// The 512 entry (duplicated) permutation, shared with the other backends
+	const std::vector<int>& getPermutation() const { return p; }
 private:
-	double fade(double t);
-	double lerp(double t, double a, double b);
-	double grad(int hash, double x, double y, double z);
+	double fade(double t) const;
+	double lerp(double t, double a, double b) const;
+	double grad(int hash, double x, double y, double z) const;
+	// The gradient direction grad() takes the dot product with
+	void gradVector(int hash, double& gx, double& gy, double& gz) const;
+	// Blend the corners of the unit cube whose hashes are given in the order
+	// 000, 100, 010, 110, 001, 101, 011, 111 (x, y, z), with derivatives
+	NoiseSample blendDerivative(const int* hash, double x, double y, double z) const;
+	// Permutation index of a 64-bit lattice coordinate
+	int wrapWide(long long lattice) const;
 };
 
 #endif
\ No newline at end of file
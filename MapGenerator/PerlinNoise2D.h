@@ -0,0 +1,51 @@
+// Classic Perlin noise on a plane: 4 corners and 3 lerps per sample instead
+// of the 8 corners and 7 lerps of PerlinNoise sliced at a constant z. Header
+// only, so the templated row loops of NoiseSource.h inline it
+#pragma once
+
+#include "PerlinNoise.h"
+#include <cmath>
+#include <vector>
+
+class PerlinNoise2D {
+	// The permutation vector, 512 entries
+	std::vector<int> p;
+public:
+	// Same permutation as PerlinNoise(seed)
+	PerlinNoise2D(unsigned int seed) : p(PerlinNoise(seed).getPermutation()) {}
+
+	// Value in [0, 1]; z is ignored
+	double noise(double x, double y, double z = 0.0) const {
+		(void)z;
+		double fx = floor(x), fy = floor(y);
+		int X = (int)fx & 255;
+		int Y = (int)fy & 255;
+		x -= fx;
+		y -= fy;
+
+		double u = fade(x);
+		double v = fade(y);
+		int A = p[X] + Y;
+		int B = p[X + 1] + Y;
+		double res = lerp(v, lerp(u, grad(p[A], x, y), grad(p[B], x - 1, y)), lerp(u, grad(p[A + 1], x, y - 1), grad(p[B + 1], x - 1, y - 1)));
+		return (res + 1.0) / 2.0;
+	}
+private:
+	static double fade(double t) {
+		return t * t * t * (t * (t * 6 - 15) + 10);
+	}
+
+	static double lerp(double t, double a, double b) {
+		return a + t * (b - a);
+	}
+
+	// Eight directions: the four diagonals and the four axes. With them the
+	// value stays within [-1, 1]
+	static double grad(int hash, double x, double y) {
+		int h = hash & 7;
+		if (h < 4)
+			return ((h & 1) == 0 ? x : -x) + ((h & 2) == 0 ? y : -y);
+		double u = (h & 1) == 0 ? x : y;
+		return (h & 2) == 0 ? u : -u;
+	}
+};
@@ -0,0 +1,70 @@
+// Small random number generators whose output is fully specified, so a seed
+// gives the same sequence with every compiler and standard library (the
+// engines of <random> are specified, but the distributions and std::shuffle
+// are not)
+#pragma once
+
+#include <cstdint>
+#include <utility>
+
+// SplitMix64: one 64-bit add and a mix per value. Good for turning a small
+// seed into well spread state for another generator
+class SplitMix64 {
+	std::uint64_t state;
+public:
+	explicit SplitMix64(std::uint64_t seed) : state(seed) {}
+
+	std::uint64_t next() {
+		std::uint64_t z = (state += 0x9e3779b97f4a7c15ULL);
+		z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+		z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+		return z ^ (z >> 31);
+	}
+};
+
+// PCG32 (XSH RR): 64-bit LCG state, 32-bit output
+class Pcg32 {
+	std::uint64_t state;
+	std::uint64_t increment;
+public:
+	// State and stream both come from SplitMix64(seed)
+	explicit Pcg32(std::uint64_t seed) {
+		SplitMix64 mix(seed);
+		std::uint64_t initial = mix.next();
+		increment = (mix.next() << 1) | 1;
+		state = 0;
+		next();
+		state += initial;
+		next();
+	}
+
+	std::uint32_t next() {
+		std::uint64_t old = state;
+		state = old * 6364136223846793005ULL + increment;
+		std::uint32_t xorShifted = (std::uint32_t)(((old >> 18) ^ old) >> 27);
+		std::uint32_t rotation = (std::uint32_t)(old >> 59);
+		return (xorShifted >> rotation) | (xorShifted << ((32 - rotation) & 31));
+	}
+
+	// Uniform in [0, bound) without modulo bias (Lemire's multiply and reject)
+	std::uint32_t bounded(std::uint32_t bound) {
+		std::uint64_t m = (std::uint64_t)next() * bound;
+		std::uint32_t low = (std::uint32_t)m;
+		if (low < bound) {
+			std::uint32_t threshold = (0u - bound) % bound;
+			while (low < threshold) {
+				m = (std::uint64_t)next() * bound;
+				low = (std::uint32_t)m;
+			}
+		}
+		return (std::uint32_t)(m >> 32);
+	}
+};
+
+// Fisher-Yates from the back, one bounded() per element: the same permutation
+// everywhere for the same generator state
+template <class T>
+void portableShuffle(T* first, int count, Pcg32& rng) {
+	for (int i = count - 1; i > 0; i--)
+		std::swap(first[i], first[rng.bounded((std::uint32_t)i + 1)]);
+}
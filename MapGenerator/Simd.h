@@ -0,0 +1,28 @@
+// Runtime selection of the instruction set used by the vectorized kernels
+#pragma once
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define MAPGEN_X86 1
+#include <immintrin.h>
+#endif
+
+// Functions using AVX2/SSE4.1 intrinsics must be tagged so that GCC/Clang
+// emit them without raising the baseline of the whole program; MSVC allows
+// intrinsics everywhere
+#if defined(MAPGEN_X86) && (defined(__GNUC__) || defined(__clang__))
+#define MAPGEN_TARGET_SSE41 __attribute__((target("sse4.1")))
+#define MAPGEN_TARGET_AVX2  __attribute__((target("avx2")))
+#else
+#define MAPGEN_TARGET_SSE41
+#define MAPGEN_TARGET_AVX2
+#endif
+
+enum class SimdLevel {
+	Scalar,
+	SSE41,
+	AVX2
+};
+
+// Best instruction set supported by the CPU (and the OS for AVX state), detected once
+SimdLevel detectSimdLevel();
+const char* simdLevelName(SimdLevel level);
@@ -0,0 +1,113 @@
+// Simplex noise in 2D and 3D: a sample blends the 3 (2D) or 4 (3D) corners of
+// the simplex that contains it, where classic Perlin noise blends the 4 or 8
+// corners of a square or cube. Header only, so the templated row loops of
+// NoiseSource.h inline it
+#pragma once
+
+#include "PerlinNoise.h"
+#include <cmath>
+#include <vector>
+
+class SimplexNoise2D {
+	std::vector<int> p;
+public:
+	// Same permutation as PerlinNoise(seed)
+	SimplexNoise2D(unsigned int seed) : p(PerlinNoise(seed).getPermutation()) {}
+
+	// Value in [0, 1]; z is ignored
+	double noise(double x, double y, double z = 0.0) const {
+		(void)z;
+		// Skew the plane onto the square grid to find the simplex cell
+		const double F2 = 0.36602540378443865; // (sqrt(3) - 1) / 2
+		const double G2 = 0.21132486540518713; // (3 - sqrt(3)) / 6
+		double s = (x + y) * F2;
+		double i = floor(x + s), j = floor(y + s);
+		double t = (i + j) * G2;
+		double x0 = x - (i - t), y0 = y - (j - t);
+
+		// Lower or upper triangle of the cell
+		int i1 = x0 > y0 ? 1 : 0;
+		int j1 = 1 - i1;
+		double x1 = x0 - i1 + G2, y1 = y0 - j1 + G2;
+		double x2 = x0 - 1.0 + 2.0 * G2, y2 = y0 - 1.0 + 2.0 * G2;
+
+		int ii = (int)i & 255, jj = (int)j & 255;
+		double res = corner(p[ii + p[jj]], x0, y0) + corner(p[ii + i1 + p[jj + j1]], x1, y1)
+			+ corner(p[ii + 1 + p[jj + 1]], x2, y2);
+		// Scaled so the output spans [0, 1]
+		return 0.5 + 0.5 * 60.0 * res;
+	}
+private:
+	static double corner(int hash, double x, double y) {
+		double t = 0.5 - x * x - y * y;
+		if (t <= 0.0)
+			return 0.0;
+		t *= t;
+		return t * t * grad(hash, x, y);
+	}
+
+	// Same eight directions as PerlinNoise2D
+	static double grad(int hash, double x, double y) {
+		int h = hash & 7;
+		if (h < 4)
+			return ((h & 1) == 0 ? x : -x) + ((h & 2) == 0 ? y : -y);
+		double u = (h & 1) == 0 ? x : y;
+		return (h & 2) == 0 ? u : -u;
+	}
+};
+
+class SimplexNoise3D {
+	std::vector<int> p;
+public:
+	// Same permutation as PerlinNoise(seed)
+	SimplexNoise3D(unsigned int seed) : p(PerlinNoise(seed).getPermutation()) {}
+
+	// Value in [0, 1]
+	double noise(double x, double y, double z) const {
+		const double F3 = 1.0 / 3.0;
+		const double G3 = 1.0 / 6.0;
+		double s = (x + y + z) * F3;
+		double i = floor(x + s), j = floor(y + s), k = floor(z + s);
+		double t = (i + j + k) * G3;
+		double x0 = x - (i - t), y0 = y - (j - t), z0 = z - (k - t);
+
+		// Which of the six tetrahedra of the cube: order the coordinates
+		int i1, j1, k1, i2, j2, k2;
+		if (x0 >= y0) {
+			if (y0 >= z0) { i1 = 1; j1 = 0; k1 = 0; i2 = 1; j2 = 1; k2 = 0; }
+			else if (x0 >= z0) { i1 = 1; j1 = 0; k1 = 0; i2 = 1; j2 = 0; k2 = 1; }
+			else { i1 = 0; j1 = 0; k1 = 1; i2 = 1; j2 = 0; k2 = 1; }
+		}
+		else {
+			if (y0 < z0) { i1 = 0; j1 = 0; k1 = 1; i2 = 0; j2 = 1; k2 = 1; }
+			else if (x0 < z0) { i1 = 0; j1 = 1; k1 = 0; i2 = 0; j2 = 1; k2 = 1; }
+			else { i1 = 0; j1 = 1; k1 = 0; i2 = 1; j2 = 1; k2 = 0; }
+		}
+		double x1 = x0 - i1 + G3, y1 = y0 - j1 + G3, z1 = z0 - k1 + G3;
+		double x2 = x0 - i2 + 2.0 * G3, y2 = y0 - j2 + 2.0 * G3, z2 = z0 - k2 + 2.0 * G3;
+		double x3 = x0 - 1.0 + 3.0 * G3, y3 = y0 - 1.0 + 3.0 * G3, z3 = z0 - 1.0 + 3.0 * G3;
+
+		int ii = (int)i & 255, jj = (int)j & 255, kk = (int)k & 255;
+		double res = corner(p[ii + p[jj + p[kk]]], x0, y0, z0)
+			+ corner(p[ii + i1 + p[jj + j1 + p[kk + k1]]], x1, y1, z1)
+			+ corner(p[ii + i2 + p[jj + j2 + p[kk + k2]]], x2, y2, z2)
+			+ corner(p[ii + 1 + p[jj + 1 + p[kk + 1]]], x3, y3, z3);
+		return 0.5 + 0.5 * 32.0 * res;
+	}
+private:
+	static double corner(int hash, double x, double y, double z) {
+		double t = 0.6 - x * x - y * y - z * z;
+		if (t <= 0.0)
+			return 0.0;
+		t *= t;
+		return t * t * grad(hash, x, y, z);
+	}
+
+	// The twelve cube edge directions of PerlinNoise
+	static double grad(int hash, double x, double y, double z) {
+		int h = hash & 15;
+		double u = h < 8 ? x : y,
+			v = h < 4 ? y : h == 12 || h == 14 ? x : z;
+		return ((h & 1) == 0 ? u : -u) + ((h & 2) == 0 ? v : -v);
+	}
+};
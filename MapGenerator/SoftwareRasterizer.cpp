@@ -0,0 +1,327 @@
+#include "SoftwareRasterizer.h"
+#include <algorithm>
+#include <cmath>
+#include <map>
+
+using namespace std;
+
+namespace {
+
+// Triangles set up and binned by one task, and vertices transformed by one
+const size_t BLOCK_TRIANGLES = 4096;
+const int VERTEX_BLOCK = 4096;
+const int SUBPIXEL = 256;
+// Triangles are clipped to a band this many pixels around the viewport, so
+// snapped positions stay under 2^24 and edge functions fit 64 bits
+const float GUARD_PIXELS = 32768.0f;
+
+// PixelShader.hlsl
+const float LIGHT = 0.57735027f;
+const float AMBIENT = 0.2f;
+const float MATERIAL_R = 0.5f, MATERIAL_G = 0.8f, MATERIAL_B = 0.4f;
+// Render() in the viewer
+const float CLEAR = 0.2f;
+
+// Float to UNORM8 conversion of the render target, alpha 1
+uint32_t packColor(float r, float g, float b) {
+	auto unorm = [](float c) { return (uint32_t)lrintf(min(max(c, 0.0f), 1.0f) * 255.0f); };
+	return unorm(r) | unorm(g) << 8 | unorm(b) << 16 | 0xFF000000u;
+}
+
+int64_t floorDiv(int64_t a, int64_t b) {
+	return a >= 0 ? a / b : -((-a + b - 1) / b);
+}
+
+}
+
+SoftwareRasterizer::SoftwareRasterizer(int _width, int _height, int _tileSize)
+	: width(_width), height(_height), tileSize(max(_tileSize, 8)),
+	world(Matrix4::identity()), view(Matrix4::identity()), projection(Matrix4::identity()), activeBlocks(0), drawn(0) {
+	tilesX = (width + tileSize - 1) / tileSize;
+	tilesY = (height + tileSize - 1) / tileSize;
+	color.resize((size_t)width * height);
+	depth.resize((size_t)width * height);
+	clear();
+}
+
+void SoftwareRasterizer::setTransforms(const Matrix4& _world, const Matrix4& _view, const Matrix4& _projection) {
+	world = _world;
+	view = _view;
+	projection = _projection;
+}
+
+void SoftwareRasterizer::clear() {
+	fill(color.begin(), color.end(), packColor(CLEAR, CLEAR, CLEAR));
+	fill(depth.begin(), depth.end(), 1.0f);
+}
+
+void SoftwareRasterizer::draw(const vector<Vertex>& vertices, const vector<unsigned int>& indices, ThreadPool& pool) {
+	DrawRange range = { 0, (unsigned int)(indices.size() / 3), 0, 0 };
+	ranges.assign(1, range);
+	drawRanges(vertices, indices.data(), pool);
+}
+
+void SoftwareRasterizer::draw(const ChunkedTerrain& terrain, const vector<int>& lods, ThreadPool& pool) {
+	ranges.clear();
+	const uint16_t* indices = terrain.indices.data();
+	// Strips become lists first, once per LOD list in use
+	map<unsigned int, pair<unsigned int, unsigned int>> lists;
+	bool strips = terrain.getIndexOrder() == IndexOrder::Strip;
+	if (strips)
+		stripList.clear();
+	vector<uint16_t> list;
+	size_t total = 0;
+	for (size_t i = 0; i < terrain.chunks.size(); i++) {
+		if (lods[i] == CULLED_LOD)
+			continue;
+		const TerrainChunk& chunk = terrain.chunks[i];
+		const ChunkLod& lod = chunk.lods[lods[i]];
+		DrawRange range = { lod.firstIndex, lod.indexCount / 3, chunk.firstVertex, total };
+		if (strips) {
+			auto found = lists.find(lod.firstIndex);
+			if (found == lists.end()) {
+				stripToList(&terrain.indices[lod.firstIndex], lod.indexCount, list);
+				found = lists.insert(make_pair(lod.firstIndex, make_pair((unsigned int)stripList.size(), (unsigned int)(list.size() / 3)))).first;
+				stripList.insert(stripList.end(), list.begin(), list.end());
+			}
+			range.firstIndex = found->second.first;
+			range.triangleCount = found->second.second;
+		}
+		ranges.push_back(range);
+		total += range.triangleCount;
+	}
+	drawRanges(terrain.vertices, strips ? stripList.data() : indices, pool);
+}
+
+ppm SoftwareRasterizer::image() const {
+	ppm out(width, height);
+	for (size_t i = 0; i < color.size(); i++) {
+		out.r[i] = (unsigned char)(color[i] & 0xFF);
+		out.g[i] = (unsigned char)(color[i] >> 8 & 0xFF);
+		out.b[i] = (unsigned char)(color[i] >> 16 & 0xFF);
+	}
+	return out;
+}
+
+template<class Index>
+void SoftwareRasterizer::drawRanges(const vector<Vertex>& vertices, const Index* indices, ThreadPool& pool) {
+	// VertexShader.hlsl, with the light of the pixel shader folded in: it is
+	// linear in the normal, so interpolating it matches interpolating normals
+	Matrix4 transform = world * view * projection;
+	clipVertices.resize(vertices.size());
+	int vertexBlocks = (int)((vertices.size() + VERTEX_BLOCK - 1) / VERTEX_BLOCK);
+	pool.parallelFor(0, vertexBlocks, [&](int b) {
+		size_t end = min(vertices.size(), (size_t)(b + 1) * VERTEX_BLOCK);
+		for (size_t i = (size_t)b * VERTEX_BLOCK; i < end; i++) {
+			const Vertex& v = vertices[i];
+			ClipVertex& c = clipVertices[i];
+			float p[4], n[4];
+			transform.transform(v.Position.x, v.Position.y, v.Position.z, 1.0f, p);
+			world.transform(v.Normal.x, v.Normal.y, v.Normal.z, 1.0f, n);
+			float length = sqrtf(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+			c.x = p[0];
+			c.y = p[1];
+			c.z = p[2];
+			c.w = p[3];
+			c.light = LIGHT * (-n[0] + n[1] - n[2]) / length;
+		}
+	});
+
+	size_t total = ranges.empty() ? 0 : ranges.back().firstTriangle + ranges.back().triangleCount;
+	activeBlocks = (total + BLOCK_TRIANGLES - 1) / BLOCK_TRIANGLES;
+	if (blocks.size() < activeBlocks)
+		blocks.resize(activeBlocks);
+	pool.parallelFor(0, (int)activeBlocks, [&](int b) {
+		size_t first = (size_t)b * BLOCK_TRIANGLES;
+		setupBlock(blocks[b], indices, first, min(BLOCK_TRIANGLES, total - first));
+	});
+	pool.parallelFor(0, tilesX * tilesY, [this](int tile) { drawTile(tile); });
+
+	drawn = 0;
+	for (size_t b = 0; b < activeBlocks; b++)
+		drawn += blocks[b].triangles.size();
+}
+
+template<class Index>
+void SoftwareRasterizer::setupBlock(Block& block, const Index* indices, size_t first, size_t count) const {
+	block.triangles.clear();
+	block.bins.resize((size_t)tilesX * tilesY);
+	for (vector<uint32_t>& bin : block.bins)
+		bin.clear();
+
+	size_t r = upper_bound(ranges.begin(), ranges.end(), first, [](size_t t, const DrawRange& range) {
+		return t < range.firstTriangle;
+	}) - ranges.begin() - 1;
+	for (size_t t = first; t < first + count; t++) {
+		while (t >= ranges[r].firstTriangle + ranges[r].triangleCount)
+			r++;
+		const DrawRange& range = ranges[r];
+		const Index* tri = indices + range.firstIndex + 3 * (t - range.firstTriangle);
+		addTriangle(block, clipVertices[range.baseVertex + tri[0]], clipVertices[range.baseVertex + tri[1]], clipVertices[range.baseVertex + tri[2]]);
+	}
+}
+
+void SoftwareRasterizer::addTriangle(Block& block, const ClipVertex& a, const ClipVertex& b, const ClipVertex& c) const {
+	// Signed distances to near, far, left, right, bottom and top, with the
+	// sides either at the viewport edge or at the guard band
+	float guardX = 1.0f + 2.0f * GUARD_PIXELS / width;
+	float guardY = 1.0f + 2.0f * GUARD_PIXELS / height;
+	auto distance = [](const ClipVertex& v, int plane, float gx, float gy) {
+		switch (plane) {
+		case 0: return v.z;
+		case 1: return v.w - v.z;
+		case 2: return gx * v.w + v.x;
+		case 3: return gx * v.w - v.x;
+		case 4: return gy * v.w + v.y;
+		default: return gy * v.w - v.y;
+		}
+	};
+
+	// Drop triangles entirely outside one frustum plane, clip the ones that
+	// cross near, far or the guard band
+	const ClipVertex* corners[3] = { &a, &b, &c };
+	unsigned int outside = 63, crossing = 0;
+	for (const ClipVertex* v : corners) {
+		unsigned int code = 0;
+		for (int plane = 0; plane < 6; plane++) {
+			if (distance(*v, plane, 1.0f, 1.0f) < 0.0f)
+				code |= 1u << plane;
+			if (distance(*v, plane, guardX, guardY) < 0.0f)
+				crossing |= 1u << plane;
+		}
+		outside &= code;
+	}
+	if (outside)
+		return;
+
+	ClipVertex polygon[2][9] = { { a, b, c } };
+	int count = 3, current = 0;
+	for (int plane = 0; plane < 6 && crossing; plane++) {
+		if (!(crossing & 1u << plane))
+			continue;
+		const ClipVertex* src = polygon[current];
+		ClipVertex* dst = polygon[current ^ 1];
+		int n = 0;
+		for (int i = 0; i < count; i++) {
+			const ClipVertex& p = src[i];
+			const ClipVertex& q = src[(i + 1) % count];
+			float dp = distance(p, plane, guardX, guardY), dq = distance(q, plane, guardX, guardY);
+			if (dp >= 0.0f)
+				dst[n++] = p;
+			if ((dp >= 0.0f) != (dq >= 0.0f)) {
+				float t = dp / (dp - dq);
+				ClipVertex& v = dst[n++];
+				v.x = p.x + t * (q.x - p.x);
+				v.y = p.y + t * (q.y - p.y);
+				v.z = p.z + t * (q.z - p.z);
+				v.w = p.w + t * (q.w - p.w);
+				v.light = p.light + t * (q.light - p.light);
+			}
+		}
+		count = n;
+		current ^= 1;
+		if (count < 3)
+			return;
+	}
+
+	for (int k = 1; k + 1 < count; k++) {
+		const ClipVertex* v[3] = { &polygon[current][0], &polygon[current][k], &polygon[current][k + 1] };
+		Setup s;
+		double fx[3], fy[3], z[3], invW[3], light[3];
+		for (int i = 0; i < 3; i++) {
+			double inverse = 1.0 / v[i]->w;
+			s.x[i] = (int)llrint((v[i]->x * inverse * 0.5 + 0.5) * width * SUBPIXEL);
+			s.y[i] = (int)llrint((0.5 - v[i]->y * inverse * 0.5) * height * SUBPIXEL);
+			fx[i] = (double)s.x[i] / SUBPIXEL;
+			fy[i] = (double)s.y[i] / SUBPIXEL;
+			z[i] = v[i]->z * inverse;
+			invW[i] = inverse;
+			light[i] = v[i]->light * inverse;
+		}
+		// Counter-clockwise on screen is a back face; zero area covers nothing
+		int64_t area = (int64_t)(s.x[1] - s.x[0]) * (s.y[2] - s.y[0]) - (int64_t)(s.y[1] - s.y[0]) * (s.x[2] - s.x[0]);
+		if (area <= 0)
+			continue;
+
+		// Pixels whose centers fall inside the bounding box
+		int64_t minX = min(min(s.x[0], s.x[1]), s.x[2]), maxX = max(max(s.x[0], s.x[1]), s.x[2]);
+		int64_t minY = min(min(s.y[0], s.y[1]), s.y[2]), maxY = max(max(s.y[0], s.y[1]), s.y[2]);
+		s.minX = (int)max<int64_t>(0, -floorDiv(SUBPIXEL / 2 - minX, SUBPIXEL));
+		s.minY = (int)max<int64_t>(0, -floorDiv(SUBPIXEL / 2 - minY, SUBPIXEL));
+		s.maxX = (int)min<int64_t>(width - 1, floorDiv(maxX - SUBPIXEL / 2, SUBPIXEL));
+		s.maxY = (int)min<int64_t>(height - 1, floorDiv(maxY - SUBPIXEL / 2, SUBPIXEL));
+		if (s.minX > s.maxX || s.minY > s.maxY)
+			continue;
+
+		double pixelArea = (double)area / ((double)SUBPIXEL * SUBPIXEL);
+		auto plane = [&](const double* value, float* out) {
+			double d1 = value[1] - value[0], d2 = value[2] - value[0];
+			out[0] = (float)value[0];
+			out[1] = (float)((d1 * (fy[2] - fy[0]) - d2 * (fy[1] - fy[0])) / pixelArea);
+			out[2] = (float)((d2 * (fx[1] - fx[0]) - d1 * (fx[2] - fx[0])) / pixelArea);
+		};
+		s.originX = (float)fx[0];
+		s.originY = (float)fy[0];
+		plane(z, s.z);
+		plane(invW, s.invW);
+		plane(light, s.light);
+
+		uint32_t index = (uint32_t)block.triangles.size();
+		block.triangles.push_back(s);
+		for (int ty = s.minY / tileSize; ty <= s.maxY / tileSize; ty++)
+			for (int tx = s.minX / tileSize; tx <= s.maxX / tileSize; tx++)
+				block.bins[(size_t)ty * tilesX + tx].push_back(index);
+	}
+}
+
+void SoftwareRasterizer::drawTile(int tile) {
+	int tileX = tile % tilesX * tileSize, tileY = tile / tilesX * tileSize;
+	int tileRight = min(tileX + tileSize, width) - 1, tileBottom = min(tileY + tileSize, height) - 1;
+	for (size_t b = 0; b < activeBlocks; b++) {
+		const Block& block = blocks[b];
+		for (uint32_t index : block.bins[tile]) {
+			const Setup& s = block.triangles[index];
+			int x0 = max(s.minX, tileX), x1 = min(s.maxX, tileRight);
+			int y0 = max(s.minY, tileY), y1 = min(s.maxY, tileBottom);
+
+			// Edge functions at the first pixel center, positive inside; the
+			// top-left rule keeps centers exactly on top and left edges
+			int64_t edge[3], stepX[3], stepY[3];
+			int64_t px = (int64_t)x0 * SUBPIXEL + SUBPIXEL / 2, py = (int64_t)y0 * SUBPIXEL + SUBPIXEL / 2;
+			for (int k = 0; k < 3; k++) {
+				int from = k, to = (k + 1) % 3;
+				int64_t dx = s.x[to] - s.x[from], dy = s.y[to] - s.y[from];
+				bool topLeft = dy < 0 || (dy == 0 && dx > 0);
+				edge[k] = dx * (py - s.y[from]) - dy * (px - s.x[from]) - (topLeft ? 0 : 1);
+				stepX[k] = -dy * SUBPIXEL;
+				stepY[k] = dx * SUBPIXEL;
+			}
+
+			float ox = x0 + 0.5f - s.originX;
+			for (int y = y0; y <= y1; y++) {
+				float oy = y + 0.5f - s.originY;
+				float z = s.z[0] + s.z[2] * oy + s.z[1] * ox;
+				float invW = s.invW[0] + s.invW[2] * oy + s.invW[1] * ox;
+				float light = s.light[0] + s.light[2] * oy + s.light[1] * ox;
+				int64_t e0 = edge[0], e1 = edge[1], e2 = edge[2];
+				size_t row = (size_t)y * width;
+				for (int x = x0; x <= x1; x++) {
+					if ((e0 | e1 | e2) >= 0) {
+						float i = (float)(x - x0);
+						float d = min(max(z + s.z[1] * i, 0.0f), 1.0f);
+						if (d < depth[row + x]) {
+							depth[row + x] = d;
+							float diffuse = max((light + s.light[1] * i) / (invW + s.invW[1] * i), AMBIENT);
+							color[row + x] = packColor(diffuse * MATERIAL_R, diffuse * MATERIAL_G, diffuse * MATERIAL_B);
+						}
+					}
+					e0 += stepX[0];
+					e1 += stepX[1];
+					e2 += stepX[2];
+				}
+				for (int k = 0; k < 3; k++)
+					edge[k] += stepY[k];
+			}
+		}
+	}
+}
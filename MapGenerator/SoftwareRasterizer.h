@@ -0,0 +1,85 @@
+// CPU rasterizer that draws the viewer's vertex and index buffers with the
+// viewer's transforms and lighting (VertexShader.hlsl, PixelShader.hlsl),
+// for headless screenshots and for timing frames without a device.
+//
+// Follows the D3D11 rules the viewer relies on: clockwise front faces with
+// back faces culled, clipping to the near and far planes, 8 bits of subpixel
+// precision with the top-left fill rule, and a LESS depth test. Triangles are
+// set up in blocks and binned into screen tiles, then every tile is drawn by
+// one task in submission order, so the image is the same for any pool size
+#pragma once
+
+#include "Vertex.h"
+#include "Matrix4.h"
+#include "ChunkedTerrain.h"
+#include "ThreadPool.h"
+#include "ppm.h"
+#include <vector>
+#include <cstdint>
+
+class SoftwareRasterizer {
+	struct ClipVertex {
+		float x, y, z, w;
+		// dot(light, normal), which the pixel shader interpolates
+		float light;
+	};
+	struct Setup {
+		// Screen positions in 1/256 pixel, y down, clockwise
+		int x[3], y[3];
+		// Pixels whose centers may be covered, inclusive
+		int minX, minY, maxX, maxY;
+		// Planes of depth, 1/w and light/w: value + dx * (px - originX) + dy * (py - originY)
+		float originX, originY;
+		float z[3], invW[3], light[3];
+	};
+	struct Block {
+		std::vector<Setup> triangles;
+		// Indices into triangles, per tile
+		std::vector<std::vector<std::uint32_t>> bins;
+	};
+	struct DrawRange {
+		unsigned int firstIndex;
+		unsigned int triangleCount;
+		unsigned int baseVertex;
+		// Triangles of the ranges before this one
+		size_t firstTriangle;
+	};
+
+	int width, height;
+	int tileSize, tilesX, tilesY;
+	Matrix4 world, view, projection;
+	// R8G8B8A8 like the viewer's back buffer, and depth in [0, 1]
+	std::vector<std::uint32_t> color;
+	std::vector<float> depth;
+	std::vector<ClipVertex> clipVertices;
+	std::vector<Block> blocks;
+	size_t activeBlocks;
+	std::vector<DrawRange> ranges;
+	std::vector<std::uint16_t> stripList;
+	size_t drawn;
+public:
+	SoftwareRasterizer(int width, int height, int tileSize = 64);
+
+	// Same meaning as g_World, g_View and g_Projection in the viewer
+	void setTransforms(const Matrix4& world, const Matrix4& view, const Matrix4& projection);
+	// Fill with the viewer's clear color and depth 1
+	void clear();
+	// Triangle list, as MeshBuilder and AdaptiveTerrain build it
+	void draw(const std::vector<Vertex>& vertices, const std::vector<unsigned int>& indices, ThreadPool& pool = ThreadPool::shared());
+	// Every chunk at the LOD in lods but the culled ones, like the viewer's Render()
+	void draw(const ChunkedTerrain& terrain, const std::vector<int>& lods, ThreadPool& pool = ThreadPool::shared());
+
+	int getWidth() const { return width; }
+	int getHeight() const { return height; }
+	const std::vector<std::uint32_t>& pixels() const { return color; }
+	// Triangles of the last draw that survived culling and clipping
+	size_t drawnTriangles() const { return drawn; }
+	ppm image() const;
+private:
+	template<class Index>
+	void drawRanges(const std::vector<Vertex>& vertices, const Index* indices, ThreadPool& pool);
+	template<class Index>
+	void setupBlock(Block& block, const Index* indices, size_t first, size_t count) const;
+	void addTriangle(Block& block, const ClipVertex& a, const ClipVertex& b, const ClipVertex& c) const;
+	void drawTile(int tile);
+};
@@ -0,0 +1,16 @@
+// Wall clock timer used for stage timings and benchmarks
+#pragma once
+
+#include <chrono>
+
+class Stopwatch {
+	std::chrono::steady_clock::time_point start;
+public:
+	Stopwatch() : start(std::chrono::steady_clock::now()) {}
+	void restart() { start = std::chrono::steady_clock::now(); }
+	// Elapsed time in seconds since construction or the last restart
+	double seconds() const {
+		return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	}
+	double milliseconds() const { return seconds() * 1000.0; }
+};
@@ -2,16 +2,11 @@
 
 #include <vector>
 #include <string>
-#include <DirectXMath.h>
+#include "Vertex.h"
+#include "HeightGrid.h"
+#include "MeshBuilder.h"
 
-struct Vertex
-{
-	DirectX::XMFLOAT3 Position;
-	DirectX::XMFLOAT3 Normal;
-	Vertex() :Position(0, 0, 0), Normal(0, 0, 0) {}
-	Vertex(float x, float y, float z, float nx, float ny, float nz) :Position(x, y, z), Normal(nx, ny, nz) {}
-	Vertex(const DirectX::XMFLOAT3& pos, const DirectX::XMFLOAT3& norm) :Position(pos), Normal(norm) {}
-};
+class HeightmapView;
 
 class Terrain {
 public:
@@ -19,8 +14,12 @@ public:
 	std::vector<unsigned int> indices;
 public:
 	Terrain(const std::string &heightmap);
+	// Build straight from a mapped heightmap; heights are decoded in place
+	Terrain(const HeightmapView& heightmap);
+	// Build from heights already in memory, no file involved
+	Terrain(const HeightGrid& heightmap);
+	// Build from rows produced on request, e.g. HeightmapGenerator::rowSource
+	Terrain(int width, int height, const HeightRowSource& source);
 private:
-	float getHeight(int x, int z);
-	DirectX::XMFLOAT3 calcNormal(int x, int z);
+	void build(int width, int height, const HeightRowSource& source);
 };
-
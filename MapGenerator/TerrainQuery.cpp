@@ -0,0 +1,322 @@
+#include "TerrainQuery.h"
+#include <algorithm>
+#include <cmath>
+
+using namespace std;
+
+namespace {
+
+// Rays handed to a task at once by the batched queries
+const int RAY_BATCH = 256;
+const float FAR_AWAY = 1e30f;
+
+// Narrow [tNear, tFar] to where p + d * t lies in [lo, hi]
+bool slab(float p, float d, float lo, float hi, float& tNear, float& tFar) {
+	if (d == 0.0f)
+		return p >= lo && p <= hi;
+	float t0 = (lo - p) / d, t1 = (hi - p) / d;
+	if (t0 > t1)
+		swap(t0, t1);
+	tNear = max(tNear, t0);
+	tFar = min(tFar, t1);
+	return tNear <= tFar;
+}
+
+// Where p + d * t leaves node n of the given size along one axis
+float axisExit(float p, float d, int n, int size) {
+	if (d > 0.0f)
+		return ((float)(n + 1) * size - p) / d;
+	if (d < 0.0f)
+		return ((float)n * size - p) / d;
+	return FAR_AWAY;
+}
+
+}
+
+TerrainQuery::TerrainQuery(const HeightGrid& grid, const MeshSettings& _settings)
+	: width(grid.width), height(grid.height), settings(_settings), step(0.0f), originX(0.0f), originZ(0.0f) {
+	if (width < 2 || height < 2)
+		return;
+	step = settings.extent / (max(width, height) - 1);
+	originX = -0.5f * step * (width - 1);
+	originZ = -0.5f * step * (height - 1);
+	heights.resize(grid.data.size());
+	for (size_t i = 0; i < heights.size(); i++)
+		heights[i] = grid.data[i] * settings.heightScale + settings.heightOffset;
+	buildPyramid();
+}
+
+void TerrainQuery::buildPyramid() {
+	int w = width - 1, h = height - 1;
+	minimum.clear();
+	maximum.clear();
+	levelWidths.clear();
+	levelHeights.clear();
+	while (true) {
+		minimum.push_back(vector<float>((size_t)w * h));
+		maximum.push_back(vector<float>((size_t)w * h));
+		levelWidths.push_back(w);
+		levelHeights.push_back(h);
+		if (w == 1 && h == 1)
+			break;
+		w = (w + 1) / 2;
+		h = (h + 1) / 2;
+	}
+	refreshPyramid(0, 0, width - 1, height - 1);
+}
+
+void TerrainQuery::refreshPyramid(int x0, int z0, int x1, int z1) {
+	int w = levelWidths[0];
+	for (int z = z0; z < z1; z++) {
+		for (int x = x0; x < x1; x++) {
+			float a = sample(x, z), b = sample(x + 1, z), c = sample(x, z + 1), d = sample(x + 1, z + 1);
+			minimum[0][(size_t)z * w + x] = min(min(a, b), min(c, d));
+			maximum[0][(size_t)z * w + x] = max(max(a, b), max(c, d));
+		}
+	}
+	// Every level above only over the parents of the nodes just refreshed
+	for (size_t level = 1; level < maximum.size(); level++) {
+		x0 /= 2;
+		z0 /= 2;
+		x1 = (x1 + 1) / 2;
+		z1 = (z1 + 1) / 2;
+		int childWidth = levelWidths[level - 1], childHeight = levelHeights[level - 1];
+		const vector<float>& childLow = minimum[level - 1];
+		const vector<float>& childHigh = maximum[level - 1];
+		int pw = levelWidths[level];
+		for (int z = z0; z < z1; z++) {
+			for (int x = x0; x < x1; x++) {
+				float low = FAR_AWAY, high = -FAR_AWAY;
+				for (int cz = 2 * z; cz < min(2 * z + 2, childHeight); cz++) {
+					for (int cx = 2 * x; cx < min(2 * x + 2, childWidth); cx++) {
+						low = min(low, childLow[(size_t)cz * childWidth + cx]);
+						high = max(high, childHigh[(size_t)cz * childWidth + cx]);
+					}
+				}
+				minimum[level][(size_t)z * pw + x] = low;
+				maximum[level][(size_t)z * pw + x] = high;
+			}
+		}
+	}
+}
+
+void TerrainQuery::update(const HeightGrid& grid, int x0, int z0, int x1, int z1) {
+	if (heights.empty())
+		return;
+	x0 = max(x0, 0);
+	z0 = max(z0, 0);
+	x1 = min(x1, width);
+	z1 = min(z1, height);
+	if (x0 >= x1 || z0 >= z1)
+		return;
+	for (int z = z0; z < z1; z++) {
+		const float* src = grid.row(z);
+		for (int x = x0; x < x1; x++)
+			heights[(size_t)z * width + x] = src[x] * settings.heightScale + settings.heightOffset;
+	}
+	// Cells with one of the samples as a corner
+	refreshPyramid(max(x0 - 1, 0), max(z0 - 1, 0), min(x1, width - 1), min(z1, height - 1));
+}
+
+float TerrainQuery::heightAt(float x, float z) const {
+	if (heights.empty())
+		return settings.heightOffset;
+	float u = min(max((x - originX) / step, 0.0f), (float)(width - 1));
+	float v = min(max((z - originZ) / step, 0.0f), (float)(height - 1));
+	int cx = min((int)u, width - 2), cz = min((int)v, height - 2);
+	float fx = u - cx, fz = v - cz;
+	float top = sample(cx, cz) + fx * (sample(cx + 1, cz) - sample(cx, cz));
+	float bottom = sample(cx, cz + 1) + fx * (sample(cx + 1, cz + 1) - sample(cx, cz + 1));
+	return top + fz * (bottom - top);
+}
+
+Float3 TerrainQuery::normalAt(float x, float z) const {
+	if (heights.empty())
+		return Float3(0.0f, 1.0f, 0.0f);
+	float u = min(max((x - originX) / step, 0.0f), (float)(width - 1));
+	float v = min(max((z - originZ) / step, 0.0f), (float)(height - 1));
+	int cx = min((int)u, width - 2), cz = min((int)v, height - 2);
+	float fx = u - cx, fz = v - cz;
+	float h00 = sample(cx, cz), h10 = sample(cx + 1, cz);
+	float h01 = sample(cx, cz + 1), h11 = sample(cx + 1, cz + 1);
+	float slopeX = ((1.0f - fz) * (h10 - h00) + fz * (h11 - h01)) / step;
+	float slopeZ = ((1.0f - fx) * (h01 - h00) + fx * (h11 - h10)) / step;
+	float inverse = 1.0f / sqrtf(slopeX * slopeX + slopeZ * slopeZ + 1.0f);
+	return Float3(-slopeX * inverse, inverse, -slopeZ * inverse);
+}
+
+RayHit TerrainQuery::trace(const Ray& ray, bool anyHit) const {
+	RayHit result;
+	const Float3& d = ray.direction;
+	float length = sqrtf(d.x * d.x + d.y * d.y + d.z * d.z);
+	if (heights.empty() || length == 0.0f)
+		return result;
+
+	// Across in samples, up in world units; t is the world distance
+	float dx = d.x / length, dy = d.y / length, dz = d.z / length;
+	float u0 = (ray.origin.x - originX) / step, v0 = (ray.origin.z - originZ) / step, y0 = ray.origin.y;
+	float du = dx / step, dv = dz / step;
+	int top = (int)maximum.size() - 1;
+	float tNear = 0.0f, tFar = ray.maxDistance;
+	if (!slab(u0, du, 0.0f, (float)(width - 1), tNear, tFar) || !slab(v0, dv, 0.0f, (float)(height - 1), tNear, tFar)
+		|| !slab(y0, dy, minimum[top][0], maximum[top][0], tNear, tFar))
+		return result;
+
+	auto hitAt = [&](float t) {
+		result.hit = true;
+		result.distance = t;
+		result.position = Float3(ray.origin.x + dx * t, ray.origin.y + dy * t, ray.origin.z + dz * t);
+		return result;
+	};
+
+	int level = top;
+	float t = tNear;
+	while (t < tFar) {
+		int size = 1 << level;
+		int columns = levelWidths[level], rows = levelHeights[level];
+		int cx = min(max((int)floorf((u0 + du * t) / size), 0), columns - 1);
+		int cz = min(max((int)floorf((v0 + dv * t) / size), 0), rows - 1);
+		// Rounding can leave t on the far side of the node it lands in: step
+		// to the neighbour the ray is actually in
+		float exitU = axisExit(u0, du, cx, size), exitV = axisExit(v0, dv, cz, size);
+		while (exitU <= t) {
+			cx += du > 0.0f ? 1 : -1;
+			exitU = axisExit(u0, du, cx, size);
+		}
+		while (exitV <= t) {
+			cz += dv > 0.0f ? 1 : -1;
+			exitV = axisExit(v0, dv, cz, size);
+		}
+		if (cx < 0 || cx >= columns || cz < 0 || cz >= rows)
+			break;
+
+		float tExit = min(min(exitU, exitV), tFar);
+		float yEnter = y0 + dy * t, yExit = y0 + dy * tExit;
+		size_t node = (size_t)cz * columns + cx;
+		if (min(yEnter, yExit) > maximum[level][node]) {
+			// Above everything in the node
+			t = tExit;
+			level = min(level + 1, top);
+			continue;
+		}
+		if (anyHit && max(yEnter, yExit) < minimum[level][node])
+			return hitAt(t);
+		if (level > 0) {
+			level--;
+			continue;
+		}
+
+		// Ray minus ground over the cell as a quadratic in s = t' - t:
+		// c + b s + a s^2, with the bilinear ground expanded along the ray
+		float h00 = sample(cx, cz), h10 = sample(cx + 1, cz);
+		float h01 = sample(cx, cz + 1), h11 = sample(cx + 1, cz + 1);
+		float fx = min(max(u0 + du * t - cx, 0.0f), 1.0f), fz = min(max(v0 + dv * t - cz, 0.0f), 1.0f);
+		float ex = h10 - h00, ez = h01 - h00, k = h11 - h10 - h01 + h00;
+		float c = yEnter - (h00 + ex * fx + ez * fz + k * fx * fz);
+		float b = dy - (ex * du + ez * dv + k * (fx * dv + fz * du));
+		float a = -k * du * dv;
+		if (c <= 0.0f)
+			return hitAt(t);
+		float roots[2];
+		int count = 0;
+		if (a == 0.0f) {
+			if (b != 0.0f)
+				roots[count++] = -c / b;
+		}
+		else {
+			float discriminant = b * b - 4.0f * a * c;
+			if (discriminant >= 0.0f) {
+				float q = -0.5f * (b + copysignf(sqrtf(discriminant), b));
+				if (q != 0.0f) {
+					roots[count++] = q / a;
+					roots[count++] = c / q;
+				}
+			}
+		}
+		float nearest = FAR_AWAY;
+		for (int i = 0; i < count; i++)
+			if (roots[i] >= 0.0f && roots[i] <= tExit - t)
+				nearest = min(nearest, roots[i]);
+		if (nearest < FAR_AWAY)
+			return hitAt(t + nearest);
+
+		t = tExit;
+		level = min(level + 1, top);
+	}
+	return result;
+}
+
+RayHit TerrainQuery::raycast(const Ray& ray) const {
+	return trace(ray, false);
+}
+
+void TerrainQuery::raycast(const vector<Ray>& rays, vector<RayHit>& hits, ThreadPool& pool) const {
+	hits.resize(rays.size());
+	int batches = (int)((rays.size() + RAY_BATCH - 1) / RAY_BATCH);
+	pool.parallelFor(0, batches, [&](int batch) {
+		size_t end = min(rays.size(), (size_t)(batch + 1) * RAY_BATCH);
+		for (size_t i = (size_t)batch * RAY_BATCH; i < end; i++)
+			hits[i] = trace(rays[i], false);
+	});
+}
+
+bool TerrainQuery::visible(const Sightline& line) const {
+	Float3 d(line.to.x - line.from.x, line.to.y - line.from.y, line.to.z - line.from.z);
+	// Stop just short of the end, so a target on the ground does not hide itself
+	float length = sqrtf(d.x * d.x + d.y * d.y + d.z * d.z);
+	return !trace(Ray(line.from, d, length * 0.9999f), true).hit;
+}
+
+void TerrainQuery::visible(const vector<Sightline>& lines, vector<char>& clear, ThreadPool& pool) const {
+	clear.resize(lines.size());
+	int batches = (int)((lines.size() + RAY_BATCH - 1) / RAY_BATCH);
+	pool.parallelFor(0, batches, [&](int batch) {
+		size_t end = min(lines.size(), (size_t)(batch + 1) * RAY_BATCH);
+		for (size_t i = (size_t)batch * RAY_BATCH; i < end; i++)
+			clear[i] = visible(lines[i]) ? 1 : 0;
+	});
+}
+
+RayHit TerrainQuery::raycastStepped(const Ray& ray, float stepSize) const {
+	RayHit result;
+	const Float3& d = ray.direction;
+	float length = sqrtf(d.x * d.x + d.y * d.y + d.z * d.z);
+	if (heights.empty() || length == 0.0f)
+		return result;
+	float dx = d.x / length, dy = d.y / length, dz = d.z / length;
+	float tNear = 0.0f, tFar = ray.maxDistance;
+	if (!slab(ray.origin.x, dx, originX, -originX, tNear, tFar) || !slab(ray.origin.z, dz, originZ, -originZ, tNear, tFar))
+		return result;
+
+	auto above = [&](float t) {
+		return ray.origin.y + dy * t - heightAt(ray.origin.x + dx * t, ray.origin.z + dz * t);
+	};
+	float previous = tNear;
+	if (above(tNear) > 0.0f) {
+		bool crossed = false;
+		for (float t = tNear + stepSize; ; t += stepSize) {
+			float next = min(t, tFar);
+			if (above(next) <= 0.0f) {
+				for (int i = 0; i < 24; i++) {
+					float middle = 0.5f * (previous + next);
+					if (above(middle) > 0.0f)
+						previous = middle;
+					else
+						next = middle;
+				}
+				previous = next;
+				crossed = true;
+				break;
+			}
+			previous = next;
+			if (next >= tFar)
+				break;
+		}
+		if (!crossed)
+			return result;
+	}
+	result.hit = true;
+	result.distance = previous;
+	result.position = Float3(ray.origin.x + dx * previous, ray.origin.y + dy * previous, ray.origin.z + dz * previous);
+	return result;
+}
@@ -0,0 +1,82 @@
+// Ground height, normal, ray and line-of-sight queries against a height grid,
+// in the world space MeshBuilder places it in (same settings). The ground is
+// the bilinear surface through the samples; rays intersect it exactly, cell
+// by cell, and skip empty space with a min/max mip pyramid of the cells: a
+// node is only entered when the ray comes below its highest sample, and a
+// sightline is blocked as soon as it passes under a node's lowest one
+#pragma once
+
+#include "Vertex.h"
+#include "HeightGrid.h"
+#include "MeshBuilder.h"
+#include "ThreadPool.h"
+#include <vector>
+
+struct Ray {
+	Float3 origin;
+	// Need not be normalized; distances are in world units along it
+	Float3 direction;
+	float maxDistance;
+
+	Ray() : maxDistance(1e30f) {}
+	Ray(const Float3& _origin, const Float3& _direction, float _maxDistance = 1e30f)
+		: origin(_origin), direction(_direction), maxDistance(_maxDistance) {}
+};
+
+struct RayHit {
+	bool hit;
+	float distance;
+	Float3 position;
+
+	RayHit() : hit(false), distance(0.0f) {}
+};
+
+struct Sightline {
+	Float3 from, to;
+};
+
+class TerrainQuery {
+	int width, height;
+	MeshSettings settings;
+	float step, originX, originZ;
+	// World heights of the samples
+	std::vector<float> heights;
+	// Per level, the lowest and highest sample of every node; level 0 holds
+	// the cells and a node of level l covers 2^l x 2^l of them
+	std::vector<std::vector<float>> minimum, maximum;
+	std::vector<int> levelWidths, levelHeights;
+public:
+	TerrainQuery(const HeightGrid& grid, const MeshSettings& settings = MeshSettings());
+
+	// Take samples [x0, x1) x [z0, z1) from grid, the map the query was built
+	// from after they changed, and refresh only the cells around them and the
+	// pyramid nodes above those: the work follows the size of the change
+	void update(const HeightGrid& grid, int x0, int z0, int x1, int z1);
+
+	// Bilinear world height at world (x, z), clamped to the map
+	float heightAt(float x, float z) const;
+	// Unit normal of the bilinear surface at world (x, z)
+	Float3 normalAt(float x, float z) const;
+
+	// First point where the ray meets the ground within maxDistance; a ray
+	// starting under the ground hits where it enters the map
+	RayHit raycast(const Ray& ray) const;
+	void raycast(const std::vector<Ray>& rays, std::vector<RayHit>& hits, ThreadPool& pool = ThreadPool::shared()) const;
+	// Whether the ground leaves the segment between from and to clear
+	bool visible(const Sightline& line) const;
+	void visible(const std::vector<Sightline>& lines, std::vector<char>& clear, ThreadPool& pool = ThreadPool::shared()) const;
+
+	// Reference raycast: heightAt every stepSize world units along the ray,
+	// then bisection; the per-sample walk the pyramid replaces
+	RayHit raycastStepped(const Ray& ray, float stepSize) const;
+
+	int levelCount() const { return (int)maximum.size(); }
+private:
+	float sample(int x, int z) const { return heights[(size_t)z * width + x]; }
+	// Shared traversal; with anyHit it returns at the first proof of a hit
+	// instead of finding the nearest one
+	RayHit trace(const Ray& ray, bool anyHit) const;
+	void buildPyramid();
+	// Recompute cells [x0, x1) x [z0, z1) and every node above them
+	void refreshPyramid(int x0, int z0, int x1, int z1);
+};
@@ -0,0 +1,104 @@
+#include "ThreadPool.h"
+#include <algorithm>
+
+ThreadPool::ThreadPool(unsigned int threads) : pending(0), nextQueue(0), stopping(false) {
+	if (threads == 0)
+		threads = std::max(1u, std::thread::hardware_concurrency());
+
+	for (unsigned int i = 0; i < threads; i++)
+		queues.push_back(std::unique_ptr<Queue>(new Queue()));
+	for (unsigned int i = 0; i < threads; i++)
+		workers.emplace_back(&ThreadPool::workerLoop, this, i);
+}
+
+ThreadPool::~ThreadPool() {
+	{
+		std::lock_guard<std::mutex> lock(sleepMutex);
+		stopping = true;
+	}
+	wake.notify_all();
+	for (std::thread& t : workers)
+		t.join();
+}
+
+ThreadPool& ThreadPool::shared() {
+	static ThreadPool pool;
+	return pool;
+}
+
+void ThreadPool::parallelFor(int begin, int end, const std::function<void(int)>& fn) {
+	if (end <= begin)
+		return;
+	if (end - begin == 1) {
+		fn(begin);
+		return;
+	}
+
+	Batch batch;
+	batch.fn = &fn;
+	batch.remaining = end - begin;
+
+	// Deal the indices out round-robin; stealing evens out the imbalance
+	pending += end - begin;
+	unsigned int queueCount = (unsigned int)queues.size();
+	unsigned int first = nextQueue.fetch_add(1) % queueCount;
+	for (int i = begin; i < end; i++) {
+		Queue& q = *queues[(first + (unsigned int)(i - begin)) % queueCount];
+		std::lock_guard<std::mutex> lock(q.mutex);
+		q.tasks.push_back(Task{ &batch, i });
+	}
+	{
+		// Taking the lock orders the notify after a worker's predicate check
+		std::lock_guard<std::mutex> lock(sleepMutex);
+	}
+	wake.notify_all();
+
+	// Help out until every task of this batch has finished
+	while (batch.remaining.load() > 0) {
+		if (!tryRun(first))
+			std::this_thread::yield();
+	}
+}
+
+bool ThreadPool::pop(unsigned int queue, Task& task, bool back) {
+	Queue& q = *queues[queue];
+	std::lock_guard<std::mutex> lock(q.mutex);
+	if (q.tasks.empty())
+		return false;
+	if (back) {
+		task = q.tasks.back();
+		q.tasks.pop_back();
+	}
+	else {
+		task = q.tasks.front();
+		q.tasks.pop_front();
+	}
+	return true;
+}
+
+bool ThreadPool::tryRun(unsigned int self) {
+	Task task;
+	unsigned int queueCount = (unsigned int)queues.size();
+	bool found = pop(self, task, true);
+	for (unsigned int i = 1; !found && i < queueCount; i++)
+		found = pop((self + i) % queueCount, task, false);
+	if (!found)
+		return false;
+
+	pending--;
+	(*task.batch->fn)(task.index);
+	task.batch->remaining--;
+	return true;
+}
+
+void ThreadPool::workerLoop(unsigned int self) {
+	for (;;) {
+		if (tryRun(self))
+			continue;
+
+		std::unique_lock<std::mutex> lock(sleepMutex);
+		wake.wait(lock, [this] { return stopping || pending.load() > 0; });
+		if (stopping)
+			return;
+	}
+}
@@ -0,0 +1,53 @@
+// Work-stealing thread pool: every worker owns a deque of tasks, pops from
+// its back and steals from the front of the others when it runs dry
+#pragma once
+
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <functional>
+#include <memory>
+
+class ThreadPool {
+	struct Batch {
+		const std::function<void(int)>* fn;
+		std::atomic<int> remaining;
+	};
+	struct Task {
+		Batch* batch;
+		int index;
+	};
+	struct Queue {
+		std::mutex mutex;
+		std::deque<Task> tasks;
+	};
+
+	std::vector<std::thread> workers;
+	std::vector<std::unique_ptr<Queue>> queues;
+	std::atomic<int> pending;
+	std::atomic<unsigned> nextQueue;
+	std::mutex sleepMutex;
+	std::condition_variable wake;
+	bool stopping;
+public:
+	// threads == 0 uses one worker per hardware thread
+	explicit ThreadPool(unsigned int threads = 0);
+	~ThreadPool();
+	ThreadPool(const ThreadPool&) = delete;
+	ThreadPool& operator=(const ThreadPool&) = delete;
+
+	unsigned int size() const { return (unsigned int)workers.size(); }
+	// Run fn(i) for every i in [begin, end) and return once all calls are done.
+	// The calling thread takes part, so nested calls from inside fn are fine
+	void parallelFor(int begin, int end, const std::function<void(int)>& fn);
+
+	// Process-wide pool sized to the machine
+	static ThreadPool& shared();
+private:
+	void workerLoop(unsigned int self);
+	bool tryRun(unsigned int self);
+	bool pop(unsigned int queue, Task& task, bool back);
+};
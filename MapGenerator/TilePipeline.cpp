@@ -0,0 +1,197 @@
+#include "TilePipeline.h"
+#include <algorithm>
+#include <cmath>
+
+using namespace std;
+
+namespace {
+
+// Heap order that puts the smallest priority on top
+struct LaterJob {
+	template<class J>
+	bool operator()(const J& a, const J& b) const { return a->priority > b->priority; }
+};
+
+}
+
+TilePipeline::TilePipeline(TileService& _tiles, const PipelineSettings& _settings, const TileFilter& _filter)
+	: tiles(_tiles), settings(_settings), filter(_filter), cameraX(0.0), cameraZ(0.0),
+	stopping(false), requested(0), completed(0), cancelled(0) {
+	int n = tiles.getSettings().tileSize + 1;
+	MeshBuilder(n, n, HeightRowSource(), settings.mesh).buildIndices(indices, ThreadPool::shared());
+
+	unsigned int count = settings.workers;
+	if (count == 0) {
+		unsigned int hardware = thread::hardware_concurrency();
+		count = hardware > 1 ? hardware - 1 : 1;
+	}
+	for (unsigned int i = 0; i < count; i++)
+		workers.emplace_back(&TilePipeline::workerLoop, this);
+}
+
+TilePipeline::~TilePipeline() {
+	{
+		lock_guard<mutex> lock(jobMutex);
+		stopping = true;
+		for (const JobPtr& job : queue)
+			job->cancelled = true;
+	}
+	wake.notify_all();
+	for (thread& t : workers)
+		t.join();
+
+	unique_ptr<TileMesh> mesh;
+	while ((mesh = poll()))
+		;
+}
+
+double TilePipeline::distance(const TileKey& key) const {
+	double span = (double)tiles.getSettings().tileSize * (double)((int64_t)1 << key.lod);
+	double dx = max(max(key.tx * span - cameraX, cameraX - (key.tx + 1) * span), 0.0);
+	double dz = max(max(key.tz * span - cameraZ, cameraZ - (key.tz + 1) * span), 0.0);
+	return sqrt(dx * dx + dz * dz);
+}
+
+bool TilePipeline::request(const TileKey& key) {
+	{
+		lock_guard<mutex> lock(jobMutex);
+		if (stopping || active.count(key))
+			return false;
+		JobPtr job = make_shared<Job>();
+		job->key = key;
+		job->priority = distance(key);
+		job->cancelled = false;
+		job->requestTime = uptime.seconds();
+		active[key] = job;
+		queue.push_back(job);
+		push_heap(queue.begin(), queue.end(), LaterJob());
+	}
+	requested++;
+	wake.notify_one();
+	return true;
+}
+
+void TilePipeline::setCamera(double x, double z, double radius) {
+	lock_guard<mutex> lock(jobMutex);
+	cameraX = x;
+	cameraZ = z;
+
+	// Running jobs are told to stop; queued ones leave the heap right away
+	for (auto it = active.begin(); it != active.end();) {
+		if (distance(it->first) > radius) {
+			it->second->cancelled = true;
+			it = active.erase(it);
+		}
+		else
+			++it;
+	}
+	size_t kept = 0;
+	for (size_t i = 0; i < queue.size(); i++) {
+		if (queue[i]->cancelled) {
+			cancelled++;
+			continue;
+		}
+		queue[i]->priority = distance(queue[i]->key);
+		queue[kept++] = queue[i];
+	}
+	queue.resize(kept);
+	make_heap(queue.begin(), queue.end(), LaterJob());
+}
+
+bool TilePipeline::cancel(const TileKey& key) {
+	lock_guard<mutex> lock(jobMutex);
+	auto found = active.find(key);
+	if (found == active.end())
+		return false;
+	// A queued job is dropped when a worker pops it or at the next setCamera
+	found->second->cancelled = true;
+	active.erase(found);
+	return true;
+}
+
+unique_ptr<TileMesh> TilePipeline::poll() {
+	TileMesh* mesh = nullptr;
+	if (!done.pop(mesh))
+		return unique_ptr<TileMesh>();
+	return unique_ptr<TileMesh>(mesh);
+}
+
+size_t TilePipeline::activeCount() {
+	lock_guard<mutex> lock(jobMutex);
+	return active.size();
+}
+
+PipelineStats TilePipeline::getStats() const {
+	PipelineStats stats;
+	stats.requested = requested;
+	stats.completed = completed;
+	stats.cancelled = cancelled;
+	return stats;
+}
+
+void TilePipeline::workerLoop() {
+	for (;;) {
+		JobPtr job;
+		{
+			unique_lock<mutex> lock(jobMutex);
+			wake.wait(lock, [this] { return stopping || !queue.empty(); });
+			if (stopping)
+				return;
+			pop_heap(queue.begin(), queue.end(), LaterJob());
+			job = queue.back();
+			queue.pop_back();
+		}
+		if (job->cancelled)
+			cancelled++;
+		else
+			run(job);
+	}
+}
+
+void TilePipeline::retire(const JobPtr& job) {
+	lock_guard<mutex> lock(jobMutex);
+	auto found = active.find(job->key);
+	if (found != active.end() && found->second == job)
+		active.erase(found);
+}
+
+void TilePipeline::run(const JobPtr& job) {
+	const TileKey& key = job->key;
+	shared_ptr<const HeightTile> heights = tiles.getTile(key.tx, key.tz, key.lod);
+
+	if (filter && !job->cancelled) {
+		// The cached tile is shared, so the filter works on a copy
+		shared_ptr<HeightTile> filtered = make_shared<HeightTile>(*heights);
+		filter(filtered->grid);
+		heights = filtered;
+	}
+	if (job->cancelled) {
+		cancelled++;
+		return;
+	}
+
+	unique_ptr<TileMesh> mesh(new TileMesh());
+	mesh->key = key;
+	mesh->heights = heights;
+	int tileSize = tiles.getSettings().tileSize;
+	double span = (double)tileSize * (double)((int64_t)1 << key.lod) * settings.sampleSpacing;
+	mesh->originX = (float)((key.tx + 0.5) * span);
+	mesh->originZ = (float)((key.tz + 0.5) * span);
+
+	MeshSettings meshSettings = settings.mesh;
+	meshSettings.extent = (float)span;
+	const HeightGrid& grid = heights->grid;
+	MeshBuilder builder(grid.width, grid.height, gridRows(grid), meshSettings);
+	builder.buildInterleaved(mesh->vertices, ThreadPool::shared());
+
+	if (job->cancelled) {
+		cancelled++;
+		return;
+	}
+	mesh->latency = uptime.seconds() - job->requestTime;
+	completed++;
+	// Retire after the push: a caller that has not polled the tile yet still
+	// sees it as active and cannot queue it a second time
+	done.push(mesh.release());
+	retire(job);
+}
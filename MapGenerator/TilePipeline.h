@@ -0,0 +1,107 @@
+// Asynchronous tile pipeline: generate (through a TileService), filter, build
+// the mesh, and hand the result back. Jobs run on the pipeline's own worker
+// threads, closest to the camera first; jobs that drift out of range are
+// cancelled between stages, and finished tiles come back through a lock-free
+// queue so the thread that polls never waits on a worker
+#pragma once
+
+#include "TileService.h"
+#include "MeshBuilder.h"
+#include "MpscQueue.h"
+#include "Stopwatch.h"
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+// Runs on a worker between generation and meshing, e.g. erosion
+typedef std::function<void(HeightGrid& heights)> TileFilter;
+
+struct PipelineSettings {
+	// Worker threads; 0 leaves one hardware thread to the caller
+	unsigned int workers;
+	// World units between neighbouring samples at LOD 0
+	float sampleSpacing;
+	// Height mapping of the meshes; extent is set per LOD
+	MeshSettings mesh;
+
+	PipelineSettings() : workers(0), sampleSpacing(1.0f) {}
+};
+
+struct TileMesh {
+	TileKey key;
+	// Heights after the filter
+	std::shared_ptr<const HeightTile> heights;
+	// Vertices centred on the tile; draw them at (originX, 0, originZ) with
+	// TilePipeline::getIndices()
+	std::vector<Vertex> vertices;
+	float originX;
+	float originZ;
+	// Seconds from request() to completion
+	double latency;
+};
+
+struct PipelineStats {
+	size_t requested;
+	size_t completed;
+	size_t cancelled;
+};
+
+class TilePipeline {
+	struct Job {
+		TileKey key;
+		// Distance to the camera in world samples; smaller runs first
+		double priority;
+		std::atomic<bool> cancelled;
+		double requestTime;
+	};
+	typedef std::shared_ptr<Job> JobPtr;
+
+	TileService& tiles;
+	PipelineSettings settings;
+	TileFilter filter;
+	std::vector<unsigned int> indices;
+
+	std::mutex jobMutex;
+	std::condition_variable wake;
+	// Min-heap on priority of jobs waiting for a worker
+	std::vector<JobPtr> queue;
+	// Jobs queued or running, to ignore duplicate requests
+	std::unordered_map<TileKey, JobPtr, TileKeyHash> active;
+	double cameraX, cameraZ;
+	bool stopping;
+	std::vector<std::thread> workers;
+
+	Stopwatch uptime;
+	MpscQueue<TileMesh*> done;
+	std::atomic<size_t> requested, completed, cancelled;
+public:
+	TilePipeline(TileService& tiles, const PipelineSettings& settings = PipelineSettings(), const TileFilter& filter = TileFilter());
+	// Cancels everything still queued and waits for running jobs
+	~TilePipeline();
+	TilePipeline(const TilePipeline&) = delete;
+	TilePipeline& operator=(const TilePipeline&) = delete;
+
+	// Queue a tile; false if it is already queued or running
+	bool request(const TileKey& key);
+	// Re-prioritize queued jobs by distance to (x, z) and cancel every job
+	// whose tile lies further than radius world samples away
+	void setCamera(double x, double z, double radius);
+	bool cancel(const TileKey& key);
+	// Next finished tile, or null; never blocks
+	std::unique_ptr<TileMesh> poll();
+
+	// Triangle list shared by every tile mesh
+	const std::vector<unsigned int>& getIndices() const { return indices; }
+	size_t activeCount();
+	PipelineStats getStats() const;
+private:
+	double distance(const TileKey& key) const;
+	void workerLoop();
+	void run(const JobPtr& job);
+	void retire(const JobPtr& job);
+};
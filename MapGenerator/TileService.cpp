@@ -0,0 +1,145 @@
+#include "TileService.h"
+#include <cmath>
+#include <fstream>
+#include <sstream>
+
+using namespace std;
+
+TileService::TileService(const TileSettings& _settings)
+	: settings(_settings), fractal(_settings.seed, _settings.fractal), bytes(0), stats() {
+}
+
+void TileService::generate(const TileKey& key, HeightGrid& grid) const {
+	int n = settings.tileSize + 1;
+	grid = HeightGrid(n, n);
+	// World sample coordinates are exact integers, so a border sample gets the
+	// same bits in every tile that contains it
+	int64_t step = (int64_t)1 << key.lod;
+	int64_t x0 = key.tx * settings.tileSize * step;
+	int64_t z0 = key.tz * settings.tileSize * step;
+	double unit = 1.0 / settings.samplesPerUnit;
+	for (int j = 0; j < n; j++) {
+		float* row = grid.row(j);
+		double z = (double)(z0 + j * step) * unit;
+		for (int i = 0; i < n; i++) {
+			double x = (double)(x0 + i * step) * unit;
+			row[i] = (float)fractal.noiseWide(x, z, settings.z);
+		}
+	}
+}
+
+string TileService::tilePath(const TileKey& key) const {
+	ostringstream name;
+	name << settings.directory << "/tile_" << key.lod << "_" << key.tx << "_" << key.tz << ".hgt";
+	return name.str();
+}
+
+size_t TileService::tileBytes(const HeightTile& tile) {
+	return sizeof(HeightTile) + tile.grid.data.size() * sizeof(float);
+}
+
+shared_ptr<const HeightTile> TileService::build(const TileKey& key) {
+	shared_ptr<HeightTile> tile = make_shared<HeightTile>();
+	tile->key = key;
+
+	if (!settings.directory.empty()) {
+		string path = tilePath(key);
+		// Only files that exist are opened, a missing tile is not an error
+		if (ifstream(path).good() && readHeightFile(path, tile->grid) && tile->grid.width == settings.tileSize + 1
+			&& tile->grid.height == settings.tileSize + 1) {
+			lock_guard<mutex> lock(cacheMutex);
+			stats.loaded++;
+			return tile;
+		}
+		generate(key, tile->grid);
+		writeHeightFile(path, tile->grid, settings.diskFormat);
+	}
+	else
+		generate(key, tile->grid);
+
+	lock_guard<mutex> lock(cacheMutex);
+	stats.generated++;
+	return tile;
+}
+
+void TileService::insert(const shared_ptr<const HeightTile>& tile) {
+	lock_guard<mutex> lock(cacheMutex);
+	if (entries.count(tile->key))
+		return;
+	lru.push_front(tile->key);
+	Entry entry;
+	entry.tile = tile;
+	entry.position = lru.begin();
+	entries[tile->key] = entry;
+	bytes += tileBytes(*tile);
+
+	// Evict from the back, but always keep the tile just added
+	while (bytes > settings.cacheBytes && lru.size() > 1) {
+		auto found = entries.find(lru.back());
+		bytes -= tileBytes(*found->second.tile);
+		entries.erase(found);
+		lru.pop_back();
+		stats.evicted++;
+	}
+}
+
+shared_ptr<const HeightTile> TileService::getTile(int64_t tx, int64_t tz, int lod) {
+	TileKey key = { tx, tz, lod };
+	{
+		lock_guard<mutex> lock(cacheMutex);
+		auto found = entries.find(key);
+		if (found != entries.end()) {
+			lru.splice(lru.begin(), lru, found->second.position);
+			stats.hits++;
+			return found->second.tile;
+		}
+	}
+
+	// Built outside the lock so other tiles can be served meanwhile
+	shared_ptr<const HeightTile> tile = build(key);
+	insert(tile);
+	return tile;
+}
+
+void TileService::prefetch(const vector<TileKey>& keys, ThreadPool& pool) {
+	vector<TileKey> missing;
+	for (const TileKey& key : keys)
+		if (!isCached(key))
+			missing.push_back(key);
+	pool.parallelFor(0, (int)missing.size(), [&](int i) {
+		insert(build(missing[i]));
+	});
+}
+
+void TileService::tilesAround(double x, double z, double radius, int lod, vector<TileKey>& keys) const {
+	keys.clear();
+	double span = (double)settings.tileSize * (double)((int64_t)1 << lod);
+	int64_t tx0 = (int64_t)floor((x - radius) / span), tx1 = (int64_t)floor((x + radius) / span);
+	int64_t tz0 = (int64_t)floor((z - radius) / span), tz1 = (int64_t)floor((z + radius) / span);
+	for (int64_t tz = tz0; tz <= tz1; tz++) {
+		for (int64_t tx = tx0; tx <= tx1; tx++) {
+			// Distance from (x, z) to the tile's square
+			double dx = max(max(tx * span - x, x - (tx + 1) * span), 0.0);
+			double dz = max(max(tz * span - z, z - (tz + 1) * span), 0.0);
+			if (dx * dx + dz * dz <= radius * radius) {
+				TileKey key = { tx, tz, lod };
+				keys.push_back(key);
+			}
+		}
+	}
+}
+
+bool TileService::isCached(const TileKey& key) const {
+	lock_guard<mutex> lock(cacheMutex);
+	return entries.count(key) != 0;
+}
+
+size_t TileService::cachedBytes() const {
+	lock_guard<mutex> lock(cacheMutex);
+	return bytes;
+}
+
+TileStats TileService::getStats() const {
+	lock_guard<mutex> lock(cacheMutex);
+	return stats;
+}
@@ -0,0 +1,111 @@
+// Height tiles of an unbounded world, generated on demand from world
+// coordinates and kept in an LRU cache with a byte budget. Tiles can also be
+// persisted as height files and reloaded instead of regenerated.
+//
+// Tile (tx, tz) at LOD lod covers world samples [tx, tx + 1] * tileSize << lod
+// along x (likewise z), every (1 << lod)-th sample, so it holds
+// (tileSize + 1)^2 values. Neighbours share their border row or column and
+// compute it from the same world coordinates, so the borders match exactly
+#pragma once
+
+#include "FractalNoise.h"
+#include "HeightGrid.h"
+#include "HeightFile.h"
+#include "ThreadPool.h"
+#include <cstdint>
+#include <string>
+#include <memory>
+#include <mutex>
+#include <list>
+#include <unordered_map>
+#include <vector>
+
+struct TileSettings {
+	unsigned int seed;
+	FractalSettings fractal;
+	// World samples per noise lattice unit; 25.6 matches the original
+	// 256 x 256 image over 10 units
+	double samplesPerUnit;
+	// Slice through the 3D noise
+	double z;
+	// Cells per tile side at every LOD
+	int tileSize;
+	// Memory budget of the cache; the least recently used tiles go first
+	size_t cacheBytes;
+	// Generated tiles are written here and read back on a miss; empty disables it
+	std::string directory;
+	HeightFormat diskFormat;
+
+	TileSettings() : seed(237), samplesPerUnit(25.6), z(0.8), tileSize(128), cacheBytes((size_t)64 << 20),
+		diskFormat(HeightFormat::Float32) {}
+};
+
+struct TileKey {
+	std::int64_t tx;
+	std::int64_t tz;
+	int lod;
+
+	bool operator==(const TileKey& other) const { return tx == other.tx && tz == other.tz && lod == other.lod; }
+};
+
+struct TileKeyHash {
+	size_t operator()(const TileKey& key) const {
+		std::uint64_t h = (std::uint64_t)key.tx * 0x9e3779b97f4a7c15ULL;
+		h ^= (std::uint64_t)key.tz * 0xc2b2ae3d27d4eb4fULL + (h << 6) + (h >> 2);
+		h ^= (std::uint64_t)key.lod * 0x165667b19e3779f9ULL;
+		return (size_t)(h ^ (h >> 32));
+	}
+};
+
+struct HeightTile {
+	TileKey key;
+	// (tileSize + 1)^2 values in [0, 1]
+	HeightGrid grid;
+};
+
+struct TileStats {
+	size_t hits;
+	size_t generated;
+	size_t loaded;
+	size_t evicted;
+};
+
+class TileService {
+	TileSettings settings;
+	FractalNoise fractal;
+
+	typedef std::list<TileKey> LruList;
+	struct Entry {
+		std::shared_ptr<const HeightTile> tile;
+		LruList::iterator position;
+	};
+	mutable std::mutex cacheMutex;
+	// Most recently used at the front
+	LruList lru;
+	std::unordered_map<TileKey, Entry, TileKeyHash> entries;
+	size_t bytes;
+	TileStats stats;
+public:
+	TileService(const TileSettings& settings = TileSettings());
+
+	// The tile, from the cache, from disk or freshly generated. Safe to call
+	// from several threads; two threads missing the same tile may both build it
+	std::shared_ptr<const HeightTile> getTile(std::int64_t tx, std::int64_t tz, int lod);
+	// Build every missing tile of keys over the pool and cache them
+	void prefetch(const std::vector<TileKey>& keys, ThreadPool& pool);
+	// Tiles at lod whose area comes within radius world samples of (x, z)
+	void tilesAround(double x, double z, double radius, int lod, std::vector<TileKey>& keys) const;
+
+	bool isCached(const TileKey& key) const;
+	size_t cachedBytes() const;
+	TileStats getStats() const;
+	const TileSettings& getSettings() const { return settings; }
+
+	// Fill a tile from the noise, bypassing cache and disk
+	void generate(const TileKey& key, HeightGrid& grid) const;
+private:
+	std::string tilePath(const TileKey& key) const;
+	std::shared_ptr<const HeightTile> build(const TileKey& key);
+	void insert(const std::shared_ptr<const HeightTile>& tile);
+	static size_t tileBytes(const HeightTile& tile);
+};
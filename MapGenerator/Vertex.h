@@ -0,0 +1,19 @@
+#pragma once
+
+// Three floats laid out like DirectX::XMFLOAT3, so vertex buffers can be built
+// without the DirectX headers and uploaded as they are
+struct Float3
+{
+	float x, y, z;
+	Float3() :x(0), y(0), z(0) {}
+	Float3(float _x, float _y, float _z) :x(_x), y(_y), z(_z) {}
+};
+
+struct Vertex
+{
+	Float3 Position;
+	Float3 Normal;
+	Vertex() :Position(0, 0, 0), Normal(0, 0, 0) {}
+	Vertex(float x, float y, float z, float nx, float ny, float nz) :Position(x, y, z), Normal(nx, ny, nz) {}
+	Vertex(const Float3& pos, const Float3& norm) :Position(pos), Normal(norm) {}
+};
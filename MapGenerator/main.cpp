@@ -1,5 +1,5 @@
 // this program generates a heightmap using Perlin noise algorithm
-// and saves it as a ppm file and then loads and applies it to a 2D grid
+// and applies it to a 2D grid, all in memory
 
 // Windows stuff
 #include <windows.h>
@@ -15,11 +15,18 @@ using namespace DirectX;
 // C++ standard library stuff
 #include <iostream>
 #include <vector>
+#include <memory>
+#include <cstring>
+#include <cmath>
 
 // my stuff
-#include "PerlinNoise.h"
-#include "ppm.h"
-#include "Terrain.h"
+#include "HeightmapGenerator.h"
+#include "Erosion.h"
+#include "EditableTerrain.h"
+#include "Camera.h"
+
+// Vertices are built without DirectXMath and uploaded as they are
+static_assert(sizeof(Float3) == sizeof(XMFLOAT3), "Float3 must match XMFLOAT3");
 
 // Structures
 struct ConstantBuffer
@@ -45,17 +52,18 @@ ID3D11Buffer*           g_pVertexBuffer = nullptr;
 ID3D11Buffer*           g_pIndexBuffer = nullptr;
 ID3D11Buffer*           g_pConstantBuffer = nullptr;
 ID3D11RasterizerState*  g_pRSWireframe = nullptr;
-UINT                    g_IndexCount = 0;
 XMMATRIX				g_World;
 XMMATRIX				g_View;
 XMMATRIX				g_Projection;
-float                   g_fRadius = 500.0f;
-float                   g_fPhi = 0.35f * XM_PI;
-float                   g_fTheta = 1.3f * XM_PI;
+OrbitCamera             g_Camera;
+LodCamera               g_LodCamera;
+std::unique_ptr<EditableTerrain> g_pTerrain;
+std::vector<int>        g_ChunkLods;
+HeightmapSettings       g_Settings;
 
 // Function prototypes
 bool InitWindow(HINSTANCE hInstance);
-bool InitDirect3D();
+bool InitDirect3D(const HeightGrid& heights);
 void CleanupDirect3D();
 LRESULT CALLBACK MessageHandler(HWND hWnd, UINT uMsg, WPARAM wParam, LPARAM lParam);
 void Update(float deltaTime);
@@ -67,30 +75,14 @@ int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR lpCmdLine
 {
 	constexpr int img_width = 256;
 	constexpr int img_height = 256;
-	ppm image(img_width, img_height);
-	PerlinNoise pn(237);
-	int kk = 0;
-	for (int i = 0; i < img_height; ++i)
-	{
-		for (int j = 0; j < img_width; ++j)
-		{
-			double x = j / (double)img_width;
-			double y = i / (double)img_height;
-
-			double n = pn.noise(10 * x, 10 * y, 0.8);
-
-			image.r[kk] = floor(n * 255);
-			image.g[kk] = floor(n * 255);
-			image.b[kk] = floor(n * 255);
-			kk++;
-		}
-	}
-	image.write("perlin.ppm");
+	HeightmapGenerator generator(g_Settings);
+	HeightGrid heights = generator.generate(img_width, img_height);
+	Erosion().run(heights, ThreadPool::shared());
 
 	if (!InitWindow(hInstance))
 		return 0;
 
-	if (!InitDirect3D())
+	if (!InitDirect3D(heights))
 	{
 		CleanupDirect3D();
 		return 0;
@@ -142,7 +134,7 @@ bool InitWindow(HINSTANCE hInstance)
 
 	RECT rc = { 0, 0, 800, 600 };
 	AdjustWindowRect(&rc, WS_OVERLAPPEDWINDOW, false);
-	g_hWnd = CreateWindow(L"MAPGEN", L"Map Generator (use Arrow keys to control the camera)",
+	g_hWnd = CreateWindow(L"MAPGEN", L"Map Generator (Arrow keys: camera, R/F/T/G: raise/lower/flatten/smooth under the mouse, N: new seed)",
 		WS_OVERLAPPED | WS_SYSMENU | WS_CAPTION | WS_MINIMIZEBOX,
 		CW_USEDEFAULT, CW_USEDEFAULT,
 		rc.right - rc.left, rc.bottom - rc.top,
@@ -155,7 +147,7 @@ bool InitWindow(HINSTANCE hInstance)
 	return true;
 }
 
-bool InitDirect3D()
+bool InitDirect3D(const HeightGrid& heights)
 {
 	HRESULT hr = S_OK;
 
@@ -268,6 +260,7 @@ bool InitDirect3D()
 	vp.MaxDepth = 1.0f;
 	
 	g_pImmediateContext->RSSetViewports(1, &vp);
+	g_LodCamera.viewportHeight = vp.Height;
 
 	ID3D10Blob* pVSBlob = nullptr;
 	hr = D3DReadFileToBlob(L"../Debug/VertexShader.cso", &pVSBlob);
@@ -306,13 +299,15 @@ bool InitDirect3D()
 		return false;
 	}
 
-	Terrain terrain("perlin.ppm");
-
-	g_IndexCount = terrain.indices.size();
+	// New seeds are eroded like the first map
+	g_pTerrain.reset(new EditableTerrain(heights, g_Settings));
+	g_pTerrain->setErosion(ErosionSettings());
+	const ChunkedTerrain& terrain = g_pTerrain->terrain();
 
+	// Edits rewrite ranges of the vertex buffer, see Update()
 	D3D11_BUFFER_DESC bd;
 	bd.ByteWidth = sizeof(Vertex) * terrain.vertices.size();
-	bd.Usage = D3D11_USAGE_IMMUTABLE;
+	bd.Usage = D3D11_USAGE_DEFAULT;
 	bd.BindFlags = D3D11_BIND_VERTEX_BUFFER;
 	bd.CPUAccessFlags = 0;
 	bd.MiscFlags = 0;
@@ -329,7 +324,7 @@ bool InitDirect3D()
 	UINT offset = 0;
 	g_pImmediateContext->IASetVertexBuffers(0, 1, &g_pVertexBuffer, &stride, &offset);
 
-	bd.ByteWidth = sizeof(UINT) * terrain.indices.size();
+	bd.ByteWidth = sizeof(std::uint16_t) * terrain.indices.size();
 	bd.Usage = D3D11_USAGE_IMMUTABLE;
 	bd.BindFlags = D3D11_BIND_INDEX_BUFFER;
 	bd.CPUAccessFlags = 0;
@@ -342,9 +337,11 @@ bool InitDirect3D()
 	if (FAILED(hr))
 		return false;
 
-	g_pImmediateContext->IASetIndexBuffer(g_pIndexBuffer, DXGI_FORMAT_R32_UINT, 0);
+	// Chunks share 16-bit index lists and differ only by base vertex
+	g_pImmediateContext->IASetIndexBuffer(g_pIndexBuffer, DXGI_FORMAT_R16_UINT, 0);
 
-	g_pImmediateContext->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+	g_pImmediateContext->IASetPrimitiveTopology(terrain.getIndexOrder() == IndexOrder::Strip
+		? D3D11_PRIMITIVE_TOPOLOGY_TRIANGLESTRIP : D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
 
 	bd.ByteWidth = sizeof(ConstantBuffer);
 	bd.Usage = D3D11_USAGE_DEFAULT;
@@ -370,6 +367,7 @@ bool InitDirect3D()
 
 	g_World = XMMatrixIdentity();
 	g_Projection = XMMatrixPerspectiveFovLH(XM_PIDIV4, width / (float)height, 0.1f, 5000.0f);
+	g_LodCamera.fovY = XM_PIDIV4;
 
 	return true;
 }
@@ -378,6 +376,7 @@ void CleanupDirect3D()
 {
 	if (g_pImmediateContext) g_pImmediateContext->ClearState();
 
+	g_pTerrain.reset();
 	if (g_pRSWireframe) g_pRSWireframe->Release();
 	if (g_pConstantBuffer) g_pConstantBuffer->Release();
 	if (g_pIndexBuffer) g_pIndexBuffer->Release();
@@ -408,6 +407,15 @@ LRESULT CALLBACK MessageHandler(HWND hWnd, UINT uMsg, WPARAM wParam, LPARAM lPar
 		hDC = BeginPaint(hWnd, &ps);
 		EndPaint(hWnd, &ps);
 		return 1;
+
+	case WM_KEYDOWN:
+		// N: a new map from the next seed, regenerated tile by tile
+		if (wParam == 'N' && g_pTerrain)
+		{
+			g_Settings.seed++;
+			g_pTerrain->setSettings(g_Settings);
+		}
+		return 0;
 	}
 	return DefWindowProc(hWnd, uMsg, wParam, lParam);
 }
@@ -415,23 +423,99 @@ LRESULT CALLBACK MessageHandler(HWND hWnd, UINT uMsg, WPARAM wParam, LPARAM lPar
 void Update(float deltaTime)
 {
 	if (GetAsyncKeyState(VK_LEFT))
-		g_fTheta -= deltaTime * 1.5f;
+		g_Camera.theta -= deltaTime * 1.5f;
 	else if (GetAsyncKeyState(VK_RIGHT))
-		g_fTheta += deltaTime * 1.5f;
+		g_Camera.theta += deltaTime * 1.5f;
 	if (GetAsyncKeyState(VK_UP))
-		g_fRadius -= deltaTime * 200.0f;
+		g_Camera.radius -= deltaTime * 200.0f;
 	if (GetAsyncKeyState(VK_DOWN))
-		g_fRadius += deltaTime * 200.0f;
+		g_Camera.radius += deltaTime * 200.0f;
 
-	// Convert spherical to cartesian
-	float x = g_fRadius * sinf(g_fPhi) * cosf(g_fTheta);
-	float y = g_fRadius * cosf(g_fPhi);
-	float z = g_fRadius * sinf(g_fPhi) * sinf(g_fTheta);
+	g_Camera.eye(g_LodCamera.x, g_LodCamera.y, g_LodCamera.z);
 
-	XMVECTOR Eye = XMVectorSet(x, y, z, 0.0f);
+	XMVECTOR Eye = XMVectorSet(g_LodCamera.x, g_LodCamera.y, g_LodCamera.z, 0.0f);
 	XMVECTOR At = XMVectorSet(0.0f, 0.0f, 0.0f, 0.0f);
 	XMVECTOR Up = XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f);
 	g_View = XMMatrixLookAtLH(Eye, At, Up);
+
+	// Brushes under the mouse while a key is held: R raises, F lowers,
+	// T flattens to the height first touched and G smooths
+	static bool flattening = false;
+	static float flattenTarget = 0.0f;
+	Brush brush;
+	bool brushing = true;
+	if (GetAsyncKeyState('R'))
+		brush.mode = BrushMode::Raise;
+	else if (GetAsyncKeyState('F'))
+		brush.mode = BrushMode::Lower;
+	else if (GetAsyncKeyState('T'))
+		brush.mode = BrushMode::Flatten;
+	else if (GetAsyncKeyState('G'))
+		brush.mode = BrushMode::Smooth;
+	else
+		brushing = false;
+	if (!brushing || brush.mode != BrushMode::Flatten)
+		flattening = false;
+
+	if (brushing)
+	{
+		// Where the ray through the cursor meets the ground
+		POINT cursor;
+		RECT rc;
+		GetCursorPos(&cursor);
+		ScreenToClient(g_hWnd, &cursor);
+		GetClientRect(g_hWnd, &rc);
+		XMVECTOR nearPoint = XMVector3Unproject(XMVectorSet((float)cursor.x, (float)cursor.y, 0.0f, 0.0f),
+			0.0f, 0.0f, (float)rc.right, (float)rc.bottom, 0.0f, 1.0f, g_Projection, g_View, g_World);
+		XMVECTOR farPoint = XMVector3Unproject(XMVectorSet((float)cursor.x, (float)cursor.y, 1.0f, 0.0f),
+			0.0f, 0.0f, (float)rc.right, (float)rc.bottom, 0.0f, 1.0f, g_Projection, g_View, g_World);
+		XMFLOAT3 from, to;
+		XMStoreFloat3(&from, nearPoint);
+		XMStoreFloat3(&to, farPoint);
+		Float3 direction(to.x - from.x, to.y - from.y, to.z - from.z);
+		float length = sqrtf(direction.x * direction.x + direction.y * direction.y + direction.z * direction.z);
+		RayHit ground = g_pTerrain->query().raycast(Ray(Float3(from.x, from.y, from.z), direction, length));
+		if (ground.hit)
+		{
+			brush.x = ground.position.x;
+			brush.z = ground.position.z;
+			brush.radius = 24.0f;
+			brush.strength = brush.mode == BrushMode::Raise || brush.mode == BrushMode::Lower
+				? deltaTime * 0.2f : deltaTime * 4.0f;
+			if (brush.mode == BrushMode::Flatten && !flattening)
+			{
+				int sx, sz;
+				g_pTerrain->sampleAt(brush.x, brush.z, sx, sz);
+				flattenTarget = g_pTerrain->heights().at(sx, sz);
+				flattening = true;
+			}
+			brush.target = flattenTarget;
+			g_pTerrain->applyBrush(brush);
+		}
+	}
+
+	// Upload only the vertex ranges of the chunks that changed
+	const ChunkedTerrain& terrain = g_pTerrain->terrain();
+	for (int i : g_pTerrain->update())
+	{
+		const TerrainChunk& chunk = terrain.chunks[i];
+		D3D11_BOX box;
+		box.left = (UINT)(chunk.firstVertex * sizeof(Vertex));
+		box.right = (UINT)((chunk.firstVertex + chunk.vertexCount) * sizeof(Vertex));
+		box.top = 0;
+		box.bottom = 1;
+		box.front = 0;
+		box.back = 1;
+		g_pImmediateContext->UpdateSubresource(g_pVertexBuffer, 0, &box, &terrain.vertices[chunk.firstVertex], 0, 0);
+	}
+	terrain.selectLods(g_LodCamera, g_ChunkLods);
+
+	// Chunks outside the view are not drawn at all
+	XMFLOAT4X4 stored;
+	XMStoreFloat4x4(&stored, g_View * g_Projection);
+	Matrix4 viewProjection;
+	memcpy(viewProjection.m, stored.m, sizeof(viewProjection.m));
+	terrain.cullChunks(viewProjection, g_ChunkLods);
 }
 
 void Render()
@@ -450,7 +534,16 @@ void Render()
 	g_pImmediateContext->VSSetConstantBuffers(0, 1, &g_pConstantBuffer);
 	g_pImmediateContext->PSSetShader(g_pPixelShader, nullptr, 0);
 
-	g_pImmediateContext->DrawIndexed(g_IndexCount, 0, 0);
+	// One draw per visible chunk at the LOD Update picked for it
+	const ChunkedTerrain& terrain = g_pTerrain->terrain();
+	for (size_t i = 0; i < terrain.chunks.size(); i++)
+	{
+		if (g_ChunkLods[i] == CULLED_LOD)
+			continue;
+		const TerrainChunk& chunk = terrain.chunks[i];
+		const ChunkLod& lod = chunk.lods[g_ChunkLods[i]];
+		g_pImmediateContext->DrawIndexed(lod.indexCount, lod.firstIndex, chunk.firstVertex);
+	}
 
 	g_pSwapChain->Present(1, 0);
 }
\ No newline at end of file
@@ -0,0 +1,425 @@
+// Headless command line generator: writes a heightmap without opening a window
+// and reports how long every stage took, for batch runs and profiling
+//
+//     mapgen [--size N] [--width N] [--height N] [--seed N] [--octaves N]
+//            [--frequency F] [--noise perlin3d|perlin3d-float|perlin2d|simplex2d|simplex3d]
+//            [--format unorm16|half|float32|pgm16|ppm]
+//            [--out FILE] [--threads N] [--erode N] [--thermal N] [--mesh]
+//            [--seeds N] [--thumb N] [--warp F] [--warp-cell N]
+//            [--simplify rtin|quadric] [--max-error F] [--render FILE] [--poses N]
+//     mapgen bench [name ...]
+//
+// With --seeds, N thumbnails of --thumb samples (seeds --seed, --seed + 1,
+// ...) go into one contact sheet instead of writing a single map. --warp
+// displaces the noise by up to F noise units, with the warp evaluated every
+// --warp-cell samples and interpolated in between. --simplify builds an
+// adaptive mesh within --max-error world units of every sample instead of
+// the full grid mesh. --render draws the viewer's frame on the CPU into a PPM,
+// or --poses frames along the benchmark orbit, numbered FILE_0.ppm and so on
+
+#include "HeightmapGenerator.h"
+#include "HeightFile.h"
+#include "Erosion.h"
+#include "MeshBuilder.h"
+#include "AdaptiveTerrain.h"
+#include "ChunkedTerrain.h"
+#include "SoftwareRasterizer.h"
+#include "Camera.h"
+#include "ThreadPool.h"
+#include "Benchmark.h"
+#include "Stopwatch.h"
+#include "Simd.h"
+#include "ppm.h"
+#include "pnm.h"
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <cmath>
+#include <cstdlib>
+#include <cstdio>
+#include <algorithm>
+#include <memory>
+
+using namespace std;
+
+namespace {
+
+struct Options {
+	int width = 256;
+	int height = 256;
+	HeightmapSettings heightmap;
+	string format = "unorm16";
+	string out;
+	unsigned int threads = 0;
+	// Erosion iterations, none by default
+	int erode = 0;
+	int thermal = 0;
+	bool mesh = false;
+	// Seed search: thumbnails of this many seeds and their size
+	int seeds = 0;
+	int thumb = 64;
+	// Adaptive meshing, implies --mesh
+	bool simplify = false;
+	AdaptiveSettings adaptive;
+	// CPU rendered frames of the viewer's window size
+	string render;
+	int poses = 1;
+};
+
+void usage() {
+	cerr << "usage: mapgen [--size N] [--width N] [--height N] [--seed N] [--octaves N]\n"
+		"              [--frequency F] [--noise perlin3d|perlin3d-float|perlin2d|simplex2d|simplex3d]\n"
+		"              [--format unorm16|half|float32|pgm16|ppm]\n"
+		"              [--out FILE] [--threads N] [--erode N] [--thermal N] [--mesh]\n"
+		"              [--seeds N] [--thumb N] [--warp F] [--warp-cell N]\n"
+		"              [--simplify rtin|quadric] [--max-error F] [--render FILE] [--poses N]\n"
+		"       mapgen bench [name ...]\n"
+		"benchmarks: noise heightmap fractal pnm view formats mesh normals lod indices tiles pipeline erosion derivatives backends precision seeds warp adaptive render culling queries edits\n";
+}
+
+bool parseOptions(int argc, char** argv, Options& options) {
+	for (int i = 1; i < argc; i++) {
+		string arg = argv[i];
+		if (arg == "--mesh") {
+			options.mesh = true;
+			continue;
+		}
+		const char* value = i + 1 < argc ? argv[i + 1] : nullptr;
+		bool known = arg == "--size" || arg == "--width" || arg == "--height" || arg == "--seed" || arg == "--octaves"
+			|| arg == "--frequency" || arg == "--noise" || arg == "--format" || arg == "--out" || arg == "--threads" || arg == "--erode"
+			|| arg == "--thermal" || arg == "--seeds" || arg == "--thumb" || arg == "--warp" || arg == "--warp-cell"
+			|| arg == "--simplify" || arg == "--max-error" || arg == "--render" || arg == "--poses";
+		if (!known) {
+			cerr << "Error. Unknown option " << arg << "\n";
+			return false;
+		}
+		if (!value) {
+			cerr << "Error. " << arg << " needs a value\n";
+			return false;
+		}
+		i++;
+		if (arg == "--size")
+			options.width = options.height = atoi(value);
+		else if (arg == "--width")
+			options.width = atoi(value);
+		else if (arg == "--height")
+			options.height = atoi(value);
+		else if (arg == "--seed")
+			options.heightmap.seed = (unsigned int)strtoul(value, nullptr, 10);
+		else if (arg == "--octaves")
+			options.heightmap.fractal.octaves = atoi(value);
+		else if (arg == "--frequency")
+			options.heightmap.frequency = atof(value);
+		else if (arg == "--noise") {
+			bool found = false;
+			for (NoiseType type : { NoiseType::Perlin3D, NoiseType::Perlin3DFloat, NoiseType::Perlin2D, NoiseType::Simplex2D, NoiseType::Simplex3D }) {
+				if (value == string(noiseTypeName(type))) {
+					options.heightmap.fractal.type = type;
+					found = true;
+				}
+			}
+			if (!found) {
+				cerr << "Error. Unknown noise " << value << "\n";
+				return false;
+			}
+		}
+		else if (arg == "--format")
+			options.format = value;
+		else if (arg == "--out")
+			options.out = value;
+		else if (arg == "--erode")
+			options.erode = atoi(value);
+		else if (arg == "--thermal")
+			options.thermal = atoi(value);
+		else if (arg == "--seeds")
+			options.seeds = atoi(value);
+		else if (arg == "--thumb")
+			options.thumb = atoi(value);
+		else if (arg == "--warp")
+			options.heightmap.warp.amplitude = atof(value);
+		else if (arg == "--warp-cell")
+			options.heightmap.warp.cellSize = atoi(value);
+		else if (arg == "--simplify") {
+			if (value == string("rtin"))
+				options.adaptive.method = AdaptiveMethod::Rtin;
+			else if (value == string("quadric"))
+				options.adaptive.method = AdaptiveMethod::Quadric;
+			else {
+				cerr << "Error. Unknown mesher " << value << "\n";
+				return false;
+			}
+			options.simplify = options.mesh = true;
+		}
+		else if (arg == "--max-error")
+			options.adaptive.maxError = (float)atof(value);
+		else if (arg == "--render")
+			options.render = value;
+		else if (arg == "--poses")
+			options.poses = atoi(value);
+		else
+			options.threads = (unsigned int)atoi(value);
+	}
+	if (options.width < 2 || options.height < 2 || options.heightmap.fractal.octaves < 1) {
+		cerr << "Error. The map needs at least 2x2 samples and one octave\n";
+		return false;
+	}
+	if (options.seeds < 0 || (options.seeds > 0 && options.thumb < 2)) {
+		cerr << "Error. Thumbnails need at least 2x2 samples\n";
+		return false;
+	}
+	if (options.heightmap.warp.cellSize < 1) {
+		cerr << "Error. The warp cell needs at least one sample\n";
+		return false;
+	}
+	if (options.poses < 1) {
+		cerr << "Error. Rendering needs at least one pose\n";
+		return false;
+	}
+	return true;
+}
+
+bool writeGrid(const HeightGrid& grid, const string& format, const string& fname) {
+	if (format == "unorm16")
+		return writeHeightFile(fname, grid, HeightFormat::UNorm16);
+	if (format == "half")
+		return writeHeightFile(fname, grid, HeightFormat::Half);
+	if (format == "float32")
+		return writeHeightFile(fname, grid, HeightFormat::Float32);
+	if (format == "pgm16") {
+		pnm_writer writer;
+		if (!writer.open(fname, pnm_header(1, grid.width, grid.height, 65535)))
+			return false;
+		vector<uint16_t> row(grid.width);
+		for (int z = 0; z < grid.height; z++) {
+			const float* src = grid.row(z);
+			for (int x = 0; x < grid.width; x++)
+				row[x] = (uint16_t)lrintf(min(max(src[x], 0.0f), 1.0f) * 65535.0f);
+			if (!writer.write_rows(1, row.data()))
+				return false;
+		}
+		return writer.close();
+	}
+	if (format == "ppm") {
+		// The viewer's original format: one gray byte copied into R, G and B
+		ppm image(grid.width, grid.height);
+		for (uint64_t i = 0; i < image.size; i++)
+			image.r[i] = image.g[i] = image.b[i] = (unsigned char)floor(grid.data[i] * 255);
+		return image.write(fname);
+	}
+	cerr << "Error. Unknown format " << format << "\n";
+	return false;
+}
+
+// Thumbnails in rows of a square-ish grid, one black sample between them
+bool writeContactSheet(const vector<HeightGrid>& thumbnails, int thumb, const string& fname) {
+	int columns = (int)ceil(sqrt((double)thumbnails.size()));
+	int rows = ((int)thumbnails.size() + columns - 1) / columns;
+	int cell = thumb + 1;
+	ppm image(columns * cell - 1, rows * cell - 1);
+	for (size_t t = 0; t < thumbnails.size(); t++) {
+		int x0 = (int)(t % columns) * cell, z0 = (int)(t / columns) * cell;
+		for (int z = 0; z < thumb; z++) {
+			const float* src = thumbnails[t].row(z);
+			uint64_t i = (uint64_t)(z0 + z) * image.width + x0;
+			for (int x = 0; x < thumb; x++, i++)
+				image.r[i] = image.g[i] = image.b[i] = (unsigned char)floor(min(max(src[x], 0.0f), 1.0f) * 255);
+		}
+	}
+	return image.write(fname);
+}
+
+void stage(const char* name, double seconds, double samples) {
+	printf("%-10s %10.3f ms  %8.2f Msamples/s\n", name, seconds * 1000.0, samples / seconds / 1e6);
+}
+
+// FILE for a single frame, FILE_i.ext along the orbit
+string frameName(const string& fname, int pose, int poses) {
+	if (poses == 1)
+		return fname;
+	size_t dot = fname.find_last_of('.');
+	size_t slash = fname.find_last_of("/\\");
+	if (dot == string::npos || (slash != string::npos && dot < slash))
+		dot = fname.size();
+	return fname.substr(0, dot) + "_" + to_string(pose) + fname.substr(dot);
+}
+
+// The default viewer pose, or poses frames of the scripted orbit, drawn with
+// the LODs the viewer would pick for them (or the adaptive mesh). False if a
+// frame could not be written
+bool renderFrames(const HeightGrid& grid, const Options& options, const AdaptiveTerrain* adaptive, ThreadPool& pool) {
+	const int width = 800, height = 600;
+	Stopwatch timer;
+	unique_ptr<ChunkedTerrain> terrain;
+	if (!adaptive) {
+		terrain.reset(new ChunkedTerrain(grid.width, grid.height, gridRows(grid)));
+		stage("chunks", timer.seconds(), (double)grid.width * grid.height);
+	}
+
+	SoftwareRasterizer raster(width, height);
+	LodCamera lodCamera;
+	lodCamera.viewportHeight = (float)height;
+	vector<int> lods;
+	for (int pose = 0; pose < options.poses; pose++) {
+		OrbitCamera camera = options.poses == 1 ? OrbitCamera() : OrbitCamera::scripted(pose, options.poses);
+		camera.eye(lodCamera.x, lodCamera.y, lodCamera.z);
+		raster.setTransforms(Matrix4::identity(), camera.view(), OrbitCamera::projection(width, height));
+		timer.restart();
+		raster.clear();
+		if (adaptive)
+			raster.draw(adaptive->vertices, adaptive->indices, pool);
+		else {
+			terrain->selectLods(lodCamera, lods);
+			terrain->cullChunks(camera.view() * OrbitCamera::projection(width, height), lods);
+			raster.draw(*terrain, lods, pool);
+		}
+		double seconds = timer.seconds();
+		string fname = frameName(options.render, pose, options.poses);
+		if (!raster.image().write(fname))
+			return false;
+		printf("pose %-5d %10.3f ms  %8zu triangles  %s\n", pose, seconds * 1000.0, raster.drawnTriangles(), fname.c_str());
+	}
+	return true;
+}
+
+
+int runBench(int argc, char** argv) {
+	const string path = "mapgen_bench.tmp";
+	vector<string> names;
+	for (int i = 2; i < argc; i++)
+		names.push_back(argv[i]);
+	auto wanted = [&names](const char* name) {
+		if (names.empty())
+			return true;
+		for (const string& n : names)
+			if (n == name)
+				return true;
+		return false;
+	};
+
+	cout << "simd: " << simdLevelName(detectSimdLevel()) << ", threads: " << ThreadPool::shared().size() << "\n";
+	if (wanted("noise")) benchNoiseRow(cout);
+	if (wanted("heightmap")) benchHeightmap(cout);
+	if (wanted("fractal")) benchFractal(cout);
+	if (wanted("pnm")) benchPnm(cout, path);
+	if (wanted("view")) benchHeightmapView(cout, path);
+	if (wanted("formats")) benchHeightFormats(cout, path);
+	if (wanted("mesh")) benchMesh(cout);
+	if (wanted("normals")) benchNormals(cout);
+	if (wanted("lod")) benchChunkLod(cout);
+	if (wanted("indices")) benchGridIndices(cout);
+	if (wanted("tiles")) benchTiles(cout);
+	if (wanted("pipeline")) benchPipeline(cout);
+	if (wanted("erosion")) benchErosion(cout);
+	if (wanted("derivatives")) benchDerivatives(cout);
+	if (wanted("backends")) benchNoiseBackends(cout);
+	if (wanted("precision")) benchNoisePrecision(cout);
+	if (wanted("seeds")) benchSeeds(cout);
+	if (wanted("warp")) benchWarp(cout);
+	if (wanted("adaptive")) benchAdaptive(cout);
+	if (wanted("render")) benchRender(cout);
+	if (wanted("culling")) benchCulling(cout);
+	if (wanted("queries")) benchQueries(cout);
+	if (wanted("edits")) benchEdits(cout);
+	remove(path.c_str());
+	return 0;
+}
+
+}
+
+int main(int argc, char** argv) {
+	if (argc > 1 && string(argv[1]) == "bench")
+		return runBench(argc, argv);
+	if (argc > 1 && (string(argv[1]) == "--help" || string(argv[1]) == "-h")) {
+		usage();
+		return 0;
+	}
+
+	Options options;
+	if (!parseOptions(argc, argv, options)) {
+		usage();
+		return 1;
+	}
+	if (options.out.empty() && options.seeds > 0)
+		options.out = "seeds.ppm";
+	if (options.out.empty())
+		options.out = options.format == "ppm" ? "perlin.ppm" : options.format == "pgm16" ? "perlin.pgm" : "perlin.hgt";
+
+	Stopwatch total;
+	double samples = (double)options.width * options.height;
+	ThreadPool pool(options.threads);
+	cout << "mapgen " << options.width << "x" << options.height << ", seed " << options.heightmap.seed
+		<< ", " << options.heightmap.fractal.octaves << " octaves of " << noiseTypeName(options.heightmap.fractal.type) << ", " << pool.size() << " threads, "
+		<< simdLevelName(detectSimdLevel()) << "\n";
+
+	if (options.seeds > 0) {
+		Stopwatch timer;
+		vector<unsigned int> seeds(options.seeds);
+		for (int i = 0; i < options.seeds; i++)
+			seeds[i] = options.heightmap.seed + (unsigned int)i;
+		vector<HeightGrid> thumbnails;
+		generateThumbnails(options.heightmap, seeds, options.thumb, thumbnails, pool);
+		double seconds = timer.seconds();
+		stage("thumbnails", seconds, (double)options.thumb * options.thumb * options.seeds);
+		printf("%d seeds, %.0f maps/s\n", options.seeds, options.seeds / seconds);
+		if (!writeContactSheet(thumbnails, options.thumb, options.out)) {
+			cerr << "Error. Could not write " << options.out << "\n";
+			return 1;
+		}
+		cout << "wrote " << options.out << "\n";
+		return 0;
+	}
+
+	Stopwatch timer;
+	HeightmapGenerator generator(options.heightmap);
+	HeightGrid grid(options.width, options.height);
+	generator.generate(grid, pool);
+	stage("generate", timer.seconds(), samples);
+
+	if (options.erode > 0 || options.thermal > 0) {
+		// Reported per iteration: cells times iterations per second
+		timer.restart();
+		ErosionSettings settings;
+		settings.hydraulic.iterations = options.erode;
+		settings.thermal.iterations = options.thermal;
+		Erosion erosion(settings);
+		if (options.erode > 0)
+			erosion.hydraulic(grid, pool);
+		if (options.thermal > 0)
+			erosion.thermal(grid, pool);
+		stage("erode", timer.seconds(), samples * (options.erode + options.thermal));
+	}
+
+	timer.restart();
+	if (!writeGrid(grid, options.format, options.out)) {
+		cerr << "Error. Could not write " << options.out << "\n";
+		return 1;
+	}
+	stage("write", timer.seconds(), samples);
+
+	if (options.simplify) {
+		timer.restart();
+		AdaptiveTerrain terrain(grid, options.adaptive, pool);
+		stage("mesh", timer.seconds(), samples);
+		size_t full = (size_t)2 * (grid.width - 1) * (grid.height - 1);
+		printf("%zu triangles of %zu (%.1fx fewer) with %s\n", terrain.triangleCount(), full,
+			(double)full / max<size_t>(terrain.triangleCount(), 1), terrain.getMethod() == AdaptiveMethod::Rtin ? "rtin" : "quadric");
+		if (!options.render.empty() && !renderFrames(grid, options, &terrain, pool))
+			return 1;
+	}
+	else if (options.mesh) {
+		timer.restart();
+		MeshBuilder builder(grid.width, grid.height, gridRows(grid));
+		vector<Vertex> vertices;
+		vector<unsigned int> indices;
+		builder.buildInterleaved(vertices, pool);
+		builder.buildIndices(indices, pool);
+		stage("mesh", timer.seconds(), samples);
+	}
+	if (!options.render.empty() && !options.simplify && !renderFrames(grid, options, nullptr, pool))
+		return 1;
+
+	stage("total", total.seconds(), samples);
+	cout << "wrote " << options.out << "\n";
+	return 0;
+}
@@ -0,0 +1,285 @@
+#include <iostream>
+#include <algorithm>
+#include <cstdio>
+
+#include "pnm.h"
+
+//size of the stream buffers and of the batches used for (de)interleaving
+constexpr std::size_t STREAM_BUFFER_SIZE = 1 << 20;
+constexpr std::uint64_t BATCH_BYTES = 4 << 20;
+
+pnm_header::pnm_header() : channels(3), width(0), height(0), max_col_val(255) {}
+
+pnm_header::pnm_header(unsigned int _channels, unsigned int _width, unsigned int _height, unsigned int _max_col_val)
+    : channels(_channels), width(_width), height(_height), max_col_val(_max_col_val) {}
+
+//rows per batch so that a batch stays around BATCH_BYTES
+static unsigned int batch_rows(const pnm_header& hdr) {
+    std::uint64_t rows = BATCH_BYTES / std::max<std::uint64_t>(1, hdr.row_bytes());
+    return (unsigned int)std::max<std::uint64_t>(1, std::min<std::uint64_t>(rows, hdr.height));
+}
+
+//parse width, height and max_col_val of a PNM header, after the magic number;
+//next() returns the following byte, or EOF. Both the in-memory parser and
+//pnm_reader go through here, so they accept exactly the same headers
+template<class Next>
+static bool parse_header_fields(Next next, pnm_header& hdr) {
+    unsigned int* fields[] = { &hdr.width, &hdr.height, &hdr.max_col_val };
+    for (unsigned int* field : fields) {
+        //skip whitespace and comments
+        int c = next();
+        while (c != EOF) {
+            if (c == '#') {
+                while (c != EOF && c != '\n')
+                    c = next();
+            }
+            else if (c != ' ' && c != '\t' && c != '\n' && c != '\r') {
+                break;
+            }
+            c = next();
+        }
+        if (c < '0' || c > '9')
+            return false;
+
+        std::uint64_t v = 0;
+        while (c >= '0' && c <= '9') {
+            v = v * 10 + (c - '0');
+            if (v > 0xffffffffu)
+                return false;
+            c = next();
+        }
+        *field = (unsigned int)v;
+        //exactly one whitespace character separates the header from the data, and it was just consumed
+        if (c == EOF)
+            return false;
+    }
+    return hdr.max_col_val > 0 && hdr.max_col_val <= 65535;
+}
+
+//parse the header of a PNM file held in memory
+
+bool pnm_parse_header(const unsigned char* data, std::uint64_t size, pnm_header& hdr, std::uint64_t& offset) {
+    if (size < 2 || data[0] != 'P' || (data[1] != '5' && data[1] != '6'))
+        return false;
+    hdr.channels = data[1] == '5' ? 1 : 3;
+
+    std::uint64_t pos = 2;
+    auto next = [&]() -> int { return pos < size ? data[pos++] : EOF; };
+    if (!parse_header_fields(next, hdr))
+        return false;
+    offset = pos;
+    return offset + hdr.row_bytes() * hdr.height <= size;
+}
+
+pnm_reader::pnm_reader() : stream_buffer(STREAM_BUFFER_SIZE), next_row(0) {}
+
+bool pnm_reader::read_header() {
+    char magic[2];
+    inp.read(magic, 2);
+    if (!inp || magic[0] != 'P' || (magic[1] != '5' && magic[1] != '6')) {
+        std::cout << "Error. Unrecognized file format." << std::endl;
+        return false;
+    }
+    hdr.channels = magic[1] == '5' ? 1 : 3;
+
+    if (!parse_header_fields([this]() { return inp.get(); }, hdr)) {
+        std::cout << "Header file format error." << std::endl;
+        return false;
+    }
+    return true;
+}
+
+//open fname and parse its header
+
+bool pnm_reader::open(const std::string& fname) {
+    if (inp.is_open())
+        inp.close();
+    inp.clear();
+    inp.rdbuf()->pubsetbuf(stream_buffer.data(), stream_buffer.size());
+    inp.open(fname.c_str(), std::ios::in | std::ios::binary);
+    next_row = 0;
+    hdr = pnm_header();
+    if (!inp.is_open()) {
+        std::cout << "Error. Unable to open " << fname << std::endl;
+        return false;
+    }
+    return read_header();
+}
+
+//read count raw rows into the internal row buffer
+
+bool pnm_reader::fill(unsigned int count) {
+    row_buffer.resize((std::size_t)(count * hdr.row_bytes()));
+    return read_rows(count, row_buffer.data());
+}
+
+bool pnm_reader::read_rows(unsigned int count, unsigned char* dst) {
+    if (count > rows_left()) {
+        std::cout << "Error. Read past the last row." << std::endl;
+        return false;
+    }
+    std::streamsize bytes = (std::streamsize)(count * hdr.row_bytes());
+    inp.read((char*)dst, bytes);
+    if (inp.gcount() != bytes) {
+        std::cout << "Error. Unexpected end of file." << std::endl;
+        return false;
+    }
+    next_row += count;
+    return true;
+}
+
+bool pnm_reader::read_rows(unsigned int count, std::uint16_t* dst) {
+    std::uint64_t samples_per_row = (std::uint64_t)hdr.width * hdr.channels;
+    unsigned int batch = batch_rows(hdr);
+    while (count > 0) {
+        unsigned int rows = std::min(batch, count);
+        if (!fill(rows))
+            return false;
+
+        std::size_t n = (std::size_t)(rows * samples_per_row);
+        const unsigned char* src = row_buffer.data();
+        if (hdr.bytes_per_sample() == 2) {
+            for (std::size_t i = 0; i < n; ++i)
+                dst[i] = (std::uint16_t)(src[2 * i] << 8 | src[2 * i + 1]);
+        }
+        else {
+            std::copy(src, src + n, dst);
+        }
+        dst += n;
+        count -= rows;
+    }
+    return true;
+}
+
+bool pnm_reader::read_rows(unsigned int count, unsigned char* r, unsigned char* g, unsigned char* b) {
+    if (hdr.bytes_per_sample() != 1) {
+        std::cout << "Error. Planar reads need an 8-bit file." << std::endl;
+        return false;
+    }
+    unsigned int batch = batch_rows(hdr);
+    while (count > 0) {
+        unsigned int rows = std::min(batch, count);
+        std::size_t n = (std::size_t)((std::uint64_t)rows * hdr.width);
+        if (hdr.channels == 1) {
+            //gray rows land straight in r and are copied to the other planes
+            if (!read_rows(rows, r))
+                return false;
+            std::copy(r, r + n, g);
+            std::copy(r, r + n, b);
+        }
+        else {
+            if (!fill(rows))
+                return false;
+            const unsigned char* src = row_buffer.data();
+            for (std::size_t i = 0; i < n; ++i) {
+                r[i] = src[3 * i];
+                g[i] = src[3 * i + 1];
+                b[i] = src[3 * i + 2];
+            }
+        }
+        r += n;
+        g += n;
+        b += n;
+        count -= rows;
+    }
+    return true;
+}
+
+pnm_writer::pnm_writer() : stream_buffer(STREAM_BUFFER_SIZE), next_row(0) {}
+
+//create fname and write the header
+
+bool pnm_writer::open(const std::string& fname, const pnm_header& header) {
+    if (out.is_open())
+        out.close();
+    out.clear();
+    out.rdbuf()->pubsetbuf(stream_buffer.data(), stream_buffer.size());
+    out.open(fname.c_str(), std::ios::out | std::ios::binary);
+    hdr = header;
+    next_row = 0;
+    if (!out.is_open()) {
+        std::cout << "Error. Unable to open " << fname << std::endl;
+        return false;
+    }
+
+    out << (hdr.channels == 1 ? "P5\n" : "P6\n");
+    out << hdr.width << " " << hdr.height << "\n";
+    out << hdr.max_col_val << "\n";
+    return (bool)out;
+}
+
+bool pnm_writer::write_rows(unsigned int count, const unsigned char* src) {
+    if (count > hdr.height - next_row) {
+        std::cout << "Error. Write past the last row." << std::endl;
+        return false;
+    }
+    out.write((const char*)src, (std::streamsize)(count * hdr.row_bytes()));
+    next_row += count;
+    return (bool)out;
+}
+
+bool pnm_writer::write_rows(unsigned int count, const std::uint16_t* src) {
+    std::uint64_t samples_per_row = (std::uint64_t)hdr.width * hdr.channels;
+    unsigned int batch = batch_rows(hdr);
+    while (count > 0) {
+        unsigned int rows = std::min(batch, count);
+        std::size_t n = (std::size_t)(rows * samples_per_row);
+        row_buffer.resize((std::size_t)(rows * hdr.row_bytes()));
+        unsigned char* dst = row_buffer.data();
+        if (hdr.bytes_per_sample() == 2) {
+            for (std::size_t i = 0; i < n; ++i) {
+                dst[2 * i] = (unsigned char)(src[i] >> 8);
+                dst[2 * i + 1] = (unsigned char)src[i];
+            }
+        }
+        else {
+            for (std::size_t i = 0; i < n; ++i)
+                dst[i] = (unsigned char)src[i];
+        }
+        if (!write_rows(rows, dst))
+            return false;
+        src += n;
+        count -= rows;
+    }
+    return true;
+}
+
+bool pnm_writer::write_rows(unsigned int count, const unsigned char* r, const unsigned char* g, const unsigned char* b) {
+    if (hdr.bytes_per_sample() != 1) {
+        std::cout << "Error. Planar writes need an 8-bit file." << std::endl;
+        return false;
+    }
+    if (hdr.channels == 1)
+        return write_rows(count, r);
+
+    unsigned int batch = batch_rows(hdr);
+    while (count > 0) {
+        unsigned int rows = std::min(batch, count);
+        std::size_t n = (std::size_t)((std::uint64_t)rows * hdr.width);
+        row_buffer.resize(3 * n);
+        unsigned char* dst = row_buffer.data();
+        for (std::size_t i = 0; i < n; ++i) {
+            dst[3 * i] = r[i];
+            dst[3 * i + 1] = g[i];
+            dst[3 * i + 2] = b[i];
+        }
+        if (!write_rows(rows, dst))
+            return false;
+        r += n;
+        g += n;
+        b += n;
+        count -= rows;
+    }
+    return true;
+}
+
+//flush and close; false if any row failed to reach the file
+
+bool pnm_writer::close() {
+    if (!out.is_open())
+        return false;
+    out.flush();
+    bool ok = (bool)out && next_row == hdr.height;
+    out.close();
+    return ok;
+}
@@ -0,0 +1,80 @@
+//Streaming reader and writer for binary PNM files: P5 (grayscale) and P6 (RGB),
+//with 8 or 16 bits per sample. Rows are moved in bulk through a large buffer,
+//so callers can process an image in bands without holding all of it
+#include <fstream>
+#include <string>
+#include <vector>
+#include <cstdint>
+
+#ifndef PNM_H
+#define PNM_H
+
+struct pnm_header {
+    //1 for P5, 3 for P6
+    unsigned int channels;
+    unsigned int width;
+    unsigned int height;
+    unsigned int max_col_val;
+
+    pnm_header();
+    pnm_header(unsigned int _channels, unsigned int _width, unsigned int _height, unsigned int _max_col_val = 255);
+    //samples wider than 8 bits are stored as 16-bit big endian
+    unsigned int bytes_per_sample() const { return max_col_val > 255 ? 2 : 1; }
+    std::uint64_t row_bytes() const { return (std::uint64_t)width * channels * bytes_per_sample(); }
+    std::uint64_t size() const { return (std::uint64_t)width * height; }
+};
+
+//parse the header of a PNM file held in memory (e.g. a mapped file);
+//offset receives the position of the first sample byte
+bool pnm_parse_header(const unsigned char* data, std::uint64_t size, pnm_header& hdr, std::uint64_t& offset);
+
+class pnm_reader {
+    std::ifstream inp;
+    std::vector<char> stream_buffer;
+    std::vector<unsigned char> row_buffer;
+    pnm_header hdr;
+    unsigned int next_row;
+
+    bool read_header();
+    //read count raw rows into the internal row buffer
+    bool fill(unsigned int count);
+
+public:
+    pnm_reader();
+    //open fname and parse its header
+    bool open(const std::string& fname);
+    const pnm_header& header() const { return hdr; }
+    unsigned int rows_left() const { return hdr.height - next_row; }
+
+    //read count rows of raw file bytes (interleaved, big endian) into dst
+    bool read_rows(unsigned int count, unsigned char* dst);
+    //read count rows as native 16-bit samples, interleaved; 8-bit files are widened
+    bool read_rows(unsigned int count, std::uint16_t* dst);
+    //read count rows of an 8-bit file into separate R,G,B planes; P5 fills all three with the gray value
+    bool read_rows(unsigned int count, unsigned char* r, unsigned char* g, unsigned char* b);
+};
+
+class pnm_writer {
+    std::ofstream out;
+    std::vector<char> stream_buffer;
+    std::vector<unsigned char> row_buffer;
+    pnm_header hdr;
+    unsigned int next_row;
+
+public:
+    pnm_writer();
+    //create fname and write the header
+    bool open(const std::string& fname, const pnm_header& header);
+    const pnm_header& header() const { return hdr; }
+
+    //write count rows of raw file bytes (interleaved, big endian)
+    bool write_rows(unsigned int count, const unsigned char* src);
+    //write count rows of native 16-bit samples, interleaved
+    bool write_rows(unsigned int count, const std::uint16_t* src);
+    //write count rows of an 8-bit file from separate R,G,B planes (only r is used for P5)
+    bool write_rows(unsigned int count, const unsigned char* r, const unsigned char* g, const unsigned char* b);
+    //flush and close; false if any row failed to reach the file
+    bool close();
+};
+
+#endif
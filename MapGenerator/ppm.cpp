@@ -1,9 +1,8 @@
 #include <iostream>
-#include <fstream>
-#include <sstream>
-#include <exception>
+#include <algorithm>
 
 #include "ppm.h"
+#include "pnm.h"
 
 //init with default values
 
@@ -11,6 +10,7 @@ void ppm::init() {
     width = 0;
     height = 0;
     max_col_val = 255;
+    size = 0;
 }
 
 //create a PPM object
@@ -34,7 +34,7 @@ ppm::ppm(const unsigned int _width, const unsigned int _height) {
     height = _height;
     nr_lines = height;
     nr_columns = width;
-    size = width * height;
+    size = (std::uint64_t)width * height;
 
     // fill r, g and b with 0
     r.resize(size);
@@ -45,87 +45,56 @@ ppm::ppm(const unsigned int _width, const unsigned int _height) {
 //read the PPM image from fname
 
 void ppm::read(const std::string& fname) {
-    std::ifstream inp(fname.c_str(), std::ios::in | std::ios::binary);
-    if (inp.is_open()) {
-        std::string line;
-        std::getline(inp, line);
-        if (line != "P6") {
-            std::cout << "Error. Unrecognized file format." << std::endl;
-            return;
-        }
-        std::getline(inp, line);
-        while (line[0] == '#') {
-            std::getline(inp, line);
-        }
-        std::stringstream dimensions(line);
-
-        try {
-            dimensions >> width;
-            dimensions >> height;
-            nr_lines = height;
-            nr_columns = width;
-        }
-        catch (std::exception& e) {
-            std::cout << "Header file format error. " << e.what() << std::endl;
-            return;
-        }
+    pnm_reader inp;
+    if (!inp.open(fname))
+        return;
 
-        std::getline(inp, line);
-        std::stringstream max_val(line);
-        try {
-            max_val >> max_col_val;
-        }
-        catch (std::exception& e) {
-            std::cout << "Header file format error. " << e.what() << std::endl;
-            return;
-        }
+    const pnm_header& hdr = inp.header();
+    width = hdr.width;
+    height = hdr.height;
+    nr_lines = height;
+    nr_columns = width;
+    size = hdr.size();
+    max_col_val = hdr.max_col_val;
 
-        size = width * height;
+    r.resize((std::size_t)size);
+    g.resize((std::size_t)size);
+    b.resize((std::size_t)size);
 
-        r.resize(size);
-        g.resize(size);
-        b.resize(size);
+    if (hdr.bytes_per_sample() == 1) {
+        inp.read_rows(height, r.data(), g.data(), b.data());
+        return;
+    }
 
-        char aux;
-        for (unsigned int i = 0; i < size; ++i) {
-            inp.read(&aux, 1);
-            r[i] = (unsigned char)aux;
-            inp.read(&aux, 1);
-            g[i] = (unsigned char)aux;
-            inp.read(&aux, 1);
-            b[i] = (unsigned char)aux;
+    //16-bit samples are read in bands and rescaled to 0..255
+    std::vector<std::uint16_t> band;
+    unsigned int band_rows = std::max(1u, (1u << 20) / (width * hdr.channels + 1));
+    std::uint64_t k = 0;
+    while (inp.rows_left() > 0) {
+        unsigned int rows = std::min(band_rows, inp.rows_left());
+        band.resize((std::size_t)rows * width * hdr.channels);
+        if (!inp.read_rows(rows, band.data()))
+            return;
+        //for P5 all three offsets land on the gray sample
+        for (std::size_t i = 0; i < band.size(); i += hdr.channels, ++k) {
+            r[k] = (unsigned char)((band[i] * 255u + hdr.max_col_val / 2) / hdr.max_col_val);
+            g[k] = (unsigned char)((band[i + hdr.channels / 2] * 255u + hdr.max_col_val / 2) / hdr.max_col_val);
+            b[k] = (unsigned char)((band[i + hdr.channels - 1] * 255u + hdr.max_col_val / 2) / hdr.max_col_val);
         }
     }
-    else {
-        std::cout << "Error. Unable to open " << fname << std::endl;
-    }
-    inp.close();
+    max_col_val = 255;
 }
 
 //write the PPM image in fname
 
-void ppm::write(const std::string& fname) {
-    std::ofstream inp(fname.c_str(), std::ios::out | std::ios::binary);
-    if (inp.is_open()) {
-
-        inp << "P6\n";
-        inp << width;
-        inp << " ";
-        inp << height << "\n";
-        inp << max_col_val << "\n";
-
-        char aux;
-        for (unsigned int i = 0; i < size; ++i) {
-            aux = (char)r[i];
-            inp.write(&aux, 1);
-            aux = (char)g[i];
-            inp.write(&aux, 1);
-            aux = (char)b[i];
-            inp.write(&aux, 1);
-        }
+bool ppm::write(const std::string& fname) {
+    pnm_writer out;
+    if (!out.open(fname, pnm_header(3, width, height, std::min(max_col_val, 255u))))
+        return false;
+    out.write_rows(height, r.data(), g.data(), b.data());
+    if (!out.close()) {
+        std::cout << "Error. Unable to write " << fname << std::endl;
+        return false;
     }
-    else {
-        std::cout << "Error. Unable to open " << fname << std::endl;
-    }
-    inp.close();
-}
\ No newline at end of file
+    return true;
+}
@@ -1,6 +1,7 @@
 //Process a binary PPM file
 #include <vector>
 #include <string>
+#include <cstdint>
 
 #ifndef PPM_H
 #define PPM_H
@@ -20,18 +21,19 @@ public:
     unsigned int height;
     unsigned int width;
     unsigned int max_col_val;
-    //total number of elements (pixels)
-    unsigned int size;
+    //total number of elements (pixels), 64-bit so images over 4 GiB work
+    std::uint64_t size;
 
     ppm();
     //create a PPM object and fill it with data stored in fname 
     ppm(const std::string& fname);
     //create an "epmty" PPM image with a given width and height;the R,G,B arrays are filled with zeros
     ppm(const unsigned int _width, const unsigned int _height);
-    //read the PPM image from fname
+    //read the PPM image from fname; P5 files fill R,G,B with the gray value
+    //and 16-bit files are scaled down to 8 bits
     void read(const std::string& fname);
-    //write the PPM image in fname
-    void write(const std::string& fname);
+    //write the PPM image in fname; false if it could not be written
+    bool write(const std::string& fname);
 };
 
 #endif
\ No newline at end of file